@@ -0,0 +1,936 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <stdexcept>
+#include <atomic>
+#include <climits>
+#include <set>
+#include <iterator>
+#include <string>
+#include <cstdio>
+
+#include "sequential.h"
+#include "coarsegrained.h"
+#include "finegrainedBronson.h"
+#include "catree.h"
+#include "delegation.h"
+
+#define KEY_SPACE 100000000  // Keys are drawn from [0, KEY_SPACE)
+
+/* Return n distinct sorted keys drawn uniformly from the key space */
+std::vector<int> getSortedKeys(int n, std::mt19937& eng) {
+    std::uniform_int_distribution<> distr(0, KEY_SPACE - 1);
+    std::vector<int> v(n);
+    for (int i = 0; i < n; i++)
+        v[i] = distr(eng);
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+    return v;
+}
+
+double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count() * 1000;
+}
+
+// URL-like keys: a shared scheme, one of a thousand hosts, a section and a
+// unique id, so keys under one host tie on most of their inline prefix
+std::vector<std::string> getUrlKeys(int n) {
+    std::mt19937 g(1);
+    std::vector<std::string> hosts(1000);
+    for (std::string& host : hosts)
+        for (int len = 5 + g() % 8; len > 0; len--)
+            host.push_back('a' + g() % 26);
+    const char* sections[] = {"users", "items", "posts", "search"};
+    std::vector<std::string> keys(n);
+    for (int i = 0; i < n; i++)
+        keys[i] = "https://" + hosts[g() % hosts.size()] + ".example.com/" + sections[g() % 4] + "/" + std::to_string(i);
+    return keys;
+}
+
+// Random version 4 UUIDs in the usual 36-character form
+std::vector<std::string> getUuidKeys(int n) {
+    std::mt19937_64 g(1);
+    std::vector<std::string> keys(n);
+    char buf[40];
+    for (int i = 0; i < n; i++) {
+        uint64_t hi = g(), lo = g();
+        snprintf(buf, sizeof(buf), "%08x-%04x-4%03x-%04x-%012llx", (unsigned)(hi >> 32), (unsigned)(hi >> 16) & 0xffff, (unsigned)hi & 0xfff, (((unsigned)(lo >> 48) & 0x3fff) | 0x8000), (unsigned long long)lo & 0xffffffffffffull);
+        keys[i] = buf;
+    }
+    return keys;
+}
+
+/* Join-based set operation against applying the smaller set key by key */
+void testSetOperations(int n, int m, std::mt19937& eng, std::ofstream& outFile) {
+    std::vector<int> big = getSortedKeys(n, eng);
+    std::vector<int> small = getSortedKeys(m, eng);
+    // Make half of the small set overlap the big one so intersections are not empty
+    for (size_t i = 0; i < small.size(); i += 2)
+        small[i] = big[(i * 7919) % big.size()];
+    std::sort(small.begin(), small.end());
+    small.erase(std::unique(small.begin(), small.end()), small.end());
+
+    for (int op = 0; op < 3; op++) {
+        AVLTree* a = new AVLTree();
+        AVLTree* b = new AVLTree();
+        a->bulkLoad(big.data(), big.size());
+        b->bulkLoad(small.data(), small.size());
+        auto start = std::chrono::steady_clock::now();
+        if (op == 0) a->unionWith(*b);
+        if (op == 1) a->intersectWith(*b);
+        if (op == 2) a->differenceWith(*b);
+        double joinTime = elapsed(start);
+
+        AVLTree* c = new AVLTree();
+        c->bulkLoad(big.data(), big.size());
+        start = std::chrono::steady_clock::now();
+        if (op == 0) {
+            for (int k : small) c->insert(k);
+        }
+        if (op == 1) {
+            // Key-by-key intersection: look every key up and build the result
+            std::vector<int> common;
+            for (int k : small)
+                if (c->search(k)) common.push_back(k);
+            AVLTree* result = new AVLTree();
+            result->bulkLoad(common.data(), common.size());
+            delete result;
+        }
+        if (op == 2) {
+            for (int k : small) c->deleteNode(k);
+        }
+        double keyTime = elapsed(start);
+
+        const char* name = op == 0 ? "Union" : op == 1 ? "Intersection" : "Difference";
+        outFile << name << " of " << big.size() << " and " << small.size() << " keys: join-based " << joinTime << " milliseconds, key by key " << keyTime << " milliseconds\n";
+        delete a;
+        delete b;
+        delete c;
+    }
+}
+
+/* Apply ops to tree with numThreads threads, each taking a contiguous slice */
+template <typename Tree>
+void applyKeyByKey(Tree* tree, const std::vector<BatchOp>& ops, int numThreads) {
+    std::vector<std::thread> threads;
+    size_t slice = (ops.size() + numThreads - 1) / numThreads;
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([tree, &ops, slice, i]() {
+            size_t end = std::min(ops.size(), (i + 1) * slice);
+            for (size_t j = i * slice; j < end; j++) {
+                if (ops[j].insert) tree->insert(ops[j].key);
+                else tree->deleteNode(ops[j].key);
+            }
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+}
+
+/* Batch-parallel apply on the sequential tree against the concurrent trees
+   applying the same batch key by key, all at the same thread count */
+void testBatchApply(int n, int m, int numThreads, std::mt19937& eng, std::ofstream& outFile) {
+    std::vector<int> keys = getSortedKeys(n, eng);
+    std::vector<int> batchKeys = getSortedKeys(m, eng);
+    // Half of the batch deletes existing keys, the other half inserts new ones
+    for (size_t i = 0; i < batchKeys.size(); i += 2)
+        batchKeys[i] = keys[(i * 7919) % keys.size()];
+    std::sort(batchKeys.begin(), batchKeys.end());
+    batchKeys.erase(std::unique(batchKeys.begin(), batchKeys.end()), batchKeys.end());
+    std::vector<BatchOp> ops;
+    for (int k : batchKeys)
+        ops.push_back({k, !std::binary_search(keys.begin(), keys.end(), k)});
+
+    AVLTree* seq = new AVLTree();
+    seq->bulkLoad(keys.data(), keys.size());
+    auto start = std::chrono::steady_clock::now();
+    seq->applyBatch(ops, numThreads);
+    double batchTime = elapsed(start);
+    delete seq;
+
+    AVLTreeCG* cg = new AVLTreeCG();
+    cg->bulkLoad(keys.data(), keys.size());
+    start = std::chrono::steady_clock::now();
+    applyKeyByKey(cg, ops, numThreads);
+    double cgTime = elapsed(start);
+    delete cg;
+
+    AVLTreeFG* bronson = new AVLTreeFG();
+    bronson->bulkLoad(keys.data(), keys.size());
+    start = std::chrono::steady_clock::now();
+    applyKeyByKey(bronson, ops, numThreads);
+    double bronsonTime = elapsed(start);
+    delete bronson;
+
+    outFile << "Batch of " << ops.size() << " updates on " << keys.size() << " keys with " << numThreads << " threads: applyBatch " << batchTime << " milliseconds, coarse-grained " << cgTime << " milliseconds, Bronson " << bronsonTime << " milliseconds\n";
+}
+
+/* Time n lookups one at a time and through searchBatch on the same tree */
+template <typename Tree>
+void timeLookups(Tree* tree, const char* name, const std::vector<int>& queries, std::ofstream& outFile) {
+    std::unique_ptr<bool[]> out(new bool[queries.size()]);
+    auto start = std::chrono::steady_clock::now();
+    size_t hits = 0;
+    for (size_t i = 0; i < queries.size(); i++)
+        hits += tree->search(queries[i]);
+    double oneTime = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    tree->searchBatch(queries.data(), queries.size(), out.get());
+    double batchTime = elapsed(start);
+    size_t batchHits = std::count(out.get(), out.get() + queries.size(), true);
+    outFile << name << ": " << queries.size() << " lookups (" << hits << " hits) one by one " << oneTime << " milliseconds, searchBatch " << batchTime << " milliseconds (" << batchHits << " hits)\n";
+}
+
+/* Single-thread lookup throughput of searchBatch against search on large trees */
+void testSearchBatch(int n, int m, std::mt19937& eng, std::ofstream& outFile) {
+    std::vector<int> keys = getSortedKeys(n, eng);
+    // Half of the queries hit, in random order
+    std::uniform_int_distribution<> distr(0, KEY_SPACE - 1);
+    std::vector<int> queries(m);
+    for (int i = 0; i < m; i++)
+        queries[i] = i % 2 == 0 ? keys[eng() % keys.size()] : distr(eng);
+
+    outFile << "Lookups on " << keys.size() << " keys\n";
+    AVLTree* seq = new AVLTree();
+    seq->bulkLoad(keys.data(), keys.size());
+    timeLookups(seq, "Sequential", queries, outFile);
+    delete seq;
+
+    AVLTreeCG* cg = new AVLTreeCG();
+    cg->bulkLoad(keys.data(), keys.size());
+    timeLookups(cg, "Coarse-grained", queries, outFile);
+    delete cg;
+
+    AVLTreeFG* bronson = new AVLTreeFG();
+    bronson->bulkLoad(keys.data(), keys.size());
+    timeLookups(bronson, "Bronson", queries, outFile);
+    delete bronson;
+}
+
+/* Shared-descent multiGet against per-key lookups for one batch. Clustered
+   batches draw their keys from a narrow slice of the key space, like the
+   batches of a range-partitioned job */
+template <typename Tree>
+void timeMultiGet(Tree* tree, const char* name, const std::vector<int>& batch, std::ofstream& outFile) {
+    std::unique_ptr<bool[]> out(new bool[batch.size()]);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < batch.size(); i++)
+        out[i] = tree->search(batch[i]);
+    double oneTime = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    tree->searchBatch(batch.data(), batch.size(), out.get());
+    double batchTime = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    size_t visited = tree->multiGet(batch.data(), batch.size(), out.get());
+    double multiTime = elapsed(start);
+    outFile << name << ": one by one " << oneTime << " milliseconds, searchBatch " << batchTime << " milliseconds, multiGet " << multiTime << " milliseconds, " << (double)visited / batch.size() << " nodes visited per key\n";
+}
+
+void testMultiGet(int n, int m, bool clustered, bool sorted, std::mt19937& eng, std::ofstream& outFile) {
+    std::vector<int> keys = getSortedKeys(n, eng);
+    int lo = 0, width = KEY_SPACE;
+    if (clustered) {
+        width = KEY_SPACE / 100;
+        lo = std::uniform_int_distribution<>(0, KEY_SPACE - width)(eng);
+    }
+    std::uniform_int_distribution<> distr(lo, lo + width - 1);
+    std::vector<int> batch(m);
+    for (int i = 0; i < m; i++)
+        batch[i] = distr(eng);
+    if (sorted)
+        std::sort(batch.begin(), batch.end());
+
+    outFile << (sorted ? "Sorted " : "") << (clustered ? "Clustered" : "Uniform") << " batch of " << m << " lookups on " << keys.size() << " keys\n";
+    AVLTree* seq = new AVLTree();
+    seq->bulkLoad(keys.data(), keys.size());
+    timeMultiGet(seq, "Sequential", batch, outFile);
+    delete seq;
+
+    AVLTreeCG* cg = new AVLTreeCG();
+    cg->bulkLoad(keys.data(), keys.size());
+    timeMultiGet(cg, "Coarse-grained", batch, outFile);
+    delete cg;
+}
+
+/* Run numThreads threads, each incrementing the counters of its slice of
+   keys with increment, and return the elapsed time */
+template <typename Increment>
+double countConcurrently(const std::vector<int>& keys, int numThreads, Increment increment) {
+    std::vector<std::thread> threads;
+    size_t slice = (keys.size() + numThreads - 1) / numThreads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([&, i]() {
+            size_t end = std::min(keys.size(), (i + 1) * slice);
+            for (size_t j = i * slice; j < end; j++)
+                increment(keys[j]);
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+    return elapsed(start);
+}
+
+/* Counter aggregation: m increments over n counters, hotPercent of them
+   going to 16 hot keys. Compares Bronson's compute, a get and replace retry
+   loop on Bronson, and compute on the coarse-grained map. Every run checks
+   that no increment was lost */
+void testCounters(int n, int m, int hotPercent, int numThreads, std::mt19937& eng, std::ofstream& outFile) {
+    std::vector<int> keys = getSortedKeys(n, eng);
+    std::vector<int> increments(m);
+    for (int i = 0; i < m; i++) {
+        bool hot = (int)(eng() % 100) < hotPercent;
+        increments[i] = keys[hot ? eng() % 16 : eng() % keys.size()];
+    }
+    auto plusOne = [](std::optional<int> v) { return v ? *v + 1 : 1; };
+
+    AVLTreeFG* bronson = new AVLTreeFG();
+    bronson->bulkLoad(keys.data(), keys.size());
+    double computeTime = countConcurrently(increments, numThreads, [&](int k) {
+        bronson->compute(k, plusOne);
+    });
+    double replaceTime = countConcurrently(increments, numThreads, [&](int k) {
+        while (true) {
+            int v = *bronson->get(k);
+            if (bronson->replace(k, v, v + 1))
+                break;
+        }
+    });
+    long long bronsonTotal = 0;
+    for (int k : keys)
+        bronsonTotal += *bronson->get(k);
+    delete bronson;
+
+    AVLMapCG<int, int>* cg = new AVLMapCG<int, int>();
+    for (int k : keys)
+        cg->put(k, 0);
+    double cgTime = countConcurrently(increments, numThreads, [&](int k) {
+        cg->compute(k, plusOne);
+    });
+    long long cgTotal = 0;
+    for (int k : keys)
+        cgTotal += *cg->get(k);
+    delete cg;
+
+    if (bronsonTotal != 2LL * m || cgTotal != m)
+        throw std::runtime_error("Counter increments were lost");
+    outFile << m << " increments on " << keys.size() << " counters, " << hotPercent << "% to 16 hot keys, with " << numThreads << " threads: Bronson compute " << computeTime << " milliseconds, Bronson get and replace " << replaceTime << " milliseconds, coarse-grained compute " << cgTime << " milliseconds\n";
+}
+
+/* Check rank, select and countRange of tree against its sorted keys */
+void checkOrderStatistics(AVLTree& tree, const std::vector<int>& keys, std::mt19937& eng, const char* after) {
+    for (size_t i = 0; i <= keys.size(); i++) {
+        int key = -1;
+        bool found = tree.select(i, key);
+        if (found != (i < keys.size()) || (found && key != keys[i]))
+            throw std::runtime_error(std::string("select failed after ") + after);
+    }
+    std::uniform_int_distribution<> distr(-100, 20100);
+    for (int q = 0; q < 1000; q++) {
+        int lo = distr(eng), hi = distr(eng);
+        size_t rank = std::lower_bound(keys.begin(), keys.end(), lo) - keys.begin();
+        size_t count = lo > hi ? 0 : std::upper_bound(keys.begin(), keys.end(), hi) - keys.begin() - rank;
+        if (tree.rank(lo) != rank || tree.countRange(lo, hi) != count)
+            throw std::runtime_error(std::string("rank or countRange failed after ") + after);
+    }
+    if (tree.countRange(INT_MIN, INT_MAX) != keys.size())
+        throw std::runtime_error(std::string("countRange over all keys failed after ") + after);
+}
+
+/* Keys in [0, 20000) drawn with probability 1/3 each */
+std::vector<int> getSmallKeys(std::mt19937& eng) {
+    std::vector<int> v;
+    for (int k = 0; k < 20000; k++) {
+        if (eng() % 3 == 0)
+            v.push_back(k);
+    }
+    return v;
+}
+
+/* Order statistics of the sequential tree after every operation that
+   rebuilds it from joins rather than from inserts and deletes: the set
+   operations, applyBatch, and the split and join2 a CA tree applies to its
+   base nodes */
+void testSequentialOrderStatistics(std::mt19937& eng) {
+    for (int op = 0; op < 3; op++) {
+        std::vector<int> a = getSmallKeys(eng), b = getSmallKeys(eng), expected;
+        AVLTree ta, tb;
+        ta.bulkLoad(a.data(), a.size());
+        tb.bulkLoad(b.data(), b.size());
+        checkOrderStatistics(ta, a, eng, "bulkLoad");
+        if (op == 0) {
+            ta.unionWith(tb);
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        if (op == 1) {
+            ta.intersectWith(tb);
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        if (op == 2) {
+            ta.differenceWith(tb);
+            std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        checkOrderStatistics(ta, expected, eng, op == 0 ? "unionWith" : op == 1 ? "intersectWith" : "differenceWith");
+        checkOrderStatistics(tb, {}, eng, "being consumed by a set operation");
+    }
+
+    std::vector<int> keys = getSmallKeys(eng);
+    AVLTree tree;
+    tree.bulkLoad(keys.data(), keys.size());
+    std::vector<BatchOp> ops;
+    for (int k = 0; k < 20000; k++) {
+        if (eng() % 4 == 0)
+            ops.push_back({k, eng() % 2 == 0});
+    }
+    if (!tree.applyBatch(ops, 4))
+        throw std::runtime_error("applyBatch rejected a sorted batch");
+    std::set<int> model(keys.begin(), keys.end());
+    for (const BatchOp& op : ops) {
+        if (op.insert) model.insert(op.key);
+        else model.erase(op.key);
+    }
+    keys.assign(model.begin(), model.end());
+    checkOrderStatistics(tree, keys, eng, "applyBatch");
+
+    // Split the tree at its root into two CA leaves and join them back
+    Node *l, *m, *r;
+    int pivot = tree.root->key;
+    tree.split(tree.root, pivot, l, m, r);
+    tree.root = NULL;
+    AVLTree left, right;
+    left.root = l;
+    right.root = tree.join(NULL, m, r);
+    size_t below = std::lower_bound(keys.begin(), keys.end(), pivot) - keys.begin();
+    checkOrderStatistics(left, std::vector<int>(keys.begin(), keys.begin() + below), eng, "a CA split");
+    checkOrderStatistics(right, std::vector<int>(keys.begin() + below, keys.end()), eng, "a CA split");
+    tree.root = tree.join2(left.root, right.root);
+    left.root = right.root = NULL;
+    checkOrderStatistics(tree, keys, eng, "a CA join");
+    std::cout << "Sequential order statistics passed!" << std::endl;
+}
+
+/* compact() of the sequential tree after set operations: both inputs are
+   compacted first, so the result holds nodes from its own arena and from the
+   one it adopted from the consumed tree. Deletes free some of those nodes
+   and inserts add heap nodes before the result is compacted again, which
+   must free every old arena exactly once. */
+void testSequentialCompaction(std::mt19937& eng) {
+    for (int op = 0; op < 3; op++) {
+        std::vector<int> a = getSmallKeys(eng), b = getSmallKeys(eng), expected;
+        AVLTree ta, tb;
+        ta.bulkLoad(a.data(), a.size());
+        tb.bulkLoad(b.data(), b.size());
+        ta.compact();
+        tb.compact();
+        if (op == 0) {
+            ta.unionWith(tb);
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        if (op == 1) {
+            ta.intersectWith(tb);
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        if (op == 2) {
+            ta.differenceWith(tb);
+            std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        std::set<int> model(expected.begin(), expected.end());
+        for (size_t i = 0; i < expected.size(); i += 5) {
+            ta.deleteNode(expected[i]);
+            model.erase(expected[i]);
+        }
+        for (int k = 20000; k < 20100; k++) {
+            ta.insert(k);
+            model.insert(k);
+        }
+        const char* after = op == 0 ? "compacting a union" : op == 1 ? "compacting an intersection" : "compacting a difference";
+        for (int round = 0; round < 2; round++) {
+            ta.compact();
+            std::vector<int> keys(model.begin(), model.end());
+            checkOrderStatistics(ta, keys, eng, after);
+            for (int k = -1; k <= 20100; k++) {
+                if (ta.search(k) != (model.count(k) == 1))
+                    throw std::runtime_error(std::string("search failed after ") + after);
+            }
+        }
+        checkOrderStatistics(tb, {}, eng, "being consumed by a set operation");
+    }
+    std::cout << "Sequential compaction passed!" << std::endl;
+}
+
+/* Correctness of the Bronson tree. Ascending and descending runs of
+   inserts drive the rotations, deleted keys are inserted again to revive
+   their routing nodes, and then threads that each own the keys congruent to
+   their index update the tree concurrently, checking every result against
+   their own model while other threads' updates rebalance around them */
+void testBronson(int keyRange, int opsPerThread, int numThreads, std::mt19937& eng) {
+    AVLTreeFG* tree = new AVLTreeFG();
+    for (int k = 0; k < keyRange / 2; k++) {
+        if (!tree->insert(k))
+            throw std::runtime_error("Bronson insert of an ascending key failed");
+    }
+    for (int k = keyRange - 1; k >= keyRange / 2; k--) {
+        if (!tree->insert(k))
+            throw std::runtime_error("Bronson insert of a descending key failed");
+    }
+    if (tree->insert(keyRange / 3))
+        throw std::runtime_error("Bronson insert of a present key succeeded");
+    for (int k = 0; k < keyRange; k += 2) {
+        if (!tree->deleteNode(k))
+            throw std::runtime_error("Bronson delete of a present key failed");
+    }
+    for (int k = 0; k < keyRange; k++) {
+        if (tree->search(k) != (k % 2 == 1))
+            throw std::runtime_error("Bronson search after deletes failed");
+    }
+    if (tree->deleteNode(0))
+        throw std::runtime_error("Bronson delete of a removed key succeeded");
+    for (int k = 0; k < keyRange; k += 4) {
+        if (!tree->insert(k))
+            throw std::runtime_error("Bronson insert of a removed key failed");
+    }
+
+    std::vector<std::vector<bool>> models(numThreads, std::vector<bool>(keyRange));
+    for (int k = 0; k < keyRange; k++)
+        models[k % numThreads][k] = k % 2 == 1 || k % 4 == 0;
+    std::vector<unsigned> seeds(numThreads);
+    for (unsigned& seed : seeds)
+        seed = eng();
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            std::mt19937 local(seeds[t]);
+            std::vector<bool>& model = models[t];
+            for (int i = 0; i < opsPerThread; i++) {
+                int key = (int)(local() % (keyRange / numThreads)) * numThreads + t;
+                int op = local() % 3;
+                if (op == 0) {
+                    if (tree->insert(key) == model[key])
+                        failed = true;
+                    model[key] = true;
+                }
+                else if (op == 1) {
+                    if (tree->deleteNode(key) != model[key])
+                        failed = true;
+                    model[key] = false;
+                }
+                else if (tree->search(key) != model[key]) {
+                    failed = true;
+                }
+            }
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+    if (failed)
+        throw std::runtime_error("Bronson update or search disagreed with the model");
+
+    std::vector<int> all(keyRange);
+    for (int k = 0; k < keyRange; k++)
+        all[k] = k;
+    std::unique_ptr<bool[]> out(new bool[keyRange]);
+    tree->searchBatch(all.data(), all.size(), out.get());
+    for (int k = 0; k < keyRange; k++) {
+        bool present = models[k % numThreads][k];
+        if (tree->search(k) != present || out[k] != present)
+            throw std::runtime_error("Bronson contents differ from the model");
+    }
+    delete tree;
+    std::cout << "Bronson test passed!" << std::endl;
+}
+
+/* Correctness of the delegated tree: client threads that each own the keys
+   congruent to their index send single requests and batches through
+   execute(), mixed with requests for keys just updated, and check every
+   result against their own model. Keys cross every server boundary. */
+void testDelegatedTree(int keyRange, int opsPerThread, int numThreads, int numServers, std::mt19937& eng) {
+    std::vector<int> sample(keyRange / 10);
+    for (int& k : sample)
+        k = eng() % keyRange;
+    std::vector<int> loaded;
+    for (int k = 0; k < keyRange; k += 3)
+        loaded.push_back(k);
+    AVLTreeDG* tree = new AVLTreeDG(numServers, sample);
+    if (!tree->bulkLoad(loaded.data(), loaded.size()))
+        throw std::runtime_error("Delegated bulkLoad failed");
+
+    std::vector<std::vector<bool>> models(numThreads, std::vector<bool>(keyRange));
+    for (int k : loaded)
+        models[k % numThreads][k] = true;
+    std::vector<unsigned> seeds(numThreads);
+    for (unsigned& seed : seeds)
+        seed = eng();
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            std::mt19937 local(seeds[t]);
+            std::vector<bool>& model = models[t];
+            auto pick = [&]() { return (int)(local() % (keyRange / numThreads)) * numThreads + t; };
+            for (int i = 0; i < opsPerThread; i++) {
+                int key = pick();
+                int op = local() % 4;
+                if (op == 0) {
+                    if (tree->insert(key) == model[key])
+                        failed = true;
+                    model[key] = true;
+                }
+                else if (op == 1) {
+                    if (tree->deleteNode(key) != model[key])
+                        failed = true;
+                    model[key] = false;
+                }
+                else if (op == 2) {
+                    if (tree->search(key) != model[key])
+                        failed = true;
+                }
+                else {
+                    // A batch may hit a key more than once; results follow
+                    // the order of the batch
+                    DelegatedOp ops[20];
+                    bool expected[20], out[20];
+                    for (int j = 0; j < 20; j++) {
+                        int k = j > 0 && local() % 4 == 0 ? ops[j - 1].key : pick();
+                        DelegatedOp::Type type = (DelegatedOp::Type)(local() % 3);
+                        ops[j] = {k, type};
+                        expected[j] = type == DelegatedOp::INSERT ? !model[k] : model[k];
+                        if (type == DelegatedOp::INSERT) model[k] = true;
+                        if (type == DelegatedOp::DELETE) model[k] = false;
+                    }
+                    tree->execute(ops, 20, out);
+                    if (!std::equal(expected, expected + 20, out))
+                        failed = true;
+                }
+            }
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+    if (failed)
+        throw std::runtime_error("Delegated tree disagreed with the model");
+    for (int k = 0; k < keyRange; k++) {
+        if (tree->search(k) != models[k % numThreads][k])
+            throw std::runtime_error("Delegated tree contents differ from the model");
+    }
+    delete tree;
+    std::cout << "Delegated tree test passed!" << std::endl;
+}
+
+/* Atomicity of the Bronson map operations. Single-threaded checks of
+   their results come first, then threads increment eight hot keys through
+   compute and through get and replace retry loops while another thread
+   keeps inserting and removing the keys around them, which unlinks and
+   revives routing nodes next to the hot ones. No increment may be lost. */
+void testBronsonAtomicUpdates(int n, int increments, int numThreads) {
+    AVLTreeFG* tree = new AVLTreeFG();
+    auto plusOne = [](std::optional<int> v) { return v ? *v + 1 : 1; };
+    for (int k = 1; k <= n; k++) {
+        if (tree->putIfAbsent(k, k) != std::nullopt || tree->putIfAbsent(k, 0) != std::optional<int>(k))
+            throw std::runtime_error("Bronson putIfAbsent returned the wrong value");
+        if (tree->replace(k, k + 1, 0) || !tree->replace(k, k, -k) || tree->get(k) != std::optional<int>(-k))
+            throw std::runtime_error("Bronson replace did not compare the value");
+        if (tree->compute(k, plusOne) != 1 - k || tree->compute(n + k, plusOne) != 1 || tree->get(n + k) != std::optional<int>(1))
+            throw std::runtime_error("Bronson compute returned the wrong value");
+        if (tree->replace(2 * n + k, 0, 1) || tree->get(2 * n + k) != std::nullopt)
+            throw std::runtime_error("Bronson replace inserted an absent key");
+    }
+    for (int k = 1; k <= 2 * n; k++) {
+        if (!tree->deleteNode(k))
+            throw std::runtime_error("Bronson delete of a mapped key failed");
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (int i = 0; i < increments; i++) {
+                int k = 10 * (1 + (i + t) % 8);
+                if (i % 2 == 0) {
+                    tree->compute(k, plusOne);
+                    continue;
+                }
+                while (true) {
+                    std::optional<int> v = tree->get(k);
+                    if (v ? tree->replace(k, *v, *v + 1) : tree->putIfAbsent(k, 1) == std::nullopt)
+                        break;
+                }
+            }
+        }));
+    }
+    threads.push_back(std::thread([&]() {
+        for (int round = 0; round < 10; round++) {
+            for (int k = 1; k <= n; k++)
+                if (k % 10 != 0) tree->putIfAbsent(k, 0);
+            for (int k = 1; k <= n; k++)
+                if (k % 10 != 0) tree->deleteNode(k);
+        }
+    }));
+    for (auto& t : threads)
+        t.join();
+    for (int k = 10; k <= 80; k += 10) {
+        if (tree->get(k) != std::optional<int>(numThreads * increments / 8))
+            throw std::runtime_error("Increments of a hot Bronson key were lost");
+    }
+    delete tree;
+    std::cout << "Bronson atomic updates passed!" << std::endl;
+}
+
+/* The Bronson tree keyed by StringKey: concurrent inserts, deletes and
+   borrowed-key lookups of URL and UUID keys, each thread owning the keys
+   at the indices congruent to its own, checked against per-thread models */
+void testBronsonStringKeys(int n, int opsPerThread, int numThreads, std::mt19937& eng) {
+    std::vector<std::string> keys = getUrlKeys(n / 2);
+    std::vector<std::string> uuids = getUuidKeys(n - n / 2);
+    keys.insert(keys.end(), uuids.begin(), uuids.end());
+    // Load every third key in order, then update concurrently
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+    std::vector<StringKey> loaded;
+    std::vector<bool> present(keys.size());
+    for (size_t i = 0; i < order.size(); i += 3) {
+        loaded.push_back(StringKey(keys[order[i]]));
+        present[order[i]] = true;
+    }
+    BronsonTree<StringKey>* tree = new BronsonTree<StringKey>();
+    if (!tree->bulkLoad(loaded.data(), loaded.size()))
+        throw std::runtime_error("StringKey Bronson bulkLoad failed");
+
+    std::vector<std::vector<bool>> models(numThreads, present);
+    std::vector<unsigned> seeds(numThreads);
+    for (unsigned& seed : seeds)
+        seed = eng();
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            std::mt19937 local(seeds[t]);
+            std::vector<bool>& model = models[t];
+            for (int i = 0; i < opsPerThread; i++) {
+                size_t index = (local() % (keys.size() / numThreads)) * numThreads + t;
+                StringKey key = StringKey::borrow(keys[index]);
+                int op = local() % 3;
+                if (op == 0) {
+                    if (tree->insert(key) == model[index])
+                        failed = true;
+                    model[index] = true;
+                }
+                else if (op == 1) {
+                    if (tree->deleteNode(key) != model[index])
+                        failed = true;
+                    model[index] = false;
+                }
+                else if (tree->search(key) != model[index]) {
+                    failed = true;
+                }
+            }
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+    if (failed)
+        throw std::runtime_error("StringKey Bronson tree disagreed with the model");
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (tree->search(StringKey::borrow(keys[i])) != models[i % numThreads][i])
+            throw std::runtime_error("StringKey Bronson tree contents differ from the model");
+    }
+    delete tree;
+    std::cout << "StringKey Bronson test passed!" << std::endl;
+}
+
+/* Concurrent inserts and deletes against range queries on the
+   contention-adapting tree. Writers own the keys congruent to their index,
+   so their models together give the final contents. Every range query must
+   come back sorted, duplicate-free and inside its bounds while bases split
+   under contention and join again once it is gone */
+void testCATree(int keyRange, int opsPerThread, int numThreads, std::mt19937& eng) {
+    AVLTreeCA* tree = new AVLTreeCA();
+    std::vector<std::vector<bool>> models(numThreads, std::vector<bool>(keyRange, false));
+    std::atomic<bool> writing(true);
+    std::atomic<bool> failed(false);
+    std::atomic<int> finished(0);
+    std::vector<unsigned> seeds(2 * numThreads);
+    for (unsigned& seed : seeds)
+        seed = eng();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            std::mt19937 local(seeds[t]);
+            std::vector<bool>& model = models[t];
+            for (int i = 0; i < opsPerThread; i++) {
+                int key = (int)(local() % (keyRange / numThreads)) * numThreads + t;
+                if (local() % 2 == 0) {
+                    if (tree->insert(key) == model[key])
+                        failed = true;
+                    model[key] = true;
+                }
+                else {
+                    if (tree->deleteNode(key) != model[key])
+                        failed = true;
+                    model[key] = false;
+                }
+            }
+            finished++;
+        }));
+    }
+    std::vector<std::thread> readers;
+    for (int t = 0; t < numThreads; t++) {
+        readers.push_back(std::thread([&, t]() {
+            std::mt19937 local(seeds[numThreads + t]);
+            std::vector<int> out;
+            while (writing) {
+                int lo = (int)(local() % keyRange) - keyRange / 8;
+                int hi = lo + (int)(local() % (keyRange / 4));
+                tree->rangeQuery(lo, hi, out);
+                for (size_t i = 0; i < out.size(); i++) {
+                    if (out[i] < lo || out[i] > hi || (i > 0 && out[i - 1] >= out[i]))
+                        failed = true;
+                }
+            }
+        }));
+    }
+    // Sample the number of bases until the writers are done
+    int maxBases = 1;
+    while (finished < numThreads) {
+        maxBases = std::max(maxBases, tree->numBases());
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    for (auto& t : threads)
+        t.join();
+    writing = false;
+    for (auto& t : readers)
+        t.join();
+    if (failed)
+        throw std::runtime_error("CA tree returned a wrong result under concurrent updates");
+    if (maxBases == 1)
+        throw std::runtime_error("CA tree never split under contention");
+
+    std::vector<int> expected;
+    for (int k = 0; k < keyRange; k++) {
+        if (models[k % numThreads][k])
+            expected.push_back(k);
+    }
+    std::vector<int> out;
+    tree->rangeQuery(INT_MIN, INT_MAX, out);
+    if (out != expected)
+        throw std::runtime_error("CA tree contents differ from the model");
+
+    // Without contention every operation lowers the statistic, so the bases
+    // join back; one thread walking the key space reaches all of them
+    int splitBases = tree->numBases();
+    for (int i = 0; i < 100; i++) {
+        for (int k = 0; k < keyRange; k += 64)
+            tree->search(k);
+    }
+    if (tree->numBases() >= splitBases && splitBases > 1)
+        throw std::runtime_error("CA tree bases did not join without contention");
+    tree->rangeQuery(INT_MIN, INT_MAX, out);
+    if (out != expected)
+        throw std::runtime_error("CA tree lost keys while joining");
+    delete tree;
+    std::cout << "CA tree test passed! (" << maxBases << " bases at most, " << splitBases << " after the updates)" << std::endl;
+}
+
+/* Lookups of every key, half of them present, in a Bronson tree keyed by
+   Key, which is std::string or StringKey */
+template <typename Key>
+double timeStringLookups(const std::vector<std::string>& keys, int numThreads) {
+    BronsonTree<Key>* tree = new BronsonTree<Key>();
+    for (size_t i = 0; i < keys.size(); i += 2)
+        tree->insert(Key(keys[i]));
+    std::atomic<size_t> hits(0);
+    std::vector<std::thread> threads;
+    size_t slice = (keys.size() + numThreads - 1) / numThreads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            size_t found = 0;
+            size_t end = std::min(keys.size(), (t + 1) * slice);
+            for (size_t i = t * slice; i < end; i++) {
+                // Spread the lookups over the tree rather than in key order
+                const std::string& key = keys[(i * 7919) % keys.size()];
+                if constexpr (std::is_same<Key, StringKey>::value) found += tree->search(StringKey::borrow(key));
+                else found += tree->search(key);
+            }
+            hits += found;
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+    double time = elapsed(start);
+    delete tree;
+    if (hits != (keys.size() + 1) / 2)
+        throw std::runtime_error("String-keyed Bronson tree lookups missed keys");
+    return time;
+}
+
+/* Bronson lookups with std::string keys, which compare through a pointer
+   to the heap buffer, against StringKey's inline prefix */
+void testStringKeys(int n, int numThreads, std::ofstream& outFile) {
+    std::vector<std::string> urls = getUrlKeys(n);
+    std::vector<std::string> uuids = getUuidKeys(n);
+    double urlString = timeStringLookups<std::string>(urls, numThreads);
+    double urlKey = timeStringLookups<StringKey>(urls, numThreads);
+    double uuidString = timeStringLookups<std::string>(uuids, numThreads);
+    double uuidKey = timeStringLookups<StringKey>(uuids, numThreads);
+    outFile << "Bronson lookups of " << n << " string keys, half present, with " << numThreads << " threads: URL std::string " << urlString << " milliseconds, URL StringKey " << urlKey << " milliseconds, UUID std::string " << uuidString << " milliseconds, UUID StringKey " << uuidKey << " milliseconds\n";
+}
+
+int main() {
+    // Constructing the file path
+    std::string filePath = "./result/batchops_results.txt";
+
+    // Opening the file
+    std::ofstream outputFile(filePath);
+    if (!outputFile.is_open()) {
+        std::cerr << "Error: Could not open the file." << std::endl;
+        return 1;
+    }
+
+    std::random_device rd;
+    std::mt19937 eng(rd());
+    testSequentialOrderStatistics(eng);
+    testSequentialCompaction(eng);
+    testBronson(100000, 200000, 16, eng);
+    testBronsonAtomicUpdates(1000, 8000, 16);
+    testBronsonStringKeys(100000, 50000, 16, eng);
+    testCATree(100000, 200000, 16, eng);
+    testDelegatedTree(100000, 50000, 8, 4, eng);
+
+    std::vector<int> sizes = {1000, 100000, 1000000, 10000000};
+    for (int n : sizes) {
+        for (int m : sizes) {
+            if (m <= n)
+                testSetOperations(n, m, eng, outputFile);
+        }
+    }
+    std::vector<int> threadCounts = {1, 2, 4, 8, 16, 32, 64, 128};
+    for (int m : {10000, 1000000}) {
+        for (int numThreads : threadCounts)
+            testBatchApply(1000000, m, numThreads, eng, outputFile);
+    }
+    for (int n : {100000, 10000000})
+        testSearchBatch(n, 1000000, eng, outputFile);
+    for (int m : {100, 10000, 1000000}) {
+        testMultiGet(10000000, m, false, false, eng, outputFile);
+        testMultiGet(10000000, m, true, false, eng, outputFile);
+        testMultiGet(10000000, m, true, true, eng, outputFile);
+    }
+    for (int numThreads : threadCounts)
+        testStringKeys(1000000, numThreads, outputFile);
+    for (int hotPercent : {0, 50, 90}) {
+        for (int numThreads : threadCounts)
+            testCounters(100000, 1000000, hotPercent, numThreads, eng, outputFile);
+    }
+    std::cout << "Batch operation results written to '" << filePath << "'\n";
+
+    outputFile.close();
+    return 0;
+}
@@ -0,0 +1,347 @@
+#include "bptree.h"
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <immintrin.h>
+
+static_assert(sizeof(LeafBP) <= BP_NODE_BYTES, "leaf larger than BP_NODE_BYTES");
+static_assert(sizeof(InnerBP) <= BP_NODE_BYTES, "inner node larger than BP_NODE_BYTES");
+static_assert(BP_INNER_SLOTS >= 2, "BP_NODE_BYTES too small for an inner node");
+
+NodeBP::NodeBP(bool isLeaf) : version(0), count(0), isLeaf(isLeaf) {}
+
+LeafBP::LeafBP() : NodeBP(true) {}
+
+InnerBP::InnerBP() : NodeBP(false) {}
+
+// Number of keys[0, n) below key, which is where key sits in a sorted node.
+// Keys are compared a vector at a time: the compare mask of a sorted array
+// is a prefix of ones, so the first vector not all below key ends the search.
+static inline int lowerBound(const int* keys, int n, int key) {
+    int i = 0;
+#ifdef __AVX2__
+    __m256i key8 = _mm256_set1_epi32(key);
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(key8, v)));
+        if (mask != 0xff)
+            return i + __builtin_popcount(mask);
+    }
+#endif
+#ifdef __SSE2__
+    __m128i key4 = _mm_set1_epi32(key);
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(key4, v)));
+        if (mask != 0xf)
+            return i + __builtin_popcount(mask);
+    }
+#endif
+    while (i < n && keys[i] < key)
+        i++;
+    return i;
+}
+
+// A reader may see count mid-update; keep it inside the node until the
+// version check throws the read away
+static inline int nodeCount(const NodeBP* node, int slots) {
+    int n = __atomic_load_n(&node->count, __ATOMIC_RELAXED);
+    return std::min(std::max(n, 0), slots);
+}
+
+static void backoff(int attempt) {
+    if (attempt < BP_SPIN_LIMIT)
+        __builtin_ia32_pause();
+    else
+        std::this_thread::yield();
+}
+
+// Note the version of an unlocked node before reading it
+static inline bool readLock(NodeBP* node, uint64_t& v) {
+    v = node->version.load(std::memory_order_acquire);
+    return (v & 1) == 0;
+}
+
+// The reads since readLock were consistent if the version did not move
+static inline bool validate(NodeBP* node, uint64_t v) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return node->version.load(std::memory_order_relaxed) == v;
+}
+
+// Lock a node that has not changed since version v
+static inline bool upgrade(NodeBP* node, uint64_t v) {
+    return node->version.compare_exchange_strong(v, v + 1, std::memory_order_acquire);
+}
+
+static inline void writeUnlock(NodeBP* node) {
+    node->version.fetch_add(1, std::memory_order_release);
+}
+
+BPlusTreeOLC::BPlusTreeOLC() : root(new LeafBP()) {}
+
+BPlusTreeOLC::~BPlusTreeOLC() {
+    freeTree(root);
+}
+
+void BPlusTreeOLC::freeTree(NodeBP* node) {
+    if (!node->isLeaf) {
+        InnerBP* inner = static_cast<InnerBP*>(node);
+        for (int i = 0; i <= inner->count; i++)
+            freeTree(inner->children[i]);
+        delete inner;
+    }
+    else
+        delete static_cast<LeafBP*>(node);
+}
+
+// Optimistic descent to the leaf that holds key. A child's version is read
+// before its parent is validated, so a split of the child that went
+// through the parent cannot slip in between. With splitFull, a full inner
+// node on the way is split instead and the descent restarts.
+bool BPlusTreeOLC::findLeaf(int key, bool splitFull, Path& path) {
+    NodeBP* node = root.load(std::memory_order_acquire);
+    uint64_t v;
+    // The root split stores the new root before unlocking the old one
+    if (!readLock(node, v) || root.load(std::memory_order_acquire) != node)
+        return false;
+    path.parent = nullptr;
+    path.hasFence = false;
+    while (!node->isLeaf) {
+        InnerBP* inner = static_cast<InnerBP*>(node);
+        int n = nodeCount(inner, BP_INNER_SLOTS);
+        if (splitFull && n == BP_INNER_SLOTS) {
+            split(path.parent, path.parentVersion, inner, v);
+            return false;
+        }
+        int pos = lowerBound(inner->keys, n, key);
+        if (pos < n) {
+            path.hasFence = true;
+            path.fence = inner->keys[pos];
+        }
+        NodeBP* child = __atomic_load_n(&inner->children[pos], __ATOMIC_RELAXED);
+        uint64_t cv;
+        if (!validate(inner, v) || !readLock(child, cv) || !validate(inner, v))
+            return false;
+        path.parent = inner;
+        path.parentVersion = v;
+        node = child;
+        v = cv;
+    }
+    path.leaf = static_cast<LeafBP*>(node);
+    path.version = v;
+    return true;
+}
+
+// Split node (version v) under parent (version pv), or under a new root if
+// parent is null. Gives up if either changed; the caller restarts anyway.
+// The descent split every full inner node above, so parent has room.
+void BPlusTreeOLC::split(InnerBP* parent, uint64_t pv, NodeBP* node, uint64_t v) {
+    if (parent != nullptr && !upgrade(parent, pv))
+        return;
+    if (!upgrade(node, v)) {
+        if (parent != nullptr)
+            writeUnlock(parent);
+        return;
+    }
+    if (parent == nullptr && root.load(std::memory_order_relaxed) != node) {
+        writeUnlock(node);
+        return;
+    }
+    int sep;
+    NodeBP* right;
+    if (node->isLeaf) {
+        LeafBP* leaf = static_cast<LeafBP*>(node);
+        LeafBP* sibling = new LeafBP();
+        int mid = leaf->count / 2;
+        sibling->count = leaf->count - mid;
+        std::copy(leaf->keys + mid, leaf->keys + leaf->count, sibling->keys);
+        leaf->count = mid;
+        sep = leaf->keys[mid - 1];
+        right = sibling;
+    }
+    else {
+        InnerBP* inner = static_cast<InnerBP*>(node);
+        InnerBP* sibling = new InnerBP();
+        int mid = inner->count / 2;
+        sep = inner->keys[mid];
+        sibling->count = inner->count - mid - 1;
+        std::copy(inner->keys + mid + 1, inner->keys + inner->count, sibling->keys);
+        std::copy(inner->children + mid + 1, inner->children + inner->count + 1, sibling->children);
+        inner->count = mid;
+        right = sibling;
+    }
+    if (parent != nullptr) {
+        int pos = lowerBound(parent->keys, parent->count, sep);
+        std::copy_backward(parent->keys + pos, parent->keys + parent->count, parent->keys + parent->count + 1);
+        std::copy_backward(parent->children + pos + 1, parent->children + parent->count + 1, parent->children + parent->count + 2);
+        parent->keys[pos] = sep;
+        parent->children[pos + 1] = right;
+        parent->count++;
+        writeUnlock(parent);
+    }
+    else {
+        InnerBP* newRoot = new InnerBP();
+        newRoot->count = 1;
+        newRoot->keys[0] = sep;
+        newRoot->children[0] = node;
+        newRoot->children[1] = right;
+        root.store(newRoot, std::memory_order_release);
+    }
+    writeUnlock(node);
+}
+
+bool BPlusTreeOLC::tryInsert(int key, bool& inserted) {
+    Path path;
+    if (!findLeaf(key, true, path))
+        return false;
+    LeafBP* leaf = path.leaf;
+    if (nodeCount(leaf, BP_LEAF_SLOTS) == BP_LEAF_SLOTS) {
+        split(path.parent, path.parentVersion, leaf, path.version);
+        return false;
+    }
+    if (!upgrade(leaf, path.version))
+        return false;
+    int pos = lowerBound(leaf->keys, leaf->count, key);
+    inserted = pos == leaf->count || leaf->keys[pos] != key;
+    if (inserted) {
+        std::copy_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        leaf->keys[pos] = key;
+        leaf->count++;
+    }
+    writeUnlock(leaf);
+    return true;
+}
+
+bool BPlusTreeOLC::insert(int key) {
+    bool inserted;
+    for (int attempt = 0; !tryInsert(key, inserted); attempt++)
+        backoff(attempt);
+    return inserted;
+}
+
+bool BPlusTreeOLC::tryDelete(int key, bool& deleted) {
+    Path path;
+    if (!findLeaf(key, false, path))
+        return false;
+    LeafBP* leaf = path.leaf;
+    if (!upgrade(leaf, path.version))
+        return false;
+    int pos = lowerBound(leaf->keys, leaf->count, key);
+    deleted = pos < leaf->count && leaf->keys[pos] == key;
+    if (deleted) {
+        std::copy(leaf->keys + pos + 1, leaf->keys + leaf->count, leaf->keys + pos);
+        leaf->count--;
+    }
+    writeUnlock(leaf);
+    return true;
+}
+
+bool BPlusTreeOLC::deleteNode(int key) {
+    bool deleted;
+    for (int attempt = 0; !tryDelete(key, deleted); attempt++)
+        backoff(attempt);
+    return deleted;
+}
+
+bool BPlusTreeOLC::trySearch(int key, bool& found) {
+    Path path;
+    if (!findLeaf(key, false, path))
+        return false;
+    LeafBP* leaf = path.leaf;
+    int n = nodeCount(leaf, BP_LEAF_SLOTS);
+    int pos = lowerBound(leaf->keys, n, key);
+    found = pos < n && leaf->keys[pos] == key;
+    return validate(leaf, path.version);
+}
+
+bool BPlusTreeOLC::search(int key) {
+    bool found;
+    for (int attempt = 0; !trySearch(key, found); attempt++)
+        backoff(attempt);
+    return found;
+}
+
+// Append the keys in [from, hi] of the leaf holding from
+bool BPlusTreeOLC::tryScanLeaf(int from, int hi, std::vector<int>& out, Path& path) {
+    if (!findLeaf(from, false, path))
+        return false;
+    LeafBP* leaf = path.leaf;
+    int n = nodeCount(leaf, BP_LEAF_SLOTS);
+    for (int i = lowerBound(leaf->keys, n, from); i < n && leaf->keys[i] <= hi; i++)
+        out.push_back(leaf->keys[i]);
+    return validate(leaf, path.version);
+}
+
+// Replace out with the keys in [lo, hi] in ascending order, one leaf at a
+// time: each next leaf is found from the root just past the last one's fence
+void BPlusTreeOLC::rangeQuery(int lo, int hi, std::vector<int>& out) {
+    out.clear();
+    for (int from = lo; from <= hi; ) {
+        size_t mark = out.size();
+        Path path;
+        for (int attempt = 0; !tryScanLeaf(from, hi, out, path); attempt++) {
+            out.resize(mark);
+            backoff(attempt);
+        }
+        if (!path.hasFence || path.fence >= hi)
+            return;
+        from = path.fence + 1;
+    }
+}
+
+// Load n strictly increasing keys in O(n) into full leaves, with inner
+// levels built bottom-up. Only valid on an empty tree; returns false without
+// modifying the tree otherwise.
+bool BPlusTreeOLC::bulkLoad(const int* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted + n, std::greater_equal<int>()) != sorted + n)
+        return false;
+    NodeBP* first;
+    for (int attempt = 0; ; attempt++) {
+        first = root.load(std::memory_order_acquire);
+        uint64_t v;
+        if (readLock(first, v) && upgrade(first, v)) {
+            if (root.load(std::memory_order_acquire) == first)
+                break;
+            writeUnlock(first);
+        }
+        backoff(attempt);
+    }
+    if (!first->isLeaf || first->count != 0) {
+        writeUnlock(first);
+        return false;
+    }
+    // Nodes of the level being built, with the largest key under each
+    std::vector<NodeBP*> level;
+    std::vector<int> maxKeys;
+    for (size_t i = 0; i < n; i += BP_LEAF_SLOTS) {
+        LeafBP* leaf = level.empty() ? static_cast<LeafBP*>(first) : new LeafBP();
+        leaf->count = std::min(n - i, (size_t)BP_LEAF_SLOTS);
+        std::copy(sorted + i, sorted + i + leaf->count, leaf->keys);
+        level.push_back(leaf);
+        maxKeys.push_back(leaf->keys[leaf->count - 1]);
+    }
+    while (level.size() > 1) {
+        // Spread children evenly so that no inner node is left with one
+        size_t groups = (level.size() + BP_INNER_SLOTS) / (BP_INNER_SLOTS + 1);
+        std::vector<NodeBP*> parents;
+        std::vector<int> parentMaxKeys;
+        for (size_t g = 0, i = 0; g < groups; g++) {
+            size_t end = level.size() * (g + 1) / groups;
+            InnerBP* inner = new InnerBP();
+            inner->count = end - i - 1;
+            for (int c = 0; i < end; c++, i++) {
+                inner->children[c] = level[i];
+                if (c < inner->count)
+                    inner->keys[c] = maxKeys[i];
+            }
+            parents.push_back(inner);
+            parentMaxKeys.push_back(maxKeys[end - 1]);
+        }
+        level.swap(parents);
+        maxKeys.swap(parentMaxKeys);
+    }
+    if (!level.empty() && level[0] != first)
+        root.store(level[0], std::memory_order_release);
+    writeUnlock(first);
+    return true;
+}
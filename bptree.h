@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "hugepage.h"
+
+// Size of every node, 64 to 256 bytes; a node spans BP_NODE_BYTES / 64 lines
+#define BP_NODE_BYTES 256
+// Version, count and leaf flag
+#define BP_HEADER_BYTES 16
+#define BP_LEAF_SLOTS ((BP_NODE_BYTES - BP_HEADER_BYTES) / 4)
+// n keys and n + 1 children
+#define BP_INNER_SLOTS ((BP_NODE_BYTES - BP_HEADER_BYTES - 8) / 12)
+// Restarts before a thread starts yielding to a writer holding its node
+#define BP_SPIN_LIMIT 128
+
+class NodeBP : public HugePageNode {
+public:
+    // Sequence lock as in AVLTreeCG: odd while a writer holds the node
+    std::atomic<uint64_t> version;
+    int count;
+    bool isLeaf;
+
+    NodeBP(bool isLeaf);
+};
+
+class alignas(64) LeafBP : public NodeBP {
+public:
+    int keys[BP_LEAF_SLOTS];
+
+    LeafBP();
+};
+
+// Child i holds the keys in (keys[i - 1], keys[i]]; the last child has no
+// upper bound
+class alignas(64) InnerBP : public NodeBP {
+public:
+    int keys[BP_INNER_SLOTS];
+    NodeBP* children[BP_INNER_SLOTS + 1];
+
+    InnerBP();
+};
+
+/*
+ * B+-tree with fat nodes and optimistic lock coupling (Leis et al.), as a
+ * fat-node baseline for the AVL trees: one node costs a few adjacent cache
+ * lines and replaces several levels of binary nodes. Readers take no locks;
+ * they note each node's version, read it, and restart if the version moved.
+ * Writers lock only the nodes they change, splitting full nodes on the way
+ * down so a split never has to climb. Keys inside a node are searched with
+ * SSE2 compare-and-movemask, or AVX2 when built with -mavx2.
+ *
+ * Deletes do not merge underfull nodes, so nodes are never unlinked while
+ * the tree is in use and need no deferred reclamation. Range queries read
+ * each leaf atomically but are not a snapshot of the whole range.
+ */
+class BPlusTreeOLC {
+public:
+    std::atomic<NodeBP*> root;
+    BPlusTreeOLC();
+    ~BPlusTreeOLC();
+
+    bool insert(int key);
+    bool deleteNode(int key);
+    bool search(int key);
+    void rangeQuery(int lo, int hi, std::vector<int>& out);
+    bool bulkLoad(const int* sorted, size_t n);
+
+private:
+    // Where a descent ended, with the versions it read on the way
+    struct Path {
+        LeafBP* leaf;
+        uint64_t version;
+        InnerBP* parent;
+        uint64_t parentVersion;
+        // Largest key the leaf can hold, unless it is the rightmost leaf
+        bool hasFence;
+        int fence;
+    };
+
+    // Each returns false when it has to restart from the root
+    bool findLeaf(int key, bool splitFull, Path& path);
+    bool tryInsert(int key, bool& inserted);
+    bool tryDelete(int key, bool& deleted);
+    bool trySearch(int key, bool& found);
+    bool tryScanLeaf(int from, int hi, std::vector<int>& out, Path& path);
+    void split(InnerBP* parent, uint64_t pv, NodeBP* node, uint64_t v);
+    void freeTree(NodeBP* node);
+};
@@ -0,0 +1,253 @@
+#include "catree.h"
+#include <climits>
+#include <algorithm>
+
+RouteCA::RouteCA(int key, NodeCA* left, NodeCA* right, RouteCA* parent)
+    : NodeCA(true), key(key), left(left), right(right), parent(parent) {}
+
+BaseCA::BaseCA(RouteCA* parent) : NodeCA(false), statistic(0), valid(true), parent(parent) {}
+
+AVLTreeCA::AVLTreeCA() : root(new BaseCA(nullptr)) {}
+
+// Retired nodes are freed with the EpochManager
+AVLTreeCA::~AVLTreeCA() {
+    freeNode(root);
+}
+
+static void freeNodeCA(void* p) {
+    NodeCA* node = static_cast<NodeCA*>(p);
+    if (node->isRoute) delete static_cast<RouteCA*>(node);
+    else delete static_cast<BaseCA*>(node);
+}
+
+void AVLTreeCA::freeNode(NodeCA* node) {
+    if (!node->isRoute) {
+        delete static_cast<BaseCA*>(node);
+        return;
+    }
+    RouteCA* route = static_cast<RouteCA*>(node);
+    freeNode(route->left);
+    freeNode(route->right);
+    delete route;
+}
+
+// Route to the base node responsible for key and lock it, recording whether
+// the lock was contended. If upper is given it receives the exclusive upper
+// bound of the base's key range, or LLONG_MAX if the range is unbounded.
+BaseCA* AVLTreeCA::lockBase(int key, long long* upper) {
+    while (true) {
+        long long bound = LLONG_MAX;
+        NodeCA* node = root.load();
+        while (node->isRoute) {
+            RouteCA* route = static_cast<RouteCA*>(node);
+            if (key < route->key) {
+                bound = route->key;
+                node = route->left.load();
+            }
+            else {
+                node = route->right.load();
+            }
+        }
+        BaseCA* base = static_cast<BaseCA*>(node);
+        if (base->lock.try_lock()) {
+            base->statistic -= CA_UNCONTENDED;
+        }
+        else {
+            base->lock.lock();
+            base->statistic += CA_CONTENDED;
+        }
+        if (base->valid) {
+            if (upper) *upper = bound;
+            return base;
+        }
+        base->lock.unlock();
+    }
+}
+
+// Adapt base to its contention if a threshold was crossed, then unlock it
+void AVLTreeCA::release(BaseCA* base) {
+    if (base->statistic > CA_SPLIT_THRESHOLD)
+        splitBase(base);
+    else if (base->statistic < CA_JOIN_THRESHOLD)
+        joinBase(base);
+    base->lock.unlock();
+}
+
+std::atomic<NodeCA*>& AVLTreeCA::slotOf(RouteCA* parent, NodeCA* child) {
+    if (parent == nullptr)
+        return root;
+    return parent->left.load() == child ? parent->left : parent->right;
+}
+
+// The retiring thread is itself inside an epoch and still holds the locks
+// of retired bases, which it releases before leaving, so nothing is freed
+// while it can still touch it
+void AVLTreeCA::retire(NodeCA* node) {
+    epochs.retire(node, freeNodeCA);
+}
+
+// Split base at the root of its tree into two bases under a new route node.
+// A base's parent only changes under the base's lock, and the parent cannot
+// be removed by a join while the base is locked, so no other lock is needed.
+void AVLTreeCA::splitBase(BaseCA* base) {
+    base->statistic = 0;
+    Node* top = base->tree.root;
+    if (top == NULL || top->left == NULL)
+        return;
+    Node *l, *m, *r;
+    base->tree.split(top, top->key, l, m, r);
+    BaseCA* left = new BaseCA(nullptr);
+    BaseCA* right = new BaseCA(nullptr);
+    left->tree.root = l;
+    right->tree.root = base->tree.join(NULL, m, r);
+    RouteCA* route = new RouteCA(m->key, left, right, base->parent);
+    left->parent = right->parent = route;
+
+    slotOf(base->parent, base).store(route);
+    base->tree.root = NULL;
+    base->valid = false;
+    retire(base);
+}
+
+// Merge base with its neighbour on the other side of its parent route node,
+// removing that route node. Gives up if the neighbour is busy.
+void AVLTreeCA::joinBase(BaseCA* base) {
+    base->statistic = 0;
+    RouteCA* parent = base->parent;
+    if (parent == nullptr || !joinLock.try_lock())
+        return;
+    bool isLeft = parent->left.load() == base;
+    NodeCA* sibling = isLeft ? parent->right.load() : parent->left.load();
+    NodeCA* node = sibling;
+    while (node->isRoute) {
+        RouteCA* route = static_cast<RouteCA*>(node);
+        node = isLeft ? route->left.load() : route->right.load();
+    }
+    BaseCA* neighbour = static_cast<BaseCA*>(node);
+    if (!neighbour->lock.try_lock()) {
+        joinLock.unlock();
+        return;
+    }
+    if (!neighbour->valid) {
+        neighbour->lock.unlock();
+        joinLock.unlock();
+        return;
+    }
+
+    BaseCA* merged = new BaseCA(nullptr);
+    if (isLeft)
+        merged->tree.root = base->tree.join2(base->tree.root, neighbour->tree.root);
+    else
+        merged->tree.root = base->tree.join2(neighbour->tree.root, base->tree.root);
+    RouteCA* grandparent = parent->parent;
+    NodeCA* replacement;
+    if (sibling == neighbour) {
+        merged->parent = grandparent;
+        replacement = merged;
+    }
+    else {
+        merged->parent = neighbour->parent;
+        slotOf(neighbour->parent, neighbour).store(merged);
+        static_cast<RouteCA*>(sibling)->parent = grandparent;
+        replacement = sibling;
+    }
+    // Until the parent is unlinked, keys of base still route to base, which
+    // is invalid by then, so lookups retry instead of missing keys
+    base->valid = false;
+    neighbour->valid = false;
+    slotOf(grandparent, parent).store(replacement);
+    base->tree.root = NULL;
+    neighbour->tree.root = NULL;
+    neighbour->lock.unlock();
+    joinLock.unlock();
+    retire(base);
+    retire(neighbour);
+    retire(parent);
+}
+
+bool AVLTreeCA::insert(int key) {
+    epochs.enter();
+    BaseCA* base = lockBase(key, nullptr);
+    bool inserted = !base->tree.search(key);
+    if (inserted)
+        base->tree.insert(key);
+    release(base);
+    epochs.leave();
+    return inserted;
+}
+
+bool AVLTreeCA::deleteNode(int key) {
+    epochs.enter();
+    BaseCA* base = lockBase(key, nullptr);
+    bool deleted = base->tree.search(key);
+    if (deleted)
+        base->tree.deleteNode(key);
+    release(base);
+    epochs.leave();
+    return deleted;
+}
+
+bool AVLTreeCA::search(int key) {
+    epochs.enter();
+    BaseCA* base = lockBase(key, nullptr);
+    bool found = base->tree.search(key);
+    release(base);
+    epochs.leave();
+    return found;
+}
+
+static void collectRange(Node* node, int lo, int hi, std::vector<int>& out) {
+    if (node == NULL)
+        return;
+    if (lo < node->key)
+        collectRange(node->left, lo, hi, out);
+    if (lo <= node->key && node->key <= hi)
+        out.push_back(node->key);
+    if (node->key < hi)
+        collectRange(node->right, lo, hi, out);
+}
+
+// Replace out with the keys in [lo, hi] in ascending order. Bases are
+// locked one at a time in key order, so each base is read atomically but
+// the result is not one snapshot of the whole tree. The bound from lockBase
+// may come from a route a concurrent join just removed, in which case the
+// base also holds keys at or past it; those are left to the next step,
+// which finds the same base again, so no key is collected twice.
+void AVLTreeCA::rangeQuery(int lo, int hi, std::vector<int>& out) {
+    out.clear();
+    long long next = lo;
+    while (next <= hi) {
+        long long upper;
+        epochs.enter();
+        BaseCA* base = lockBase((int)next, &upper);
+        collectRange(base->tree.root, (int)next, (int)std::min((long long)hi, upper - 1), out);
+        release(base);
+        epochs.leave();
+        next = upper;
+    }
+}
+
+// Load n strictly increasing keys into a tree that has never been split.
+// Returns false without modifying the tree otherwise.
+bool AVLTreeCA::bulkLoad(const int* sorted, size_t n) {
+    epochs.enter();
+    BaseCA* base = lockBase(INT_MIN, nullptr);
+    bool loaded = base->parent == nullptr && base->tree.bulkLoad(sorted, n);
+    base->lock.unlock();
+    epochs.leave();
+    return loaded;
+}
+
+int AVLTreeCA::countBases(NodeCA* node) {
+    if (!node->isRoute)
+        return 1;
+    RouteCA* route = static_cast<RouteCA*>(node);
+    return countBases(route->left) + countBases(route->right);
+}
+
+int AVLTreeCA::numBases() {
+    epochs.enter();
+    int n = countBases(root);
+    epochs.leave();
+    return n;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "sequential.h"
+#include "hugepage.h"
+#include "epoch.h"
+
+// Every lock acquisition adjusts the contention statistic of its base node:
+// up by CA_CONTENDED when the lock had to be waited for, down by
+// CA_UNCONTENDED otherwise. Past CA_SPLIT_THRESHOLD the base splits in two,
+// below CA_JOIN_THRESHOLD it joins with its neighbour.
+#define CA_CONTENDED 250
+#define CA_UNCONTENDED 1
+#define CA_SPLIT_THRESHOLD 1000
+#define CA_JOIN_THRESHOLD -1000
+
+class RouteCA;
+
+// Common head of route and base nodes, so a child pointer can hold either
+class NodeCA : public HugePageNode {
+public:
+    const bool isRoute;
+
+    NodeCA(bool isRoute) : isRoute(isRoute) {}
+};
+
+// Keys below key are found through left, the others through right
+class RouteCA : public NodeCA {
+public:
+    int key;
+    std::atomic<NodeCA*> left;
+    std::atomic<NodeCA*> right;
+    // Only read and written under the tree's joinLock
+    RouteCA* parent;
+
+    RouteCA(int key, NodeCA* left, NodeCA* right, RouteCA* parent);
+};
+
+// A sequential AVL tree holding one key range, with its own lock. Everything
+// but the lock is only touched while holding it.
+class BaseCA : public NodeCA {
+public:
+    AVLTree tree;
+    std::mutex lock;
+    int statistic;
+    // Cleared when a split or join replaces this base; a thread that locks
+    // an invalid base starts over from the root
+    bool valid;
+    RouteCA* parent;
+
+    BaseCA(RouteCA* parent);
+};
+
+// Contention-adapting tree: a routing layer of RouteCA nodes over BaseCA
+// leaf containers. Contended bases split and idle neighbours join, so the
+// number of locks follows the contention of every key range at runtime
+// instead of being fixed like the shard count of a ShardedTree.
+class AVLTreeCA {
+public:
+    AVLTreeCA();
+    ~AVLTreeCA();
+
+    bool insert(int key);
+    bool deleteNode(int key);
+    bool search(int key);
+    void rangeQuery(int lo, int hi, std::vector<int>& out);
+    bool bulkLoad(const int* sorted, size_t n);
+
+    // Number of base nodes, for statistics; not synchronized with updates
+    int numBases();
+
+private:
+    std::atomic<NodeCA*> root;
+    // Serializes joins, which are rare and the only operations that remove
+    // route nodes or change their parents
+    std::mutex joinLock;
+    // Replaced nodes may still be read by concurrent traversals, so they
+    // are retired through epochs. Every public operation runs inside one,
+    // from the first route it reads until its base is released.
+    EpochManager epochs;
+
+    BaseCA* lockBase(int key, long long* upper);
+    void release(BaseCA* base);
+    void splitBase(BaseCA* base);
+    void joinBase(BaseCA* base);
+    std::atomic<NodeCA*>& slotOf(RouteCA* parent, NodeCA* child);
+    void retire(NodeCA* node);
+    int countBases(NodeCA* node);
+    void freeNode(NodeCA* node);
+};
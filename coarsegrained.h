@@ -1,48 +1,878 @@
+#pragma once
 #include <iostream>
 #include <vector>
 #include <mutex>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <optional>
+#include <type_traits>
+#include <cstddef>
+#include "epoch.h"
+#include "queuelock.h"
+#include "relayout.h"
+#include "hugepage.h"
+#include "parallel.h"
 
-class NodeCG {
+// No AVL tree over int keys is deeper than this; a speculative search that
+// walks further is following pointers a writer is rearranging
+#define SEQ_MAX_DEPTH 64
+// Lock slot of the reader group: the first reader takes writeLock for all
+// readers and the last one out, possibly another thread, releases it
+#define READER_GROUP_SLOT 0
+
+// Value type of a tree used as a plain set of keys. It takes no room in the
+// node, so NodeCG is as large as it was before the tree held values.
+struct Unit {};
+
+template <typename Key, typename Value>
+class CGNode : public HugePageNode {
 public:
-    int key;
-    NodeCG* left;
-    NodeCG* right;
+    Key key;
+    CGNode* left;
+    CGNode* right;
     int height;
+    // Number of nodes in the subtree rooted here
+    int size;
+    [[no_unique_address]] Value value;
 
-    NodeCG(int key);
+    CGNode(const Key& key, const Value& value = Value()) : key(key), left(nullptr), right(nullptr), height(1), size(1), value(value) {}
 };
 
-class AVLTreeCG {
+typedef CGNode<int, Unit> NodeCG;
+
+/*
+ * Ordered map over any Key ordered by Compare, with a Value stored in every
+ * node, under one global lock. AVLTreeCG, the int set, is its <int, Unit>
+ * instance. Everything is in this header because Key and Value are
+ * open-ended.
+ *
+ * WriteLock is the global lock, taken through the slot interface of
+ * queuelock.h. AVLTreeCG keeps std::mutex; the queue locks replace its
+ * futex wakeups with local spinning when many writers contend.
+ *
+ * Lookups of values return copies taken under the read lock, so Value need
+ * not be safe to read while a writer changes it. Only search() on integral
+ * keys runs speculatively; a torn read of any other key cannot be detected
+ * and discarded.
+ */
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+class BasicAVLTreeCG {
 public:
-    NodeCG* root;
-    AVLTreeCG();
-    ~AVLTreeCG();
+    typedef CGNode<Key, Value> Node;
+
+    Node* root;
+    explicit BasicAVLTreeCG(const Compare& comp = Compare());
+    ~BasicAVLTreeCG();
+
+    BasicAVLTreeCG(const BasicAVLTreeCG&) = delete;
+    BasicAVLTreeCG& operator=(const BasicAVLTreeCG&) = delete;
 
-    bool insert(int key);
-    bool deleteNode(int key);
-    bool search(int key);
+    bool insert(const Key& key);
+    bool deleteNode(const Key& key);
+    bool search(const Key& key);
+    void searchBatch(const Key* keys, size_t n, bool* out);
+    size_t multiGet(const Key* keys, size_t n, bool* out);
     void preOrder();
+    void forEachInRange(const Key& lo, const Key& hi, const std::function<void(const Key&)>& fn);
+    void rangeQuery(const Key& lo, const Key& hi, std::vector<Key>& out);
+    void collectRange(const Key& lo, const Key& hi, size_t maxKeys, std::vector<Key>& out);
+    // Order statistics from the subtree sizes, O(log n) under the read lock:
+    // the number of keys below key, the i-th smallest key (from 0; false if
+    // there are at most i keys) and the number of keys in [lo, hi]
+    size_t rank(const Key& key);
+    bool select(size_t i, Key& key);
+    size_t countRange(const Key& lo, const Key& hi);
+    bool bulkLoad(const Key* sorted, size_t n);
+    // Stop-the-world relayout of every node into one arena in vEB order
+    void compact();
+
+    std::optional<Value> get(const Key& key);
+    bool contains(const Key& key);
+    // Insert key or replace its value; returns the value replaced, if any
+    std::optional<Value> put(const Key& key, const Value& value);
+    // Insert key only if it is absent; returns the value already there, if
+    // any, in which case the tree is unchanged
+    std::optional<Value> putIfAbsent(const Key& key, const Value& value);
+    // Set key's value to desired only if it is present with value expected
+    bool replace(const Key& key, const Value& expected, const Value& desired);
+    // Atomically map key to fn(current value, nullopt if absent) and return
+    // the new value. fn runs under the write lock and must not call back
+    // into the tree.
+    template <typename Fn>
+    Value compute(const Key& key, Fn fn);
+    // Returns the value removed, if key was present
+    std::optional<Value> remove(const Key& key);
+    size_t size();
+
+    // Searches that found a writer in their way and retried under the read lock
+    long searchRetries() const;
 
 private:
-    std::mutex writeLock;
+    // Runs batches of operations under one write lock through the helpers
+    friend class AVLTreeFC;
+
+    // Whether search() may walk the tree without locks
+    static constexpr bool speculative = std::is_integral<Key>::value;
+
+    Compare comp;
+    WriteLock writeLock;
     std::mutex readLock;
     int readCount;
+    // Sequence lock: odd while a writer is inside. search() walks the tree
+    // without locks and is valid if seq did not change meanwhile. Unlinked
+    // nodes are retired through epochs, since speculative readers may still
+    // be reading them.
+    std::atomic<unsigned long> seq;
+    std::atomic<long> retries;
+    EpochManager epochs;
+    // Nodes laid out by the last compact(), empty before the first one
+    NodeArena<Node> arena;
 
     void startWrite();
     void endWrite();
     void startRead();
     void endRead();
-    
-    NodeCG* rightRotate(NodeCG* y);
-    NodeCG* leftRotate(NodeCG* x);
-    int getBalance(NodeCG* N) const;
-    int height(NodeCG* N) const;
-    NodeCG* minValueNode(NodeCG* node);
-
-    NodeCG* insertHelper(NodeCG* node, int key, bool& err);
-    NodeCG* deleteHelper(NodeCG* node, int key, bool& err);
-    bool searchHelper(NodeCG* node, int key) const;
-    void preOrderHelper(NodeCG* node) const;
-    void freeTree(NodeCG* node);
+
+    // Writer-side store to root or to the key or a child of a linked node,
+    // which speculative searches load without locks. Relaxed is enough: the
+    // seqlock discards whatever such a search read while a writer was in.
+    template <typename T>
+    static void storeShared(T& field, const T& value);
+
+    Node* rightRotate(Node* y);
+    Node* leftRotate(Node* x);
+    int getBalance(Node* N) const;
+    int height(Node* N) const;
+    int size(Node* N) const;
+    size_t countBelow(Node* node, const Key& key, bool inclusive) const;
+    Node* minValueNode(Node* node);
+    Node* find(Node* node, const Key& key) const;
+
+    Node* insertHelper(Node* node, const Key& key, const Value& value, bool replace, std::optional<Value>& old);
+    Node* deleteHelper(Node* node, const Key& key, std::optional<Value>& old);
+    bool searchHelper(Node* node, const Key& key) const;
+    bool searchOptimistic(const Key& key, bool& found) const;
+    size_t multiGetHelper(Node* node, const std::pair<Key, size_t>* batch, size_t n, bool* out) const;
+    void preOrderHelper(Node* node) const;
+    void forEachInRangeHelper(Node* node, const Key& lo, const Key& hi, const std::function<void(const Key&)>& fn) const;
+    void collectRangeHelper(Node* node, const Key& lo, const Key& hi, size_t maxKeys, std::vector<Key>& out) const;
+    Node* buildHelper(const Key* sorted, size_t lo, size_t hi, int depth);
+    void freeTree(Node* node);
+    void retireNode(Node* node);
+    void retireTree(Node* node);
+    static void freeNode(void* p);
+    static void freeArenaNodes(void* p);
+};
+
+typedef BasicAVLTreeCG<int, Unit, std::less<int>, MutexLock> AVLTreeCG;
+typedef BasicAVLTreeCG<int, Unit, std::less<int>, MCSLock> AVLTreeCGMCS;
+typedef BasicAVLTreeCG<int, Unit, std::less<int>, CLHLock> AVLTreeCGCLH;
+typedef BasicAVLTreeCG<int, Unit, std::less<int>, CohortLock> AVLTreeCGCohort;
+
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+using AVLMapCG = BasicAVLTreeCG<Key, Value, Compare, MutexLock>;
+
+// Ordered scan over [lo, hi] that holds the read lock for one batch of keys
+// at a time, so a long scan does not block writers for its whole duration.
+// Each refill resumes after the last key returned, under a fresh read lock.
+class RangeIteratorCG {
+public:
+    RangeIteratorCG(AVLTreeCG* tree, int lo, int hi, size_t batchSize);
+
+    bool next(int& key);
+
+private:
+    AVLTreeCG* tree;
+    int nextLo;
+    int hi;
+    size_t batchSize;
+    std::vector<int> batch;
+    size_t pos;
+    bool done;
 };
 
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+BasicAVLTreeCG<Key, Value, Compare, WriteLock>::BasicAVLTreeCG(const Compare& comp) : root(nullptr), comp(comp), readCount(0), seq(0), retries(0), arena{nullptr, 0, false} {}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::freeNode(void* p) {
+    delete static_cast<Node*>(p);
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::freeArenaNodes(void* p) {
+    NodeArena<Node>* old = static_cast<NodeArena<Node>*>(p);
+    freeArena(*old);
+    delete old;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+BasicAVLTreeCG<Key, Value, Compare, WriteLock>::~BasicAVLTreeCG() {
+    freeTree(root);
+    freeArena(arena);
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::freeTree(Node* node) {
+	if (node == nullptr) return;
+	freeTree(node->left);
+	freeTree(node->right);
+	if (!arena.owns(node))
+		delete node;
+}
+
+// Arena nodes go when the whole arena is retired. Without speculative
+// readers nothing can still be reading an unlinked node.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::retireNode(Node* node) {
+    if (arena.owns(node))
+        return;
+    if constexpr (speculative)
+        epochs.retire(node, freeNode);
+    else
+        delete node;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::retireTree(Node* node) {
+    if (node == nullptr) return;
+    retireTree(node->left);
+    retireTree(node->right);
+    retireNode(node);
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::startRead() {
+    readLock.lock();
+    readCount++;
+    if (readCount == 1) {
+        writeLock.lock(READER_GROUP_SLOT);
+    }
+    readLock.unlock();
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::endRead() {
+    readLock.lock();
+    readCount--;
+    if (readCount == 0) {
+        writeLock.unlock(READER_GROUP_SLOT);
+    }
+    readLock.unlock();
+}
+
+// Writers make seq odd for the duration of their changes
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::startWrite() {
+    writeLock.lock(queueLockSlot());
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::endWrite() {
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    writeLock.unlock(queueLockSlot());
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+template <typename T>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::storeShared(T& field, const T& value) {
+    if constexpr (speculative)
+        __atomic_store_n(&field, value, __ATOMIC_RELAXED);
+    else
+        field = value;
+}
+
+// A utility function to right rotate subtree rooted with y
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+typename BasicAVLTreeCG<Key, Value, Compare, WriteLock>::Node* BasicAVLTreeCG<Key, Value, Compare, WriteLock>::rightRotate(Node* y) {
+    Node* x = y->left;
+    Node* T2 = x->right;
+    storeShared(x->right, y);
+    storeShared(y->left, T2);
+    y->height = std::max(height(y->left), height(y->right)) + 1;
+    y->size = size(y->left) + size(y->right) + 1;
+    x->height = std::max(height(x->left), height(x->right)) + 1;
+    x->size = size(x->left) + size(x->right) + 1;
+    return x;
+}
+
+// A utility function to left rotate subtree rooted with x
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+typename BasicAVLTreeCG<Key, Value, Compare, WriteLock>::Node* BasicAVLTreeCG<Key, Value, Compare, WriteLock>::leftRotate(Node* x) {
+    Node* y = x->right;
+    Node* T2 = y->left;
+    storeShared(y->left, x);
+    storeShared(x->right, T2);
+    x->height = std::max(height(x->left), height(x->right)) + 1;
+    x->size = size(x->left) + size(x->right) + 1;
+    y->height = std::max(height(y->left), height(y->right)) + 1;
+    y->size = size(y->left) + size(y->right) + 1;
+    return y;
+}
+
+// A utility function to get height of tree
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+int BasicAVLTreeCG<Key, Value, Compare, WriteLock>::height(Node* N) const {
+    if (N == nullptr)
+        return 0;
+    return N->height;
+}
+
+// Number of nodes in the subtree rooted at N
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+int BasicAVLTreeCG<Key, Value, Compare, WriteLock>::size(Node* N) const {
+    if (N == nullptr)
+        return 0;
+    return N->size;
+}
+
+// Get balance factor of node N
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+int BasicAVLTreeCG<Key, Value, Compare, WriteLock>::getBalance(Node* N) const {
+    if (N == nullptr)
+        return 0;
+    return height(N->left) - height(N->right);
+}
+
+// Return the node with minimum key value in the given tree
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+typename BasicAVLTreeCG<Key, Value, Compare, WriteLock>::Node* BasicAVLTreeCG<Key, Value, Compare, WriteLock>::minValueNode(Node* node) {
+    Node* current = node;
+    while (current->left != nullptr)
+        current = current->left;
+    return current;
+}
+
+// The node holding key in the subtree rooted at node, or nullptr
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+typename BasicAVLTreeCG<Key, Value, Compare, WriteLock>::Node* BasicAVLTreeCG<Key, Value, Compare, WriteLock>::find(Node* node, const Key& key) const {
+    while (node != nullptr) {
+        if (comp(key, node->key))
+            node = node->left;
+        else if (comp(node->key, key))
+            node = node->right;
+        else
+            break;
+    }
+    return node;
+}
+
+// Recursive function to insert a key in the subtree rooted with node. If key
+// is present, old receives its value, which is replaced by value only if
+// replace is set. Returns the new root of the subtree.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+typename BasicAVLTreeCG<Key, Value, Compare, WriteLock>::Node* BasicAVLTreeCG<Key, Value, Compare, WriteLock>::insertHelper(Node* node, const Key& key, const Value& value, bool replace, std::optional<Value>& old) {
+    // 1. Perform the normal BST insertion
+    if (node == nullptr)
+        return new Node(key, value);
+    if (comp(key, node->key))
+        storeShared(node->left, insertHelper(node->left, key, value, replace, old));
+    else if (comp(node->key, key))
+        storeShared(node->right, insertHelper(node->right, key, value, replace, old));
+    else {
+        old = node->value;
+        if (replace)
+            node->value = value;
+        return node;
+    }
+    if (old)
+        return node;
+    // 2. Update height and size of this ancestor node
+    node->height = 1 + std::max(height(node->left), height(node->right));
+    node->size = 1 + size(node->left) + size(node->right);
+    // 3. Get the balance factor of this ancestor node to check this node's balance
+    int balance = getBalance(node);
+    // If this node becomes unbalanced, then there are 4 cases
+    if (balance > 1 && comp(key, node->left->key))
+        return rightRotate(node);
+    if (balance < -1 && comp(node->right->key, key))
+        return leftRotate(node);
+    if (balance > 1 && comp(node->left->key, key)) {
+        storeShared(node->left, leftRotate(node->left));
+        return rightRotate(node);
+    }
+    if (balance < -1 && comp(key, node->right->key)) {
+        storeShared(node->right, rightRotate(node->right));
+        return leftRotate(node);
+    }
+    return node;
+}
+
+// Public insert function that wraps the helper
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+bool BasicAVLTreeCG<Key, Value, Compare, WriteLock>::insert(const Key& key) {
+    std::optional<Value> old;
+    startWrite();
+    storeShared(root, insertHelper(root, key, Value(), false, old));
+    endWrite();
+    return !old;
+}
+
+// Recursive function to delete a node with given key from subtree with given
+// root, moving its value into old. Returns root of the modified subtree.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+typename BasicAVLTreeCG<Key, Value, Compare, WriteLock>::Node* BasicAVLTreeCG<Key, Value, Compare, WriteLock>::deleteHelper(Node* node, const Key& key, std::optional<Value>& old) {
+    // STEP 1: Perform standard BST delete
+    if (node == nullptr)
+        return node;
+    if (comp(key, node->key))
+        storeShared(node->left, deleteHelper(node->left, key, old));
+    else if (comp(node->key, key))
+        storeShared(node->right, deleteHelper(node->right, key, old));
+    else { // This is the node to be deleted
+        old = std::move(node->value);
+        if (node->left == nullptr || node->right == nullptr) {
+            Node* temp = node->left ? node->left : node->right;
+            if (temp == nullptr) {
+                temp = node;
+                node = nullptr;
+            } else {
+                storeShared(node->key, temp->key);
+                storeShared(node->left, temp->left);
+                storeShared(node->right, temp->right);
+                node->height = temp->height;
+                node->size = temp->size;
+                node->value = std::move(temp->value);
+            }
+            retireNode(temp);
+        } else {
+            // The successor's key and value move up into node
+            Node* temp = minValueNode(node->right);
+            storeShared(node->key, temp->key);
+            node->value = std::move(temp->value);
+            std::optional<Value> moved;
+            storeShared(node->right, deleteHelper(node->right, node->key, moved));
+        }
+    }
+    if (node == nullptr || !old)
+        return node;
+    // Step 2: update height and size of the current node
+    node->height = 1 + std::max(height(node->left), height(node->right));
+    node->size = 1 + size(node->left) + size(node->right);
+    // Step 3: check whether this node became unbalanced
+    int balance = getBalance(node);
+    if (balance > 1 && getBalance(node->left) >= 0)
+        return rightRotate(node);
+    if (balance > 1 && getBalance(node->left) < 0) {
+        storeShared(node->left, leftRotate(node->left));
+        return rightRotate(node);
+    }
+    if (balance < -1 && getBalance(node->right) <= 0)
+        return leftRotate(node);
+    if (balance < -1 && getBalance(node->right) > 0) {
+        storeShared(node->right, rightRotate(node->right));
+        return leftRotate(node);
+    }
+    return node;
+}
+
+// Public delete function that wraps the helper
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+bool BasicAVLTreeCG<Key, Value, Compare, WriteLock>::deleteNode(const Key& key) {
+    std::optional<Value> old;
+    startWrite();
+    storeShared(root, deleteHelper(root, key, old));
+    endWrite();
+    return old.has_value();
+}
+
+// Search for the given key in the subtree rooted with given node
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+bool BasicAVLTreeCG<Key, Value, Compare, WriteLock>::searchHelper(Node* node, const Key& key) const {
+    return find(node, key) != nullptr;
+}
+
+// Lock-free attempt at search: walk the tree with relaxed loads and report
+// whether no writer ran meanwhile, in which case found is valid. Readers
+// write nothing shared on this path.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+bool BasicAVLTreeCG<Key, Value, Compare, WriteLock>::searchOptimistic(const Key& key, bool& found) const {
+    unsigned long before = seq.load(std::memory_order_acquire);
+    if (before & 1)
+        return false;
+    Node* node = __atomic_load_n(&root, __ATOMIC_RELAXED);
+    found = false;
+    for (int depth = 0; node != nullptr; depth++) {
+        if (depth > SEQ_MAX_DEPTH)
+            return false;
+        Key k = __atomic_load_n(&node->key, __ATOMIC_RELAXED);
+        if (!comp(key, k) && !comp(k, key)) {
+            found = true;
+            break;
+        }
+        node = __atomic_load_n(comp(key, k) ? &node->left : &node->right, __ATOMIC_RELAXED);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq.load(std::memory_order_relaxed) == before;
+}
+
+// Public search function: one speculative attempt, then the read lock
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+bool BasicAVLTreeCG<Key, Value, Compare, WriteLock>::search(const Key& key) {
+    bool found;
+    if constexpr (speculative) {
+        epochs.enter();
+        bool valid = searchOptimistic(key, found);
+        epochs.leave();
+        if (valid)
+            return found;
+        retries.fetch_add(1, std::memory_order_relaxed);
+    }
+    startRead();
+    found = searchHelper(root, key);
+    endRead();
+    return found;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+long BasicAVLTreeCG<Key, Value, Compare, WriteLock>::searchRetries() const {
+    return retries;
+}
+
+// Look up keys[0, n) into out[0, n) under a single read lock. SEARCH_GROUP
+// lookups advance one level at a time in lockstep, prefetching each next
+// node so that their cache misses overlap instead of stalling one by one.
+// A lane that finishes is refilled with the next pending key.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::searchBatch(const Key* keys, size_t n, bool* out) {
+    Node* cur[SEARCH_GROUP];
+    size_t idx[SEARCH_GROUP];
+    size_t next = 0;
+    int live = 0;
+    startRead();
+    for (int lane = 0; lane < SEARCH_GROUP; lane++) {
+        idx[lane] = next < n ? next++ : n;
+        cur[lane] = root;
+        if (idx[lane] != n)
+            live++;
+    }
+    while (live > 0) {
+        for (int lane = 0; lane < SEARCH_GROUP; lane++) {
+            if (idx[lane] == n)
+                continue;
+            Node* node = cur[lane];
+            const Key& key = keys[idx[lane]];
+            if (node != nullptr && (comp(key, node->key) || comp(node->key, key))) {
+                node = comp(key, node->key) ? node->left : node->right;
+                __builtin_prefetch(node);
+                cur[lane] = node;
+                continue;
+            }
+            // Lane done, record the result and start the next key
+            out[idx[lane]] = node != nullptr;
+            if (next < n) {
+                idx[lane] = next++;
+                cur[lane] = root;
+            }
+            else {
+                idx[lane] = n;
+                live--;
+            }
+        }
+    }
+    endRead();
+}
+
+// Resolve a sorted slice of (key, position) pairs against the subtree rooted
+// at node: keys below node->key go left, keys above it go right, so each
+// node is read once however many keys pass through it. Returns the number
+// of nodes visited.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+size_t BasicAVLTreeCG<Key, Value, Compare, WriteLock>::multiGetHelper(Node* node, const std::pair<Key, size_t>* batch, size_t n, bool* out) const {
+    if (n == 0)
+        return 0;
+    if (node == nullptr) {
+        for (size_t i = 0; i < n; i++)
+            out[batch[i].second] = false;
+        return 0;
+    }
+    const std::pair<Key, size_t>* end = batch + n;
+    const std::pair<Key, size_t>* lo = std::lower_bound(batch, end, node->key,
+        [this](const std::pair<Key, size_t>& p, const Key& k) { return comp(p.first, k); });
+    const std::pair<Key, size_t>* hi = lo;
+    while (hi != end && !comp(node->key, hi->first))
+        out[(hi++)->second] = true;
+    return 1 + multiGetHelper(node->left, batch, lo - batch, out)
+             + multiGetHelper(node->right, hi, end - hi, out);
+}
+
+// Look up keys[0, n) into out[0, n) with one shared descent: the batch is
+// sorted and split at every node, and the read lock is taken once. Returns
+// the number of nodes visited, at most one per node on the union of the
+// search paths.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+size_t BasicAVLTreeCG<Key, Value, Compare, WriteLock>::multiGet(const Key* keys, size_t n, bool* out) {
+    std::vector<std::pair<Key, size_t>> batch(n);
+    for (size_t i = 0; i < n; i++)
+        batch[i] = std::make_pair(keys[i], i);
+    // Range-partitioned callers usually pass sorted batches already
+    if (!std::is_sorted(keys, keys + n, comp))
+        std::sort(batch.begin(), batch.end(),
+            [this](const std::pair<Key, size_t>& a, const std::pair<Key, size_t>& b) { return comp(a.first, b.first); });
+    startRead();
+    size_t visited = multiGetHelper(root, batch.data(), n, out);
+    endRead();
+    return visited;
+}
+
+// A utility function to print preorder traversal of the tree.
+// The function also prints the height of every node.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::preOrderHelper(Node* node) const {
+    if (node != nullptr) {
+        std::cout << node->key << " ";
+        preOrderHelper(node->left);
+        preOrderHelper(node->right);
+    }
+}
+
+// Preorder wrapper function
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::preOrder() {
+    startWrite();
+    std::cout << "preorder\n";
+    preOrderHelper(root);
+    std::cout << "\n";
+    endWrite();
+}
+
+// In-order walk of the subtree, skipping children that cannot hold keys in [lo, hi]
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::forEachInRangeHelper(Node* node, const Key& lo, const Key& hi, const std::function<void(const Key&)>& fn) const {
+    if (node == nullptr)
+        return;
+    if (comp(lo, node->key))
+        forEachInRangeHelper(node->left, lo, hi, fn);
+    if (!comp(node->key, lo) && !comp(hi, node->key))
+        fn(node->key);
+    if (comp(node->key, hi))
+        forEachInRangeHelper(node->right, lo, hi, fn);
+}
+
+// Call fn on every key in [lo, hi] in ascending order under a single read lock.
+// fn must not call back into the tree.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::forEachInRange(const Key& lo, const Key& hi, const std::function<void(const Key&)>& fn) {
+    startRead();
+    forEachInRangeHelper(root, lo, hi, fn);
+    endRead();
+}
+
+// Collect every key in [lo, hi] in ascending order
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::rangeQuery(const Key& lo, const Key& hi, std::vector<Key>& out) {
+    out.clear();
+    forEachInRange(lo, hi, [&out](const Key& key) { out.push_back(key); });
+}
+
+// Same walk as forEachInRangeHelper, stopping once maxKeys keys are collected
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::collectRangeHelper(Node* node, const Key& lo, const Key& hi, size_t maxKeys, std::vector<Key>& out) const {
+    if (node == nullptr || out.size() >= maxKeys)
+        return;
+    if (comp(lo, node->key))
+        collectRangeHelper(node->left, lo, hi, maxKeys, out);
+    if (out.size() >= maxKeys)
+        return;
+    if (!comp(node->key, lo) && !comp(hi, node->key))
+        out.push_back(node->key);
+    if (comp(node->key, hi))
+        collectRangeHelper(node->right, lo, hi, maxKeys, out);
+}
+
+// Replace out with the first (at most) maxKeys keys in [lo, hi]
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::collectRange(const Key& lo, const Key& hi, size_t maxKeys, std::vector<Key>& out) {
+    out.clear();
+    startRead();
+    collectRangeHelper(root, lo, hi, maxKeys, out);
+    endRead();
+}
+
+// Count the keys of node's subtree that are below key (at most key if
+// inclusive) by summing the left subtrees passed on the way down
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+size_t BasicAVLTreeCG<Key, Value, Compare, WriteLock>::countBelow(Node* node, const Key& key, bool inclusive) const {
+    size_t count = 0;
+    while (node != nullptr) {
+        if (comp(node->key, key) || (inclusive && !comp(key, node->key))) {
+            count += size(node->left) + 1;
+            node = node->right;
+        }
+        else
+            node = node->left;
+    }
+    return count;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+size_t BasicAVLTreeCG<Key, Value, Compare, WriteLock>::rank(const Key& key) {
+    startRead();
+    size_t count = countBelow(root, key, false);
+    endRead();
+    return count;
+}
+
+// Walk down by subtree sizes; going right skips size(left) + 1 smaller keys
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+bool BasicAVLTreeCG<Key, Value, Compare, WriteLock>::select(size_t i, Key& key) {
+    startRead();
+    Node* node = root;
+    while (node != nullptr) {
+        size_t left = size(node->left);
+        if (i < left)
+            node = node->left;
+        else if (i == left) {
+            key = node->key;
+            break;
+        }
+        else {
+            i -= left + 1;
+            node = node->right;
+        }
+    }
+    endRead();
+    return node != nullptr;
+}
+
+// Both bounds are counted under one read lock, so no update can fall between them
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+size_t BasicAVLTreeCG<Key, Value, Compare, WriteLock>::countRange(const Key& lo, const Key& hi) {
+    if (comp(hi, lo))
+        return 0;
+    startRead();
+    size_t count = countBelow(root, hi, true) - countBelow(root, lo, false);
+    endRead();
+    return count;
+}
+
+// Build a perfectly balanced subtree over sorted[lo, hi), forking the two
+// halves onto separate threads near the top of the recursion
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+typename BasicAVLTreeCG<Key, Value, Compare, WriteLock>::Node* BasicAVLTreeCG<Key, Value, Compare, WriteLock>::buildHelper(const Key* sorted, size_t lo, size_t hi, int depth) {
+    if (lo >= hi)
+        return nullptr;
+    size_t mid = lo + (hi - lo) / 2;
+    Node* node = new Node(sorted[mid]);
+    forkJoin(hi - lo > FORK_GRAIN ? depth : 0,
+        [&]() { node->left = buildHelper(sorted, lo, mid, depth - 1); },
+        [&]() { node->right = buildHelper(sorted, mid + 1, hi, depth - 1); });
+    node->height = 1 + std::max(height(node->left), height(node->right));
+    node->size = 1 + size(node->left) + size(node->right);
+    return node;
+}
+
+// Load n strictly increasing keys in O(n). Only valid on an empty tree;
+// returns false without modifying the tree otherwise.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+bool BasicAVLTreeCG<Key, Value, Compare, WriteLock>::bulkLoad(const Key* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted + n, [this](const Key& a, const Key& b) { return !comp(a, b); }) != sorted + n)
+        return false;
+    startWrite();
+    if (root != nullptr) {
+        endWrite();
+        return false;
+    }
+    storeShared(root, buildHelper(sorted, 0, n, forkDepth()));
+    endWrite();
+    return true;
+}
+
+// Speculative searches may still be walking the old nodes, so they and the
+// old arena are retired through epochs rather than freed. Arena nodes are
+// never destroyed one by one, so only trivially destructible nodes qualify.
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+void BasicAVLTreeCG<Key, Value, Compare, WriteLock>::compact() {
+    static_assert(std::is_trivially_destructible<Node>::value, "compact() needs trivially destructible keys and values");
+    startWrite();
+    NodeArena<Node> fresh = allocArena<Node>(countNodes(root));
+    Node* old = root;
+    storeShared(root, copyVEB(old, fresh.nodes));
+    retireTree(old);
+    if (arena.nodes != nullptr)
+        epochs.retire(new NodeArena<Node>(arena), freeArenaNodes);
+    arena = fresh;
+    endWrite();
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+std::optional<Value> BasicAVLTreeCG<Key, Value, Compare, WriteLock>::get(const Key& key) {
+    startRead();
+    std::optional<Value> result;
+    Node* node = find(root, key);
+    if (node != nullptr)
+        result = node->value;
+    endRead();
+    return result;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+bool BasicAVLTreeCG<Key, Value, Compare, WriteLock>::contains(const Key& key) {
+    return search(key);
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+std::optional<Value> BasicAVLTreeCG<Key, Value, Compare, WriteLock>::put(const Key& key, const Value& value) {
+    std::optional<Value> old;
+    startWrite();
+    storeShared(root, insertHelper(root, key, value, true, old));
+    endWrite();
+    return old;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+std::optional<Value> BasicAVLTreeCG<Key, Value, Compare, WriteLock>::putIfAbsent(const Key& key, const Value& value) {
+    std::optional<Value> old;
+    startWrite();
+    storeShared(root, insertHelper(root, key, value, false, old));
+    endWrite();
+    return old;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+bool BasicAVLTreeCG<Key, Value, Compare, WriteLock>::replace(const Key& key, const Value& expected, const Value& desired) {
+    startWrite();
+    Node* node = find(root, key);
+    bool replaced = node != nullptr && node->value == expected;
+    if (replaced)
+        node->value = desired;
+    endWrite();
+    return replaced;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+template <typename Fn>
+Value BasicAVLTreeCG<Key, Value, Compare, WriteLock>::compute(const Key& key, Fn fn) {
+    startWrite();
+    Node* node = find(root, key);
+    if (node != nullptr)
+        node->value = fn(std::optional<Value>(node->value));
+    else {
+        std::optional<Value> old;
+        storeShared(root, insertHelper(root, key, fn(std::optional<Value>()), false, old));
+        node = find(root, key);
+    }
+    Value result = node->value;
+    endWrite();
+    return result;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+std::optional<Value> BasicAVLTreeCG<Key, Value, Compare, WriteLock>::remove(const Key& key) {
+    std::optional<Value> old;
+    startWrite();
+    storeShared(root, deleteHelper(root, key, old));
+    endWrite();
+    return old;
+}
+
+template <typename Key, typename Value, typename Compare, typename WriteLock>
+size_t BasicAVLTreeCG<Key, Value, Compare, WriteLock>::size() {
+    startRead();
+    size_t n = size(root);
+    endRead();
+    return n;
+}
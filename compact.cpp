@@ -0,0 +1,349 @@
+#include "compact.h"
+#include <algorithm>
+#include <functional>
+#include <new>
+
+AVLTreeCompact::AVLTreeCompact() : numChunks(0), nextIndex(1), freeList(0), root(0), count(0), readCount(0) {}
+
+AVLTreeCompact::~AVLTreeCompact() {
+    for (uint32_t c = 0; c < numChunks; c++)
+        delete[] chunks[c];
+}
+
+void AVLTreeCompact::startRead() {
+    readLock.lock();
+    readCount++;
+    if (readCount == 1) {
+        writeLock.lock();
+    }
+    readLock.unlock();
+}
+
+void AVLTreeCompact::endRead() {
+    readLock.lock();
+    readCount--;
+    if (readCount == 0) {
+        writeLock.unlock();
+    }
+    readLock.unlock();
+}
+
+void AVLTreeCompact::startWrite() {
+    writeLock.lock();
+}
+
+void AVLTreeCompact::endWrite() {
+    writeLock.unlock();
+}
+
+CompactNode& AVLTreeCompact::at(uint32_t i) {
+    return chunks[i >> COMPACT_CHUNK_BITS][i & (COMPACT_CHUNK_NODES - 1)];
+}
+
+const CompactNode& AVLTreeCompact::node(uint32_t i) const {
+    return chunks[i >> COMPACT_CHUNK_BITS][i & (COMPACT_CHUNK_NODES - 1)];
+}
+
+uint32_t AVLTreeCompact::rootIndex() const {
+    return root;
+}
+
+uint32_t AVLTreeCompact::leftOf(uint32_t i) {
+    return at(i).left & COMPACT_INDEX_MASK;
+}
+
+uint32_t AVLTreeCompact::rightOf(uint32_t i) {
+    return at(i).right & COMPACT_INDEX_MASK;
+}
+
+void AVLTreeCompact::setLeft(uint32_t i, uint32_t child) {
+    at(i).left = (at(i).left & COMPACT_BALANCE_BIT) | child;
+}
+
+void AVLTreeCompact::setRight(uint32_t i, uint32_t child) {
+    at(i).right = (at(i).right & COMPACT_BALANCE_BIT) | child;
+}
+
+// Height of the left subtree minus that of the right, as in AVLTreeCG
+int AVLTreeCompact::balance(uint32_t i) {
+    return (int)(at(i).left >> 31) - (int)(at(i).right >> 31);
+}
+
+void AVLTreeCompact::setBalance(uint32_t i, int b) {
+    CompactNode& n = at(i);
+    n.left = (n.left & COMPACT_INDEX_MASK) | (b > 0 ? COMPACT_BALANCE_BIT : 0);
+    n.right = (n.right & COMPACT_INDEX_MASK) | (b < 0 ? COMPACT_BALANCE_BIT : 0);
+}
+
+uint32_t AVLTreeCompact::allocNode(int key) {
+    uint32_t i;
+    if (freeList != 0) {
+        i = freeList;
+        freeList = at(i).left;
+    }
+    else {
+        if (nextIndex > COMPACT_INDEX_MASK)
+            throw std::bad_alloc();
+        if ((nextIndex >> COMPACT_CHUNK_BITS) == numChunks)
+            chunks[numChunks++] = new CompactNode[COMPACT_CHUNK_NODES];
+        i = nextIndex++;
+    }
+    at(i) = {key, 0, 0};
+    return i;
+}
+
+void AVLTreeCompact::freeNode(uint32_t i) {
+    at(i).left = freeList;
+    freeList = i;
+}
+
+// Rotations only relink; callers set the balance factors they know
+uint32_t AVLTreeCompact::rotateRight(uint32_t t) {
+    uint32_t l = leftOf(t);
+    setLeft(t, rightOf(l));
+    setRight(l, t);
+    return l;
+}
+
+uint32_t AVLTreeCompact::rotateLeft(uint32_t t) {
+    uint32_t r = rightOf(t);
+    setRight(t, leftOf(r));
+    setLeft(r, t);
+    return r;
+}
+
+// t is left-heavy and its left subtree just grew or its right one shrank.
+// Restore balance; shorter reports whether the subtree ended up lower than
+// before the rotation, which after an insert is always the case.
+uint32_t AVLTreeCompact::fixLeftHeavy(uint32_t t, bool& shorter) {
+    uint32_t l = leftOf(t);
+    int bl = balance(l);
+    if (bl >= 0) {
+        uint32_t top = rotateRight(t);
+        setBalance(t, bl == 0 ? 1 : 0);
+        setBalance(l, bl == 0 ? -1 : 0);
+        shorter = bl != 0;
+        return top;
+    }
+    uint32_t lr = rightOf(l);
+    int blr = balance(lr);
+    setLeft(t, rotateLeft(l));
+    uint32_t top = rotateRight(t);
+    setBalance(t, blr == 1 ? -1 : 0);
+    setBalance(l, blr == -1 ? 1 : 0);
+    setBalance(lr, 0);
+    shorter = true;
+    return top;
+}
+
+uint32_t AVLTreeCompact::fixRightHeavy(uint32_t t, bool& shorter) {
+    uint32_t r = rightOf(t);
+    int br = balance(r);
+    if (br <= 0) {
+        uint32_t top = rotateLeft(t);
+        setBalance(t, br == 0 ? -1 : 0);
+        setBalance(r, br == 0 ? 1 : 0);
+        shorter = br != 0;
+        return top;
+    }
+    uint32_t rl = leftOf(r);
+    int brl = balance(rl);
+    setRight(t, rotateRight(r));
+    uint32_t top = rotateLeft(t);
+    setBalance(t, brl == -1 ? 1 : 0);
+    setBalance(r, brl == 1 ? -1 : 0);
+    setBalance(rl, 0);
+    shorter = true;
+    return top;
+}
+
+// Insert key below t, returning the new subtree root; taller reports
+// whether the subtree grew
+uint32_t AVLTreeCompact::insertHelper(uint32_t t, int key, bool& taller, bool& err) {
+    if (t == 0) {
+        taller = true;
+        return allocNode(key);
+    }
+    int k = at(t).key;
+    if (key == k) {
+        err = true;
+        taller = false;
+        return t;
+    }
+    bool shorter;
+    if (key < k) {
+        setLeft(t, insertHelper(leftOf(t), key, taller, err));
+        if (!taller)
+            return t;
+        int b = balance(t);
+        if (b == 1) {
+            taller = false;
+            return fixLeftHeavy(t, shorter);
+        }
+        setBalance(t, b + 1);
+        taller = b == 0;
+        return t;
+    }
+    setRight(t, insertHelper(rightOf(t), key, taller, err));
+    if (!taller)
+        return t;
+    int b = balance(t);
+    if (b == -1) {
+        taller = false;
+        return fixRightHeavy(t, shorter);
+    }
+    setBalance(t, b - 1);
+    taller = b == 0;
+    return t;
+}
+
+bool AVLTreeCompact::insert(int key) {
+    bool taller = false, err = false;
+    startWrite();
+    root = insertHelper(root, key, taller, err);
+    if (!err)
+        count++;
+    endWrite();
+    return !err;
+}
+
+// t's left subtree just got lower
+uint32_t AVLTreeCompact::leftShrank(uint32_t t, bool& shorter) {
+    int b = balance(t);
+    if (b == -1)
+        return fixRightHeavy(t, shorter);
+    setBalance(t, b - 1);
+    shorter = b == 1;
+    return t;
+}
+
+uint32_t AVLTreeCompact::rightShrank(uint32_t t, bool& shorter) {
+    int b = balance(t);
+    if (b == 1)
+        return fixLeftHeavy(t, shorter);
+    setBalance(t, b + 1);
+    shorter = b == -1;
+    return t;
+}
+
+// Delete key below t, returning the new subtree root; shorter reports
+// whether the subtree got lower. A node with two children takes its
+// successor's key and the successor is deleted instead.
+uint32_t AVLTreeCompact::deleteHelper(uint32_t t, int key, bool& shorter, bool& err) {
+    if (t == 0) {
+        err = true;
+        shorter = false;
+        return 0;
+    }
+    int k = at(t).key;
+    if (key < k) {
+        setLeft(t, deleteHelper(leftOf(t), key, shorter, err));
+        return shorter ? leftShrank(t, shorter) : t;
+    }
+    if (key > k) {
+        setRight(t, deleteHelper(rightOf(t), key, shorter, err));
+        return shorter ? rightShrank(t, shorter) : t;
+    }
+    uint32_t l = leftOf(t), r = rightOf(t);
+    if (l == 0 || r == 0) {
+        freeNode(t);
+        shorter = true;
+        return l != 0 ? l : r;
+    }
+    uint32_t successor = r;
+    while (leftOf(successor) != 0)
+        successor = leftOf(successor);
+    at(t).key = at(successor).key;
+    setRight(t, deleteHelper(r, at(t).key, shorter, err));
+    return shorter ? rightShrank(t, shorter) : t;
+}
+
+bool AVLTreeCompact::deleteNode(int key) {
+    bool shorter = false, err = false;
+    startWrite();
+    root = deleteHelper(root, key, shorter, err);
+    if (!err)
+        count--;
+    endWrite();
+    return !err;
+}
+
+bool AVLTreeCompact::search(int key) {
+    startRead();
+    uint32_t t = root;
+    while (t != 0) {
+        const CompactNode& n = at(t);
+        if (key == n.key)
+            break;
+        t = (key < n.key ? n.left : n.right) & COMPACT_INDEX_MASK;
+    }
+    endRead();
+    return t != 0;
+}
+
+void AVLTreeCompact::rangeHelper(uint32_t t, int lo, int hi, std::vector<int>& out) {
+    if (t == 0)
+        return;
+    int k = at(t).key;
+    if (lo < k)
+        rangeHelper(leftOf(t), lo, hi, out);
+    if (lo <= k && k <= hi)
+        out.push_back(k);
+    if (k < hi)
+        rangeHelper(rightOf(t), lo, hi, out);
+}
+
+// Collect every key in [lo, hi] in ascending order
+void AVLTreeCompact::rangeQuery(int lo, int hi, std::vector<int>& out) {
+    out.clear();
+    startRead();
+    rangeHelper(root, lo, hi, out);
+    endRead();
+}
+
+size_t AVLTreeCompact::size() {
+    startRead();
+    size_t n = count;
+    endRead();
+    return n;
+}
+
+size_t AVLTreeCompact::bytes() {
+    startRead();
+    size_t n = (size_t)numChunks * COMPACT_CHUNK_NODES * sizeof(CompactNode);
+    endRead();
+    return n;
+}
+
+// Nodes are allocated in preorder, so each subtree's top levels sit together
+uint32_t AVLTreeCompact::buildHelper(const int* sorted, size_t lo, size_t hi, int& height) {
+    if (lo >= hi) {
+        height = 0;
+        return 0;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    uint32_t t = allocNode(sorted[mid]);
+    int leftHeight, rightHeight;
+    setLeft(t, buildHelper(sorted, lo, mid, leftHeight));
+    setRight(t, buildHelper(sorted, mid + 1, hi, rightHeight));
+    setBalance(t, leftHeight - rightHeight);
+    height = 1 + std::max(leftHeight, rightHeight);
+    return t;
+}
+
+// Load n strictly increasing keys in O(n). Only valid on an empty tree;
+// returns false without modifying the tree otherwise.
+bool AVLTreeCompact::bulkLoad(const int* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted + n, std::greater_equal<int>()) != sorted + n)
+        return false;
+    startWrite();
+    if (root != 0) {
+        endWrite();
+        return false;
+    }
+    int height;
+    root = buildHelper(sorted, 0, n, height);
+    count = n;
+    endWrite();
+    return true;
+}
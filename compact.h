@@ -0,0 +1,88 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Nodes per arena chunk; chunks never move once allocated
+#define COMPACT_CHUNK_BITS 16
+#define COMPACT_CHUNK_NODES (1u << COMPACT_CHUNK_BITS)
+// The top bit of each child word is a balance bit, leaving 31-bit indices
+#define COMPACT_INDEX_MASK 0x7fffffffu
+#define COMPACT_BALANCE_BIT 0x80000000u
+#define COMPACT_MAX_CHUNKS ((COMPACT_INDEX_MASK >> COMPACT_CHUNK_BITS) + 1)
+
+// 12 bytes: the children are 31-bit arena indices, 0 for none. The balance
+// factor lives in the spare top bits: left's is set when the left subtree is
+// one taller, right's when the right one is.
+struct CompactNode {
+    int key;
+    uint32_t left;
+    uint32_t right;
+};
+
+/*
+ * Memory-compact variant of AVLTreeCG for very large key sets. Nodes live in
+ * an arena of fixed-size chunks addressed by 32-bit indices instead of
+ * individually malloc'ed nodes with 64-bit pointers and an int height, so a
+ * key costs 12 bytes instead of 24 plus allocator overhead, and nodes that
+ * were allocated together share cache lines. Freed nodes go on a free list
+ * threaded through their left words. Locking is the same readers-writer
+ * scheme as AVLTreeCG.
+ */
+class AVLTreeCompact {
+public:
+    AVLTreeCompact();
+    ~AVLTreeCompact();
+
+    bool insert(int key);
+    bool deleteNode(int key);
+    bool search(int key);
+    void rangeQuery(int lo, int hi, std::vector<int>& out);
+    bool bulkLoad(const int* sorted, size_t n);
+
+    size_t size();
+    // Bytes held by the arena, including free and never-used slots
+    size_t bytes();
+    uint32_t rootIndex() const;
+    const CompactNode& node(uint32_t i) const;
+
+private:
+    CompactNode* chunks[COMPACT_MAX_CHUNKS];
+    uint32_t numChunks;
+    // Next never-used index; 0 stays reserved for null
+    uint32_t nextIndex;
+    uint32_t freeList;
+    uint32_t root;
+    size_t count;
+
+    std::mutex writeLock;
+    std::mutex readLock;
+    int readCount;
+
+    void startWrite();
+    void endWrite();
+    void startRead();
+    void endRead();
+
+    CompactNode& at(uint32_t i);
+    uint32_t leftOf(uint32_t i);
+    uint32_t rightOf(uint32_t i);
+    void setLeft(uint32_t i, uint32_t child);
+    void setRight(uint32_t i, uint32_t child);
+    uint32_t allocNode(int key);
+    void freeNode(uint32_t i);
+    int balance(uint32_t i);
+    void setBalance(uint32_t i, int b);
+    uint32_t rotateRight(uint32_t t);
+    uint32_t rotateLeft(uint32_t t);
+    uint32_t fixLeftHeavy(uint32_t t, bool& shorter);
+    uint32_t fixRightHeavy(uint32_t t, bool& shorter);
+
+    uint32_t insertHelper(uint32_t t, int key, bool& taller, bool& err);
+    uint32_t deleteHelper(uint32_t t, int key, bool& shorter, bool& err);
+    uint32_t leftShrank(uint32_t t, bool& shorter);
+    uint32_t rightShrank(uint32_t t, bool& shorter);
+    void rangeHelper(uint32_t t, int lo, int hi, std::vector<int>& out);
+    uint32_t buildHelper(const int* sorted, size_t lo, size_t hi, int& height);
+};
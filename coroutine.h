@@ -0,0 +1,143 @@
+#pragma once
+// Coroutine lookups need C++20; under older standards this header is empty
+// and the trees leave out their searchCoro members
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#include <exception>
+#include <vector>
+#include <cstddef>
+#include <new>
+
+/*
+ * A lookup that runs until its next prefetch and then suspends, so a
+ * scheduler can advance other lookups while the prefetched node is on its
+ * way from memory. Starts suspended; the result is valid once done().
+ */
+class LookupTask {
+public:
+    struct promise_type {
+        bool result = false;
+
+        LookupTask get_return_object() {
+            return LookupTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(bool found) { result = found; }
+        void unhandled_exception() { std::terminate(); }
+
+        // Lookups are short-lived and started back to back, so frames are
+        // recycled through a per-thread free list instead of the heap
+        static void* operator new(size_t size);
+        static void operator delete(void* frame, size_t size);
+    };
+
+    LookupTask() : handle(nullptr) {}
+    LookupTask(LookupTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    LookupTask& operator=(LookupTask&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = other.handle;
+            other.handle = nullptr;
+        }
+        return *this;
+    }
+    LookupTask(const LookupTask&) = delete;
+    LookupTask& operator=(const LookupTask&) = delete;
+    ~LookupTask() {
+        if (handle) handle.destroy();
+    }
+
+    bool done() const { return handle.done(); }
+    void resume() { handle.resume(); }
+    bool result() const { return handle.promise().result; }
+
+private:
+    explicit LookupTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+    std::coroutine_handle<promise_type> handle;
+};
+
+// Frames up to this size are recycled, larger ones go to the heap
+#define LOOKUP_FRAME_SIZE 512
+
+struct LookupFrameCache {
+    std::vector<void*> frames;
+    ~LookupFrameCache() {
+        for (void* f : frames) ::operator delete(f);
+    }
+};
+
+inline LookupFrameCache& lookupFrameCache() {
+    static thread_local LookupFrameCache cache;
+    return cache;
+}
+
+inline void* LookupTask::promise_type::operator new(size_t size) {
+    if (size > LOOKUP_FRAME_SIZE)
+        return ::operator new(size);
+    std::vector<void*>& frames = lookupFrameCache().frames;
+    if (frames.empty())
+        return ::operator new(LOOKUP_FRAME_SIZE);
+    void* frame = frames.back();
+    frames.pop_back();
+    return frame;
+}
+
+inline void LookupTask::promise_type::operator delete(void* frame, size_t size) {
+    if (size > LOOKUP_FRAME_SIZE)
+        ::operator delete(frame);
+    else
+        lookupFrameCache().frames.push_back(frame);
+}
+
+/*
+ * co_await prefetchAndYield(p) issues a prefetch for p and hands control
+ * back to the scheduler; the lookup continues on its next resume().
+ */
+struct PrefetchYield {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    void await_resume() const noexcept {}
+};
+
+inline PrefetchYield prefetchAndYield(const void* p) {
+    __builtin_prefetch(p);
+    return {};
+}
+
+/*
+ * Look up keys[0, n) into out[0, n) on the calling thread, keeping depth
+ * searchCoro lookups of tree in flight and resuming them round robin.
+ * A finished lookup's slot is refilled with the next pending key.
+ */
+template <typename Tree>
+void interleavedSearch(Tree* tree, const int* keys, size_t n, bool* out, int depth) {
+    std::vector<LookupTask> lanes(depth);
+    std::vector<size_t> idx(depth, n);
+    size_t next = 0;
+    int live = 0;
+    for (int lane = 0; lane < depth && next < n; lane++, live++) {
+        idx[lane] = next;
+        lanes[lane] = tree->searchCoro(keys[next++]);
+    }
+    while (live > 0) {
+        for (int lane = 0; lane < depth; lane++) {
+            if (idx[lane] == n)
+                continue;
+            lanes[lane].resume();
+            if (!lanes[lane].done())
+                continue;
+            out[idx[lane]] = lanes[lane].result();
+            if (next < n) {
+                idx[lane] = next;
+                lanes[lane] = tree->searchCoro(keys[next++]);
+            }
+            else {
+                idx[lane] = n;
+                lanes[lane] = LookupTask();
+                live--;
+            }
+        }
+    }
+}
+#endif
@@ -3,9 +3,18 @@
 #include "finegrained.h"
 #include "lockfree2.h"
 #include "lockfree.h"
+#include "flatcombining.h"
+#include "sharded.h"
+#include "rcu.h"
+#include "bptree.h"
+#include "frozen.h"
+#include "compact.h"
+#include "hugepage.h"
+#include "stringkey.h"
 using namespace std;
 
-// Coarse-grained: IMPL=1, fine-grained: IMPL=2, lock-free: IMPL=3, BST lock-free: IMPL=4
+// Coarse-grained: IMPL=1, fine-grained: IMPL=2, lock-free: IMPL=3, BST lock-free: IMPL=4,
+// flat-combining coarse-grained: IMPL=5, RCU: IMPL=7, B+-tree: IMPL=8
 #define IMPL 4
 #define NUM_THREADS 4
 #define THREAD_SIZE 100
@@ -14,6 +23,9 @@ AVLTreeCG *treeCG;
 AVLTreeFG *treeFG;
 AVLTree *treeLF;
 AVLTreeLF *treeBST;
+AVLTreeFC *treeFC;
+AVLTreeRCU *treeRCU;
+BPlusTreeOLC *treeBP;
 
 /* UTILITY FUNCTIONS */
 void initTree() {
@@ -21,6 +33,9 @@ void initTree() {
     if (IMPL==2) treeFG = new AVLTreeFG();
     if (IMPL==3) treeLF = new AVLTree();
     if (IMPL==4) treeBST = new AVLTreeLF();
+    if (IMPL==5) treeFC = new AVLTreeFC();
+    if (IMPL==7) treeRCU = new AVLTreeRCU();
+    if (IMPL==8) treeBP = new BPlusTreeOLC();
     printf("Tree initialized\n");
 }
 
@@ -29,6 +44,9 @@ void deleteTree() {
     if (IMPL==2) delete treeFG;
     if (IMPL==3) delete treeLF;
     if (IMPL==4) delete treeBST;
+    if (IMPL==5) delete treeFC;
+    if (IMPL==7) delete treeRCU;
+    if (IMPL==8) delete treeBP;
 }
 
 /* Return a random vector of key inputs */
@@ -46,6 +64,9 @@ bool flexInsert(int k) {
     if (IMPL==2) return treeFG->insert(k);
     if (IMPL==3) return treeLF->insert(k);
     if (IMPL==4) return treeBST->insert(k);
+    if (IMPL==5) return treeFC->insert(k);
+    if (IMPL==7) return treeRCU->insert(k);
+    if (IMPL==8) return treeBP->insert(k);
 }
 
 bool flexDelete(int k) {
@@ -53,6 +74,9 @@ bool flexDelete(int k) {
     if (IMPL==2) return treeFG->deleteNode(k);
     if (IMPL==3) return treeLF->deleteNode(k);
     if (IMPL==4) return treeBST->deleteNode(k);
+    if (IMPL==5) return treeFC->deleteNode(k);
+    if (IMPL==7) return treeRCU->deleteNode(k);
+    if (IMPL==8) return treeBP->deleteNode(k);
 }
 
 bool flexSearch(int k) {
@@ -60,6 +84,27 @@ bool flexSearch(int k) {
     if (IMPL==2) return treeFG->search(k);
     if (IMPL==3) return treeLF->search(k);
     if (IMPL==4) return treeBST->search(k);
+    if (IMPL==5) return treeFC->search(k);
+    if (IMPL==7) return treeRCU->search(k);
+    if (IMPL==8) return treeBP->search(k);
+}
+
+bool flexBulkLoad(const int* sorted, size_t n) {
+    if (IMPL==1) return treeCG->bulkLoad(sorted, n);
+    if (IMPL==2) return treeFG->bulkLoad(sorted, n);
+    if (IMPL==3) return treeLF->bulkLoad(sorted, n);
+    if (IMPL==4) return treeBST->bulkLoad(sorted, n);
+    if (IMPL==5) return treeFC->bulkLoad(sorted, n);
+    if (IMPL==7) return treeRCU->bulkLoad(sorted, n);
+    if (IMPL==8) return treeBP->bulkLoad(sorted, n);
+}
+
+void flexRangeQuery(int lo, int hi, std::vector<int>& out) {
+    if (IMPL==1) treeCG->rangeQuery(lo, hi, out);
+    if (IMPL==4) treeBST->rangeQuery(lo, hi, out);
+    if (IMPL==5) treeFC->rangeQuery(lo, hi, out);
+    if (IMPL==7) treeRCU->rangeQuery(lo, hi, out);
+    if (IMPL==8) treeBP->rangeQuery(lo, hi, out);
 }
 
 /* HELPER FUNCTIONS */
@@ -155,6 +200,45 @@ int checkHeightAndBalanceLF(Node* node) {
     return node->height.getValue();
 }
 
+int checkHeightAndBalanceRCU(NodeRCU* node) {
+    if (node==nullptr) return 0;
+    int leftHeight = checkHeightAndBalanceRCU(node->left);
+    int rightHeight = checkHeightAndBalanceRCU(node->right);
+    if (node->height != 1+std::max(leftHeight, rightHeight))
+        throw std::runtime_error("Node height is incorrect");
+    int balance = leftHeight-rightHeight;
+    if (balance<-1 || balance>1)
+        throw std::runtime_error("Node is unbalanced");
+    if (node->left && node->left->key>=node->key)
+        throw std::runtime_error("Left child key is greater or equal to node key");
+    if (node->right && node->right->key<=node->key)
+        throw std::runtime_error("Right child key is lesser or equal to node key");
+    return node->height;
+}
+
+// Every key of the subtree must lie in (lo, hi], keys in a node must be
+// strictly increasing and all leaves at the same depth; returns the height
+int checkHeightAndBalanceBP(NodeBP* node, long long lo, long long hi) {
+    const int* keys = node->isLeaf ? static_cast<LeafBP*>(node)->keys : static_cast<InnerBP*>(node)->keys;
+    for (int i=0; i<node->count; i++) {
+        if (keys[i]<=lo || keys[i]>hi)
+            throw std::runtime_error("Key outside the range of its node");
+        if (i>0 && keys[i]<=keys[i-1])
+            throw std::runtime_error("Node keys are not increasing");
+    }
+    if (node->isLeaf)
+        return 1;
+    InnerBP* inner = static_cast<InnerBP*>(node);
+    int height = -1;
+    for (int i=0; i<=inner->count; i++) {
+        int h = checkHeightAndBalanceBP(inner->children[i], i==0 ? lo : keys[i-1], i==inner->count ? hi : keys[i]);
+        if (height!=-1 && h!=height)
+            throw std::runtime_error("Leaves at different depths");
+        height = h;
+    }
+    return height+1;
+}
+
 int checkHeightAndBalance() {
     if (IMPL==1) {
         return checkHeightAndBalanceCG(treeCG->root);
@@ -167,6 +251,15 @@ int checkHeightAndBalance() {
     }
     if (IMPL==4)
         return 0;
+    if (IMPL==5) {
+        return checkHeightAndBalanceCG(treeFC->tree.root);
+    }
+    if (IMPL==7) {
+        return checkHeightAndBalanceRCU(treeRCU->root);
+    }
+    if (IMPL==8) {
+        return checkHeightAndBalanceBP(treeBP->root, LLONG_MIN, LLONG_MAX);
+    }
     throw std::runtime_error("Invalid IMPL defined in correctness.cpp");
     return 0;
 }
@@ -174,9 +267,10 @@ int checkHeightAndBalance() {
 /* TEST FUNCTIONS */
 void testSequentialSearch() {
     initTree();
-    if (IMPL==1) {
-        treeCG->root=new NodeCG(20);
-        NodeCG* treeRoot = treeCG->root;
+    if (IMPL==1 || IMPL==5) {
+        AVLTreeCG* cg = IMPL==1 ? treeCG : &treeFC->tree;
+        cg->root=new NodeCG(20);
+        NodeCG* treeRoot = cg->root;
         treeRoot->left=new NodeCG(12);
         treeRoot->right=new NodeCG(53);
         treeRoot->left->left=new NodeCG(1);
@@ -208,6 +302,10 @@ void testSequentialSearch() {
     if (IMPL==4) {
         return;
     }
+    if (IMPL==7 || IMPL==8) {
+        for (int k : {20,12,53,1,21,17,82,73,15,2})
+            flexInsert(k);
+    }
     std::set<int> elems = {20,12,53,1,21,17,82,73,15,2};
     for (int i=1; i<100; i++) {
         bool found = flexSearch(i);
@@ -384,6 +482,863 @@ void testInsertDeleteSpread() {
 	printf("insert delete test passed!\n");
 }
 
+void testRangeQuery() {
+    if (IMPL!=1 && IMPL!=4 && IMPL!=5 && IMPL!=7 && IMPL!=8) return;
+    initTree();
+    insertRange(1, THREAD_SIZE);
+    deleteRangeSpread(2, THREAD_SIZE);
+    std::vector<int> out;
+    flexRangeQuery(THREAD_SIZE/4, THREAD_SIZE/2, out);
+    std::vector<int> expected;
+    for (int i=THREAD_SIZE/4; i<=THREAD_SIZE/2; i++) {
+        if (i%2==1) expected.push_back(i);
+    }
+    if (out != expected)
+        throw std::runtime_error("Range query returned wrong keys\n");
+    flexRangeQuery(THREAD_SIZE, 2*THREAD_SIZE, out);
+    if (!out.empty())
+        throw std::runtime_error("Range query past the largest key is not empty\n");
+    deleteTree();
+    printf("Range query passed!\n");
+}
+
+void testConcurrentRangeQuery() {
+    if (IMPL!=1 && IMPL!=4 && IMPL!=5 && IMPL!=7 && IMPL!=8) return;
+    initTree();
+    // Even keys stay in the tree while other threads churn the odd keys;
+    // every scan must still see all even keys in its range, in order
+    for (int i=0; i<NUM_THREADS*THREAD_SIZE; i+=2)
+        flexInsert(i);
+    std::vector<std::thread> threads;
+    for (int i=0; i<NUM_THREADS; i++) {
+        threads.push_back(thread(insertRangeDeleteSpread, 1+i*THREAD_SIZE, (i+1)*THREAD_SIZE, 2));
+    }
+    std::vector<int> out;
+    for (int i=0; i<NUM_THREADS*THREAD_SIZE; i+=THREAD_SIZE/2) {
+        flexRangeQuery(i, i+THREAD_SIZE/2, out);
+        int evens = 0;
+        for (size_t j=0; j<out.size(); j++) {
+            if (j>0 && out[j]<=out[j-1])
+                throw std::runtime_error("Concurrent range query returned unordered keys\n");
+            if (out[j]%2==0) evens++;
+        }
+        if (i+THREAD_SIZE/2 < NUM_THREADS*THREAD_SIZE && evens != THREAD_SIZE/4+1)
+            throw std::runtime_error("Concurrent range query missed a stable key\n");
+    }
+    for (int i=0; i<NUM_THREADS; i++) {
+        threads[i].join();
+    }
+    deleteTree();
+    printf("Concurrent range query passed!\n");
+}
+
+void testRangeIterator() {
+    if (IMPL!=1) return;
+    initTree();
+    insertRange(1, THREAD_SIZE);
+    deleteRangeSpread(2, THREAD_SIZE);
+    for (size_t batchSize : {1, 3, 7, (int)THREAD_SIZE}) {
+        RangeIteratorCG it(treeCG, 0, THREAD_SIZE, batchSize);
+        int key, expected = 1;
+        while (it.next(key)) {
+            if (key != expected)
+                throw std::runtime_error("Range iterator returned a wrong key\n");
+            expected += 2;
+        }
+        if (expected != THREAD_SIZE+1)
+            throw std::runtime_error("Range iterator stopped early\n");
+    }
+    // Resuming after INT_MAX must not wrap around
+    flexInsert(INT_MAX);
+    RangeIteratorCG it(treeCG, INT_MAX-1, INT_MAX, 1);
+    int key, count = 0;
+    while (it.next(key)) count++;
+    if (count != 1)
+        throw std::runtime_error("Range iterator wrapped past INT_MAX\n");
+    deleteTree();
+    printf("Range iterator passed!\n");
+}
+
+void testSearchBatch() {
+    if (IMPL!=1) return;
+    initTree();
+    insertRange(1, NUM_THREADS*THREAD_SIZE);
+    deleteRangeSpread(2, NUM_THREADS*THREAD_SIZE);
+    // Unsorted keys with hits, misses and keys past both ends of the tree
+    std::vector<int> keys;
+    for (int i=NUM_THREADS*THREAD_SIZE+5; i>-5; i-=3)
+        keys.push_back(i);
+    std::unique_ptr<bool[]> out(new bool[keys.size()]);
+    treeCG->searchBatch(keys.data(), keys.size(), out.get());
+    for (size_t i=0; i<keys.size(); i++) {
+        bool expected = keys[i]>0 && keys[i]<NUM_THREADS*THREAD_SIZE && keys[i]%2==1;
+        if (out[i] != expected) {
+            std::ostringstream oss;
+            oss << "Batched search returned a wrong result for " << keys[i] << "\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    // Batches smaller than a group and empty batches
+    treeCG->searchBatch(keys.data(), 1, out.get());
+    if (out[0]) throw std::runtime_error("Batched search of one key failed\n");
+    treeCG->searchBatch(keys.data(), 0, out.get());
+    deleteTree();
+    printf("Search batch passed!\n");
+}
+
+void testMultiGet() {
+    if (IMPL!=1) return;
+    initTree();
+    insertRange(1, NUM_THREADS*THREAD_SIZE);
+    deleteRangeSpread(2, NUM_THREADS*THREAD_SIZE);
+    // Unsorted keys with duplicates, misses and keys past both ends of the tree
+    std::vector<int> keys;
+    for (int i=NUM_THREADS*THREAD_SIZE+5; i>-5; i-=3) {
+        keys.push_back(i);
+        if (i%7==0) keys.push_back(i);
+    }
+    std::unique_ptr<bool[]> out(new bool[keys.size()]);
+    size_t visited = treeCG->multiGet(keys.data(), keys.size(), out.get());
+    for (size_t i=0; i<keys.size(); i++) {
+        bool expected = keys[i]>0 && keys[i]<NUM_THREADS*THREAD_SIZE && keys[i]%2==1;
+        if (out[i] != expected) {
+            std::ostringstream oss;
+            oss << "Multi-get returned a wrong result for " << keys[i] << "\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    // A shared descent never reads a node twice
+    if (visited == 0 || visited > (size_t)NUM_THREADS*THREAD_SIZE/2)
+        throw std::runtime_error("Multi-get visited more nodes than the tree holds\n");
+    if (treeCG->multiGet(keys.data(), 0, out.get()) != 0)
+        throw std::runtime_error("Empty multi-get visited nodes\n");
+    deleteTree();
+    printf("Multi-get passed!\n");
+}
+
+void testInterleavedSearch() {
+#ifdef __cpp_impl_coroutine
+    if (IMPL!=3 && IMPL!=4) return;
+    initTree();
+    insertRange(1, NUM_THREADS*THREAD_SIZE);
+    deleteRangeSpread(2, NUM_THREADS*THREAD_SIZE);
+    std::vector<int> keys;
+    for (int i=NUM_THREADS*THREAD_SIZE+5; i>-5; i-=3)
+        keys.push_back(i);
+    std::unique_ptr<bool[]> out(new bool[keys.size()]);
+    for (int depth : {1, 4, 16, 1000}) {
+        if (IMPL==3) interleavedSearch(treeLF, keys.data(), keys.size(), out.get(), depth);
+        if (IMPL==4) interleavedSearch(treeBST, keys.data(), keys.size(), out.get(), depth);
+        for (size_t i=0; i<keys.size(); i++) {
+            bool expected = keys[i]>0 && keys[i]<NUM_THREADS*THREAD_SIZE && keys[i]%2==1;
+            if (out[i] != expected) {
+                std::ostringstream oss;
+                oss << "Interleaved search returned a wrong result for " << keys[i] << " at depth " << depth << "\n";
+                throw std::runtime_error(oss.str());
+            }
+        }
+    }
+    deleteTree();
+    printf("Interleaved search passed!\n");
+#endif
+}
+
+// Concurrent updates spread over every shard, then lookups and ordered
+// range queries that cross shard boundaries
+template <typename Impl>
+void checkShardedTree() {
+    int n = NUM_THREADS*THREAD_SIZE;
+    std::vector<int> sample;
+    for (int i=1; i<n; i+=7) sample.push_back(i);
+    ShardedTree<Impl>* tree = new ShardedTree<Impl>(8, sample);
+    if (tree->numShards() != 8)
+        throw std::runtime_error("Sharded tree has the wrong number of shards\n");
+    std::vector<std::thread> threads;
+    for (int t=0; t<NUM_THREADS; t++) {
+        threads.push_back(std::thread([tree, t]() {
+            for (int i=t*THREAD_SIZE+1; i<=(t+1)*THREAD_SIZE; i++) tree->insert(i);
+            for (int i=t*THREAD_SIZE+2; i<=(t+1)*THREAD_SIZE; i+=2) tree->deleteNode(i);
+        }));
+    }
+    for (auto& th : threads) th.join();
+    for (int i=-5; i<n+5; i++) {
+        if (tree->search(i) != (i>0 && i<=n && i%2==1))
+            throw std::runtime_error("Sharded tree search returned a wrong result\n");
+    }
+    std::vector<int> out, expected;
+    tree->rangeQuery(-10, n+10, out);
+    for (int i=1; i<=n; i+=2) expected.push_back(i);
+    if (out != expected)
+        throw std::runtime_error("Sharded range query is not the ordered key set\n");
+    tree->rangeQuery(n/3, n/3+20, out);
+    expected.clear();
+    for (int i=n/3; i<=n/3+20; i++) if (i%2==1) expected.push_back(i);
+    if (out != expected)
+        throw std::runtime_error("Sharded range query returned wrong keys\n");
+    delete tree;
+
+    // Bulk load splits the input at the shard boundaries
+    tree = new ShardedTree<Impl>(4, std::vector<int>());
+    std::vector<int> sorted = {INT_MIN, -1000000, -1, 0, 1, 1000000, INT_MAX};
+    if (!tree->bulkLoad(sorted.data(), sorted.size()))
+        throw std::runtime_error("Sharded bulk load failed\n");
+    tree->rangeQuery(INT_MIN, INT_MAX, out);
+    if (out != sorted)
+        throw std::runtime_error("Sharded bulk load lost keys\n");
+    delete tree;
+
+    // A key in the last shard makes the load refuse before touching the others
+    tree = new ShardedTree<Impl>(4, std::vector<int>());
+    tree->insert(INT_MAX);
+    if (tree->bulkLoad(sorted.data(), sorted.size() - 1))
+        throw std::runtime_error("Sharded bulk load into a non-empty shard succeeded\n");
+    tree->rangeQuery(INT_MIN, INT_MAX, out);
+    if (out != std::vector<int>{INT_MAX})
+        throw std::runtime_error("Refused sharded bulk load modified the tree\n");
+    delete tree;
+}
+
+void testShardedTree() {
+    if (IMPL==1) checkShardedTree<AVLTreeCG>();
+    else if (IMPL==4) checkShardedTree<AVLTreeLF>();
+    else return;
+    printf("Sharded tree passed!\n");
+}
+
+// Readers run against a writer that moves a token key up the key space by
+// inserting its successor before deleting it. Every version holds one or two
+// tokens, so a scan that mixed versions could see none or three. Prefilled
+// keys below the tokens are never touched and must always be found.
+void testRCUSnapshots() {
+    if (IMPL!=7) return;
+    initTree();
+    int base = NUM_THREADS*THREAD_SIZE;
+    insertRange(0, base);
+    treeRCU->insert(base);
+    std::atomic<bool> stop(false);
+    std::thread writer([&]() {
+        for (int k=base; k<base+20000; k++) {
+            treeRCU->insert(k+1);
+            treeRCU->deleteNode(k);
+        }
+        stop = true;
+    });
+    std::vector<std::thread> readers;
+    std::atomic<int> errors(0);
+    for (int t=0; t<NUM_THREADS; t++) {
+        readers.push_back(std::thread([&, t]() {
+            std::vector<int> out;
+            for (int i=0; !stop; i++) {
+                treeRCU->rangeQuery(base, INT_MAX, out);
+                if (out.size()<1 || out.size()>2 || (out.size()==2 && out[1]!=out[0]+1))
+                    errors++;
+                if (!treeRCU->search((t*THREAD_SIZE+i)%base))
+                    errors++;
+            }
+        }));
+    }
+    writer.join();
+    for (auto& r : readers) r.join();
+    if (errors>0)
+        throw std::runtime_error("RCU reader saw a torn version\n");
+    checkHeightAndBalance();
+    deleteTree();
+    printf("RCU snapshots passed!\n");
+}
+
+// Speculative searches race a writer that keeps inserting and deleting even
+// keys, rotating the tree under them. Odd keys are never touched and must
+// always be found; keys past the end are never inserted.
+void testOptimisticSearch() {
+    if (IMPL!=1) return;
+    initTree();
+    int n = NUM_THREADS*THREAD_SIZE;
+    for (int i=1; i<n; i+=2) treeCG->insert(i);
+    std::atomic<bool> stop(false);
+    std::thread writer([&]() {
+        for (int round=0; round<50; round++) {
+            for (int i=0; i<n; i+=2) treeCG->insert(i);
+            for (int i=0; i<n; i+=2) treeCG->deleteNode(i);
+        }
+        stop = true;
+    });
+    std::vector<std::thread> readers;
+    std::atomic<int> errors(0);
+    for (int t=0; t<NUM_THREADS; t++) {
+        readers.push_back(std::thread([&, t]() {
+            for (int i=t; !stop; i++) {
+                if (!treeCG->search(2*(i%(n/2))+1)) errors++;
+                if (treeCG->search(n+i%n)) errors++;
+            }
+        }));
+    }
+    writer.join();
+    for (auto& r : readers) r.join();
+    if (errors>0)
+        throw std::runtime_error("Optimistic search returned a wrong result\n");
+    checkHeightAndBalance();
+    deleteTree();
+    printf("Optimistic search passed!\n");
+}
+
+void testBulkLoad() {
+    initTree();
+    std::vector<int> keys;
+    for (int i=1; i<NUM_THREADS*THREAD_SIZE; i+=3)
+        keys.push_back(i);
+    std::vector<int> unsorted = {5, 3, 9};
+    if (flexBulkLoad(unsorted.data(), unsorted.size()))
+        throw std::runtime_error("Bulk load accepted unsorted keys\n");
+    if (!flexBulkLoad(keys.data(), keys.size()))
+        throw std::runtime_error("Bulk load into an empty tree failed\n");
+    if (flexBulkLoad(keys.data(), keys.size()))
+        throw std::runtime_error("Bulk load into a non-empty tree succeeded\n");
+    for (int i=1; i<NUM_THREADS*THREAD_SIZE; i++) {
+        bool found = flexSearch(i);
+        if (i%3==1 && !found) {
+            std::ostringstream oss;
+            oss << "Bulk load failed, missing " << i << "\n";
+            throw std::runtime_error(oss.str());
+        }
+        else if (i%3!=1 && found) {
+            std::ostringstream oss;
+            oss << "Bulk load failed, incorrectly finding " << i << "\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    checkHeightAndBalance();
+    // The loaded tree must keep working under regular updates
+    insertRange(NUM_THREADS*THREAD_SIZE, 2*NUM_THREADS*THREAD_SIZE);
+    deleteRangeContiguous(1, NUM_THREADS*THREAD_SIZE/2);
+    checkHeightAndBalance();
+    deleteTree();
+    printf("Bulk load passed!\n");
+}
+
+void testFreeze() {
+    if (IMPL!=1) return;
+    initTree();
+    insertRange(1, NUM_THREADS*THREAD_SIZE);
+    deleteRangeSpread(2, NUM_THREADS*THREAD_SIZE);
+    for (FrozenTree::Layout layout : {FrozenTree::EYTZINGER, FrozenTree::VEB}) {
+        FrozenTree* frozen = freeze(*treeCG, layout);
+        for (int i=0; i<=NUM_THREADS*THREAD_SIZE; i++) {
+            if (frozen->search(i) != (i%2==1)) {
+                std::ostringstream oss;
+                oss << "Frozen search failed for " << i << " in layout " << layout << "\n";
+                throw std::runtime_error(oss.str());
+            }
+        }
+        AVLTreeCG thawed;
+        if (!thaw(*frozen, thawed))
+            throw std::runtime_error("Thaw into an empty tree failed\n");
+        std::vector<int> expected, out;
+        treeCG->rangeQuery(INT_MIN, INT_MAX, expected);
+        thawed.rangeQuery(INT_MIN, INT_MAX, out);
+        if (out != expected)
+            throw std::runtime_error("Thawed tree differs from the frozen one\n");
+        checkHeightAndBalanceCG(thawed.root);
+        delete frozen;
+    }
+    deleteTree();
+    printf("Freeze passed!\n");
+}
+
+void testCompaction() {
+    if (IMPL!=1) return;
+    initTree();
+    insertRange(1, NUM_THREADS*THREAD_SIZE);
+    deleteRangeSpread(2, NUM_THREADS*THREAD_SIZE);
+    std::vector<int> expected, out;
+    treeCG->rangeQuery(INT_MIN, INT_MAX, expected);
+    treeCG->compact();
+    treeCG->rangeQuery(INT_MIN, INT_MAX, out);
+    if (out != expected)
+        throw std::runtime_error("Compacted tree holds the wrong keys\n");
+    checkHeightAndBalance();
+    // Readers search while the tree is compacted again and again under them
+    std::atomic<bool> stop(false), failed(false);
+    std::vector<std::thread> threads;
+    for (int t=0; t<NUM_THREADS; t++) {
+        threads.push_back(std::thread([&]() {
+            while (!stop.load())
+                for (int i=1; i<NUM_THREADS*THREAD_SIZE; i++)
+                    if (treeCG->search(i) != (i%2==1))
+                        failed.store(true);
+        }));
+    }
+    for (int round=0; round<10; round++)
+        treeCG->compact();
+    stop.store(true);
+    for (std::thread& t : threads)
+        t.join();
+    if (failed.load())
+        throw std::runtime_error("Search during compaction failed\n");
+    // Arena nodes must survive updates, which delete some of them
+    deleteRangeSpread(1, NUM_THREADS*THREAD_SIZE);
+    insertRange(1, NUM_THREADS*THREAD_SIZE);
+    checkHeightAndBalance();
+    treeCG->compact();
+    for (int i=1; i<NUM_THREADS*THREAD_SIZE; i++) {
+        if (!treeCG->search(i)) {
+            std::ostringstream oss;
+            oss << "Search after compaction failed for " << i << "\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    deleteTree();
+    printf("Compaction passed!\n");
+}
+
+// Nodes from HugePagePool must mix with ordinary ones: the pool is turned
+// off halfway, so the tree ends up holding both and frees both
+void testHugePages() {
+    HugePagePool::enable();
+    testConcurrentInsert();
+    testInsertDeleteSpread();
+    initTree();
+    std::vector<std::thread> threads;
+    for (int i=0; i<NUM_THREADS; i++) {
+        threads.push_back(thread(insertRange, 1+i*THREAD_SIZE, 1+(i+1)*THREAD_SIZE));
+    }
+    for (int i=0; i<NUM_THREADS; i++) {
+        threads[i].join();
+    }
+    HugePagePool::disable();
+    deleteRangeSpread(1, 1+NUM_THREADS*THREAD_SIZE);
+    insertRange(1+NUM_THREADS*THREAD_SIZE, 1+2*NUM_THREADS*THREAD_SIZE);
+    for (int i=1; i<=2*NUM_THREADS*THREAD_SIZE; i++) {
+        if (flexSearch(i) != (i%2==0 || i>NUM_THREADS*THREAD_SIZE)) {
+            std::ostringstream oss;
+            oss << "Search with huge-page nodes failed for " << i << "\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    checkHeightAndBalance();
+    deleteTree();
+    printf("Huge pages passed!\n");
+}
+
+static_assert(sizeof(NodeCG) < sizeof(CGNode<int, char>), "the Unit value of AVLTreeCG takes room in its nodes");
+
+// Every operation's returned value against std::map, with 64-bit keys in
+// descending order, then concurrent puts and removes on disjoint keys
+void testMap() {
+    if (IMPL!=1) return;
+    AVLMapCG<uint64_t, std::string, std::greater<uint64_t>> map;
+    std::map<uint64_t, std::string> expected;
+    std::mt19937_64 g(42);
+    for (int i=0; i<NUM_THREADS*THREAD_SIZE*100; i++) {
+        uint64_t key = g() % (NUM_THREADS*THREAD_SIZE) << 32;
+        std::string value = std::to_string(g() % 1000);
+        auto it = expected.find(key);
+        std::optional<std::string> before = it == expected.end() ? std::nullopt : std::optional<std::string>(it->second);
+        std::optional<std::string> result;
+        switch (i%4) {
+            case 0: result = map.put(key, value); expected[key] = value; break;
+            case 1: result = map.putIfAbsent(key, value); expected.emplace(key, value); break;
+            case 2: result = map.remove(key); expected.erase(key); break;
+            default: result = map.get(key); break;
+        }
+        if (result != before) {
+            std::ostringstream oss;
+            oss << "Map operation " << i%4 << " returned the wrong value for " << key << "\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    if (map.size() != expected.size())
+        throw std::runtime_error("Map size is wrong\n");
+
+    AVLMapCG<uint64_t, uint64_t> concurrent;
+    std::vector<std::thread> threads;
+    for (int t=0; t<NUM_THREADS; t++) {
+        threads.push_back(std::thread([&concurrent, t]() {
+            for (uint64_t k=t*THREAD_SIZE; k<(uint64_t)(t+1)*THREAD_SIZE; k++)
+                concurrent.put(k, k*k);
+            for (uint64_t k=t*THREAD_SIZE; k<(uint64_t)(t+1)*THREAD_SIZE; k+=2)
+                concurrent.remove(k);
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+    for (uint64_t k=0; k<(uint64_t)NUM_THREADS*THREAD_SIZE; k++) {
+        if (concurrent.get(k) != (k%2==1 ? std::optional<uint64_t>(k*k) : std::nullopt)) {
+            std::ostringstream oss;
+            oss << "Concurrent map get failed for " << k << "\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    printf("Map passed!\n");
+}
+
+// Single-threaded semantics first. Then increments through compute and
+// through get and replace retry loops on a few hot keys, which must all
+// land while another thread churns the keys around them, so that hot nodes
+// are rotated and, in the KCAS tree, take over from deleted predecessors
+template <typename Map, typename Remove>
+void checkAtomicUpdates(Map& map, Remove remove) {
+    int n = NUM_THREADS*THREAD_SIZE;
+    auto plusOne = [](std::optional<int> v) { return v ? *v + 1 : 1; };
+    for (int k=1; k<=n; k++) {
+        if (map.putIfAbsent(k, k) != std::nullopt || map.putIfAbsent(k, 0) != std::optional<int>(k))
+            throw std::runtime_error("putIfAbsent returned the wrong value\n");
+        if (map.replace(k, k+1, 0) || !map.replace(k, k, 2*k) || map.get(k) != std::optional<int>(2*k))
+            throw std::runtime_error("replace did not compare the value\n");
+        if (map.compute(k, plusOne) != 2*k+1 || map.compute(n+k, plusOne) != 1 || map.get(n+k) != std::optional<int>(1))
+            throw std::runtime_error("compute returned the wrong value\n");
+        if (map.replace(2*n+k, 0, 1) || map.get(2*n+k) != std::nullopt)
+            throw std::runtime_error("replace inserted an absent key\n");
+        if (!map.replace(k, 2*k+1, -k) || map.get(k) != std::optional<int>(-k))
+            throw std::runtime_error("A negative value did not round-trip\n");
+    }
+    for (int k=1; k<=2*n; k++)
+        remove(k);
+
+    std::vector<std::thread> threads;
+    for (int t=0; t<NUM_THREADS; t++) {
+        threads.push_back(std::thread([&map, plusOne, t]() {
+            for (int i=0; i<THREAD_SIZE*10; i++) {
+                int k = 10 * (1 + (i+t) % 8);
+                if (i%2==0) {
+                    map.compute(k, plusOne);
+                    continue;
+                }
+                while (true) {
+                    std::optional<int> v = map.get(k);
+                    if (v ? map.replace(k, *v, *v+1) : map.putIfAbsent(k, 1) == std::nullopt)
+                        break;
+                }
+            }
+        }));
+    }
+    threads.push_back(std::thread([&map, remove, n]() {
+        for (int round=0; round<10; round++) {
+            for (int k=1; k<=n; k++)
+                if (k%10!=0) map.putIfAbsent(k, 0);
+            for (int k=1; k<=n; k++)
+                if (k%10!=0) remove(k);
+        }
+    }));
+    for (std::thread& t : threads)
+        t.join();
+    for (int k=10; k<=80; k+=10) {
+        if (map.get(k) != std::optional<int>(NUM_THREADS*THREAD_SIZE*10/8)) {
+            std::ostringstream oss;
+            oss << "Increments of hot key " << k << " were lost\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+}
+
+void testAtomicUpdates() {
+    if (IMPL==1) {
+        AVLMapCG<int, int> map;
+        checkAtomicUpdates(map, [&map](int k) { map.remove(k); });
+    }
+    else if (IMPL==3) {
+        initTree();
+        checkAtomicUpdates(*treeLF, [](int k) { treeLF->deleteNode(k); });
+        deleteTree();
+    }
+    else return;
+    printf("Atomic updates passed!\n");
+}
+
+// Keys in (lo, hi), parent pointers consistent, and if exact, heights
+// exact and balanced
+int checkTransactionTree(Node* node, Node* parent, long long lo, long long hi, bool exact) {
+    if (node==nullptr) return 0;
+    if (node->parent.getValue()!=parent)
+        throw std::runtime_error("Transaction left a wrong parent pointer\n");
+    int key = node->key;
+    if (key<=lo || key>=hi)
+        throw std::runtime_error("Transaction broke the key order\n");
+    int leftHeight = checkTransactionTree(node->left, node, lo, key, exact);
+    int rightHeight = checkTransactionTree(node->right, node, key, hi, exact);
+    if (exact && (node->height.getValue()!=1+std::max(leftHeight, rightHeight) || std::abs(leftHeight-rightHeight)>1))
+        throw std::runtime_error("Transaction left the tree unbalanced\n");
+    return node->height.getValue();
+}
+
+// Random transactions against a std::map applying the same ops, then
+// concurrent swaps and moves, which must keep the number of keys and the
+// multiset of values
+void testTransactions() {
+    if (IMPL!=3) return;
+    typedef AVLTree::TxOp TxOp;
+    int n = NUM_THREADS*THREAD_SIZE;
+    initTree();
+    std::vector<int> keys;
+    for (int k=2; k<=2*n; k+=2) keys.push_back(k);
+    treeLF->bulkLoad(keys.data(), keys.size());
+    std::map<int, int> expected;
+    for (int k : keys) expected[k] = 0;
+    std::mt19937 g(42);
+    for (int i=0; i<2000; i++) {
+        std::vector<TxOp> ops;
+        for (int j=(int)(g()%6); j>=0; j--)
+            ops.push_back({(TxOp::Kind)(g()%5), 1+(int)(g()%(2*n+10)), (int)(g()%(2*n+10))});
+        std::map<int, int> after = expected;
+        bool ok = true;
+        for (const TxOp& op : ops) {
+            bool has = after.count(op.key)>0;
+            switch (op.kind) {
+                case TxOp::INSERT: ok = !has && op.key>0; if (ok) after[op.key] = op.arg; break;
+                case TxOp::ERASE: ok = has; after.erase(op.key); break;
+                case TxOp::SET: ok = has; if (ok) after[op.key] = op.arg; break;
+                case TxOp::MOVE:
+                    ok = has && (op.arg==op.key || (op.arg>0 && after.count(op.arg)==0));
+                    if (ok) { int v = after[op.key]; after.erase(op.key); after[op.arg] = v; }
+                    break;
+                case TxOp::SWAP:
+                    ok = has && after.count(op.arg)>0;
+                    if (ok) std::swap(after[op.key], after[op.arg]);
+                    break;
+            }
+            if (!ok) break;
+        }
+        if (treeLF->transact(ops)!=ok) {
+            std::ostringstream oss;
+            oss << "Transaction " << i << " returned " << !ok << "\n";
+            throw std::runtime_error(oss.str());
+        }
+        if (ok) expected = after;
+        if (i%100==0) {
+            for (int k=1; k<2*n+10; k++) {
+                auto it = expected.find(k);
+                if (treeLF->get(k)!=(it==expected.end() ? std::nullopt : std::optional<int>(it->second)))
+                    throw std::runtime_error("Transaction results differ from std::map\n");
+            }
+            checkTransactionTree(treeLF->minRoot->right, treeLF->minRoot, 0, INT_MAX, true);
+        }
+    }
+    std::vector<int> batch = {2*n+20, 2*n+21, 2*n+22};
+    if (!treeLF->insertAll(batch.data(), batch.size()) || !treeLF->search(2*n+21))
+        throw std::runtime_error("insertAll failed\n");
+    batch = {2*n+30, 2*n+31, 2*n+20};
+    if (treeLF->insertAll(batch.data(), batch.size()) || treeLF->search(2*n+30) || treeLF->search(2*n+31))
+        throw std::runtime_error("insertAll was not all or nothing\n");
+    deleteTree();
+
+    // Absent keys spread over a large tree touch more words than one KCAS
+    // descriptor holds, so insertAll must refuse them and change nothing,
+    // also when the last key is present and only validation reads them
+    initTree();
+    keys.clear();
+    for (int k=2; k<=2000000; k+=2) keys.push_back(k);
+    treeLF->bulkLoad(keys.data(), keys.size());
+    batch.clear();
+    for (int k=1; k<2000000; k+=200) batch.push_back(k);
+    if (treeLF->insertAll(batch.data(), batch.size()))
+        throw std::runtime_error("Oversized insertAll succeeded\n");
+    batch.push_back(2);
+    if (treeLF->insertAll(batch.data(), batch.size()))
+        throw std::runtime_error("Oversized insertAll of a present key succeeded\n");
+    for (int k=1; k<2000000; k+=200) {
+        if (treeLF->search(k))
+            throw std::runtime_error("Refused insertAll inserted a key\n");
+    }
+    checkTransactionTree(treeLF->minRoot->right, treeLF->minRoot, 0, INT_MAX, true);
+    batch = {1, 3, 5};
+    if (!treeLF->insertAll(batch.data(), batch.size()) || !treeLF->search(3))
+        throw std::runtime_error("insertAll after a refused one failed\n");
+    deleteTree();
+
+    initTree();
+    for (int k=1; k<=n; k++)
+        treeLF->putIfAbsent(k, k);
+    std::vector<std::thread> threads;
+    for (int t=0; t<NUM_THREADS; t++) {
+        threads.push_back(std::thread([n, t]() {
+            std::mt19937 g(t);
+            for (int i=0; i<THREAD_SIZE*10; i++) {
+                int a = 1+(int)(g()%(4*n));
+                int b = 1+(int)(g()%(4*n));
+                if (i%2==0) treeLF->swap(a, b);
+                else treeLF->move(a, b);
+            }
+        }));
+    }
+    for (std::thread& t : threads)
+        t.join();
+    std::vector<int> values;
+    for (int k=1; k<=4*n; k++) {
+        std::optional<int> v = treeLF->get(k);
+        if (v) values.push_back(*v);
+    }
+    std::sort(values.begin(), values.end());
+    for (int i=0; i<n; i++) {
+        if ((int)values.size()!=n || values[i]!=i+1)
+            throw std::runtime_error("Concurrent transactions lost or duplicated a value\n");
+    }
+    checkTransactionTree(treeLF->minRoot->right, treeLF->minRoot, 0, INT_MAX, false);
+    deleteTree();
+    printf("Transactions passed!\n");
+}
+
+// rank, select and countRange against the sorted keys of a std::set model
+template <typename Tree>
+void checkOrderStatistics(Tree& tree, const std::set<int>& model, std::mt19937& g) {
+    std::vector<int> keys(model.begin(), model.end());
+    for (size_t i=0; i<=keys.size(); i++) {
+        int key = -1;
+        bool found = tree.select(i, key);
+        if (found != (i<keys.size()) || (found && key!=keys[i])) {
+            std::ostringstream oss;
+            oss << "select(" << i << ") failed\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    for (int q=0; q<1000; q++) {
+        int lo = (int)(g()%2200)-100;
+        int hi = (int)(g()%2200)-100;
+        size_t rank = std::lower_bound(keys.begin(), keys.end(), lo)-keys.begin();
+        size_t count = lo>hi ? 0 : std::upper_bound(keys.begin(), keys.end(), hi)-keys.begin()-rank;
+        if (tree.rank(lo)!=rank || tree.countRange(lo, hi)!=count) {
+            std::ostringstream oss;
+            oss << "rank or countRange failed for [" << lo << ", " << hi << "]\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    if (tree.countRange(INT_MIN, INT_MAX)!=keys.size())
+        throw std::runtime_error("countRange over all keys failed\n");
+}
+
+// Random inserts and deletes of present keys, which every tree handles,
+// checking the subtree sizes through the order statistics as they go
+template <typename Tree>
+void churnOrderStatistics(Tree& tree, std::set<int>& model, std::mt19937& g) {
+    for (int round=0; round<20; round++) {
+        for (int i=0; i<500; i++) {
+            int k = g()%2000;
+            if (model.count(k) && model.size()>1) {
+                tree.deleteNode(k);
+                model.erase(k);
+            }
+            else if (!model.count(k)) {
+                tree.insert(k);
+                model.insert(k);
+            }
+        }
+        checkOrderStatistics(tree, model, g);
+    }
+}
+
+void testOrderStatistics() {
+    std::mt19937 g(7);
+    std::set<int> model;
+    if (IMPL==1) {
+        initTree();
+        churnOrderStatistics(*treeCG, model, g);
+        treeCG->compact();
+        checkOrderStatistics(*treeCG, model, g);
+        churnOrderStatistics(*treeCG, model, g);
+        deleteTree();
+        std::vector<int> sorted;
+        for (int k=0; k<2000; k+=3) sorted.push_back(k);
+        initTree();
+        treeCG->bulkLoad(sorted.data(), sorted.size());
+        checkOrderStatistics(*treeCG, std::set<int>(sorted.begin(), sorted.end()), g);
+        deleteTree();
+    }
+    else if (IMPL==2) {
+        // Only reached when run on its own: the IMPL 2 suite fails its
+        // concurrent tests first, since AVLTreeFG rotates after releasing
+        // its node locks and reassigns root unlocked
+        initTree();
+        churnOrderStatistics(*treeFG, model, g);
+        deleteTree();
+    }
+    else return;
+    printf("Order statistics passed!\n");
+}
+
+// StringKey must order like std::string, including keys that share their
+// whole inline prefix, contain zero bytes or are prefixes of each other
+void testStringKeys() {
+    if (IMPL!=1) return;
+    std::mt19937 g(42);
+    std::vector<std::string> strings;
+    for (int i=0; i<THREAD_SIZE; i++) {
+        std::string s(g() % 40, 'a');
+        for (char& ch : s)
+            ch = "ab\0\xff"[g() % 4];
+        strings.push_back(s);
+    }
+    std::vector<StringKey> keys(strings.begin(), strings.end());
+    for (size_t i=0; i<strings.size(); i++) {
+        if (keys[i].str() != strings[i])
+            throw std::runtime_error("StringKey does not round-trip\n");
+        for (size_t j=0; j<strings.size(); j+=7) {
+            if ((keys[i] < keys[j]) != (strings[i] < strings[j]) || (StringKey::borrow(strings[i]) < keys[j]) != (strings[i] < strings[j])) {
+                std::ostringstream oss;
+                oss << "StringKey order differs from std::string for keys " << i << " and " << j << "\n";
+                throw std::runtime_error(oss.str());
+            }
+        }
+    }
+    // A moved-from long key is the empty key
+    StringKey moved(std::string(40, 'a'));
+    StringKey taken(std::move(moved));
+    if (!(moved == StringKey()) || moved.size() != 0 || moved.str() != "" || !(moved < taken) || taken.str() != std::string(40, 'a'))
+        throw std::runtime_error("Moved-from StringKey is not empty\n");
+    AVLMapCG<StringKey, int> map;
+    std::map<std::string, int> expected;
+    for (int i=0; i<NUM_THREADS*THREAD_SIZE*10; i++) {
+        const std::string& s = strings[g() % strings.size()];
+        if (i%3 == 0) {
+            map.put(StringKey(s), i);
+            expected[s] = i;
+        }
+        else if (i%3 == 1 && map.remove(StringKey::borrow(s)).has_value() != (expected.erase(s) == 1))
+            throw std::runtime_error("String map remove returned the wrong result\n");
+        auto it = expected.find(s);
+        if (map.get(StringKey::borrow(s)) != (it == expected.end() ? std::nullopt : std::optional<int>(it->second)))
+            throw std::runtime_error("String map get returned the wrong value\n");
+    }
+    printf("String keys passed!\n");
+}
+
+// Balance bits must match the real subtree heights; returns the height
+int checkHeightAndBalanceCompact(const AVLTreeCompact& tree, uint32_t i, long long lo, long long hi) {
+    if (i==0) return 0;
+    const CompactNode& node = tree.node(i);
+    if (node.key<=lo || node.key>=hi)
+        throw std::runtime_error("Compact node key out of order");
+    int leftHeight = checkHeightAndBalanceCompact(tree, node.left & COMPACT_INDEX_MASK, lo, node.key);
+    int rightHeight = checkHeightAndBalanceCompact(tree, node.right & COMPACT_INDEX_MASK, node.key, hi);
+    if (leftHeight-rightHeight != (int)(node.left>>31) - (int)(node.right>>31))
+        throw std::runtime_error("Compact node balance bits are wrong");
+    return 1+std::max(leftHeight, rightHeight);
+}
+
+void testCompactTree() {
+    if (IMPL!=1) return;
+    AVLTreeCompact tree;
+    std::set<int> expected;
+    std::mt19937 g(42);
+    for (int i=0; i<NUM_THREADS*THREAD_SIZE*100; i++) {
+        int key = g() % (NUM_THREADS*THREAD_SIZE);
+        if (i%2==0 && tree.insert(key) != expected.insert(key).second)
+            throw std::runtime_error("Compact insert returned the wrong result\n");
+        if (i%2==1 && tree.deleteNode(key) != (expected.erase(key)==1))
+            throw std::runtime_error("Compact delete returned the wrong result\n");
+    }
+    checkHeightAndBalanceCompact(tree, tree.rootIndex(), LLONG_MIN, LLONG_MAX);
+    for (int i=0; i<NUM_THREADS*THREAD_SIZE; i++) {
+        if (tree.search(i) != (expected.count(i)==1)) {
+            std::ostringstream oss;
+            oss << "Compact search failed for " << i << "\n";
+            throw std::runtime_error(oss.str());
+        }
+    }
+    std::vector<int> out;
+    tree.rangeQuery(INT_MIN, INT_MAX, out);
+    if (out != std::vector<int>(expected.begin(), expected.end()) || tree.size() != expected.size())
+        throw std::runtime_error("Compact tree holds the wrong keys\n");
+    printf("Compact tree passed!\n");
+}
+
 /* MAIN FUNCTION */
 int main() {
     printf("Got here \n");
@@ -402,4 +1357,25 @@ int main() {
 	for (int i=0; i<10; i++) {
 		testInsertDeleteSpread();
 	}
+	testBulkLoad();
+	testRangeQuery();
+	testRangeIterator();
+	testSearchBatch();
+	testMultiGet();
+	testInterleavedSearch();
+	testShardedTree();
+	testRCUSnapshots();
+	testOptimisticSearch();
+	testFreeze();
+	testCompactTree();
+	testCompaction();
+	testHugePages();
+	testMap();
+	testStringKeys();
+	testAtomicUpdates();
+	testTransactions();
+	testOrderStatistics();
+	for (int i=0; i<10; i++) {
+		testConcurrentRangeQuery();
+	}
 }
\ No newline at end of file
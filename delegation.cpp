@@ -0,0 +1,166 @@
+#include "delegation.h"
+#include "threadslot.h"
+#include <algorithm>
+#include <functional>
+
+// Client indices are per thread and shared by every AVLTreeDG, like the
+// slots of AVLTreeFC
+typedef ThreadSlots<DG_MAX_CLIENTS> DGClients;
+
+AVLTreeDG::AVLTreeDG(int numServers, std::vector<int> sample)
+    : bounds(shardBounds(numServers, std::move(sample))), stop(false) {
+    int n = bounds.size() + 1;
+    mailboxes = new Mailbox[DG_MAX_CLIENTS * n]();
+    loadKeys.assign(n, nullptr);
+    loadCount.assign(n, 0);
+    for (int i = 0; i < n; i++)
+        servers.push_back(std::thread(&AVLTreeDG::serve, this, i));
+}
+
+// Clients must have finished before the tree is destroyed
+AVLTreeDG::~AVLTreeDG() {
+    stop = true;
+    for (auto& t : servers)
+        t.join();
+    delete[] mailboxes;
+}
+
+int AVLTreeDG::serverOf(int key) const {
+    return std::upper_bound(bounds.begin(), bounds.end(), key) - bounds.begin();
+}
+
+// Answer every mailbox whose request is newer than its response until the
+// tree is destroyed
+void AVLTreeDG::serve(int server) {
+    AVLTree* tree = new AVLTree();
+    while (!stop.load(std::memory_order_acquire)) {
+        bool busy = false;
+        int limit = DGClients::limit();
+        for (int c = 0; c < limit; c++) {
+            Mailbox& box = mailbox(c, server);
+            unsigned seq = box.request.seq.load(std::memory_order_acquire);
+            if (seq == box.response.seq.load(std::memory_order_relaxed))
+                continue;
+            for (int i = 0; i < box.request.count; i++) {
+                int key = box.request.ops[i].key;
+                int type = box.request.ops[i].type;
+                bool result;
+                if (type == DelegatedOp::INSERT) {
+                    result = !tree->search(key);
+                    if (result) tree->insert(key);
+                }
+                else if (type == DelegatedOp::DELETE) {
+                    result = tree->search(key);
+                    if (result) tree->deleteNode(key);
+                }
+                else if (type == DelegatedOp::SEARCH) {
+                    result = tree->search(key);
+                }
+                else {
+                    result = tree->bulkLoad(loadKeys[server], loadCount[server]);
+                }
+                box.response.results[i] = result;
+            }
+            box.response.seq.store(seq, std::memory_order_release);
+            busy = true;
+        }
+        if (!busy)
+            std::this_thread::yield();
+    }
+    delete tree;
+}
+
+void AVLTreeDG::post(Mailbox& box) {
+    box.request.seq.store(box.request.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void AVLTreeDG::wait(Mailbox& box) {
+    unsigned seq = box.request.seq.load(std::memory_order_relaxed);
+    while (box.response.seq.load(std::memory_order_acquire) != seq)
+        std::this_thread::yield();
+}
+
+bool AVLTreeDG::single(int key, DelegatedOp::Type type) {
+    Mailbox& box = mailbox(DGClients::id(), serverOf(key));
+    box.request.ops[0].key = key;
+    box.request.ops[0].type = type;
+    box.request.count = 1;
+    post(box);
+    wait(box);
+    return box.response.results[0];
+}
+
+bool AVLTreeDG::insert(int key) {
+    return single(key, DelegatedOp::INSERT);
+}
+
+bool AVLTreeDG::deleteNode(int key) {
+    return single(key, DelegatedOp::DELETE);
+}
+
+bool AVLTreeDG::search(int key) {
+    return single(key, DelegatedOp::SEARCH);
+}
+
+void AVLTreeDG::execute(const DelegatedOp* ops, size_t n, bool* out) {
+    int client = DGClients::id();
+    int serverCount = numServers();
+    std::vector<std::vector<size_t>> queues(serverCount);
+    for (size_t i = 0; i < n; i++)
+        queues[serverOf(ops[i].key)].push_back(i);
+    std::vector<size_t> done(serverCount, 0);
+    bool pending = n > 0;
+    while (pending) {
+        for (int s = 0; s < serverCount; s++) {
+            size_t count = std::min((size_t)DG_BATCH, queues[s].size() - done[s]);
+            if (count == 0)
+                continue;
+            Mailbox& box = mailbox(client, s);
+            for (size_t i = 0; i < count; i++) {
+                const DelegatedOp& op = ops[queues[s][done[s] + i]];
+                box.request.ops[i].key = op.key;
+                box.request.ops[i].type = op.type;
+            }
+            box.request.count = count;
+            post(box);
+        }
+        pending = false;
+        for (int s = 0; s < serverCount; s++) {
+            size_t count = std::min((size_t)DG_BATCH, queues[s].size() - done[s]);
+            if (count == 0)
+                continue;
+            Mailbox& box = mailbox(client, s);
+            wait(box);
+            for (size_t i = 0; i < count; i++)
+                out[queues[s][done[s] + i]] = box.response.results[i];
+            done[s] += count;
+            pending |= done[s] < queues[s].size();
+        }
+    }
+}
+
+// Hand every server its slice of the sorted keys and let it build its own
+// tree, in parallel across servers
+bool AVLTreeDG::bulkLoad(const int* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted + n, std::greater_equal<int>()) != sorted + n)
+        return false;
+    int client = DGClients::id();
+    const int* begin = sorted;
+    for (int s = 0; s < numServers(); s++) {
+        const int* end = s < (int)bounds.size() ? std::lower_bound(begin, sorted + n, bounds[s]) : sorted + n;
+        loadKeys[s] = begin;
+        loadCount[s] = end - begin;
+        begin = end;
+        Mailbox& box = mailbox(client, s);
+        box.request.ops[0].type = BULK_LOAD;
+        box.request.count = 1;
+        post(box);
+    }
+    bool ok = true;
+    for (int s = 0; s < numServers(); s++) {
+        Mailbox& box = mailbox(client, s);
+        wait(box);
+        ok &= box.response.results[0];
+    }
+    return ok;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include "sequential.h"
+#include "sharded.h"
+
+// Upper bound on the number of client threads of delegated trees at once
+#define DG_MAX_CLIENTS 256
+// Requests per mailbox message, sized so a message fills one cache line
+#define DG_BATCH 7
+
+// One request to a delegated tree
+struct DelegatedOp {
+    enum Type {INSERT, DELETE, SEARCH};
+    int key;
+    Type type;
+};
+
+/*
+ * Delegated AVL tree: the key space is range-partitioned across server
+ * threads, each owning a private sequential AVLTree that no other thread
+ * touches. Clients never read tree nodes; they write up to DG_BATCH
+ * requests into a one-cache-line mailbox per (client, server) pair and
+ * poll the matching response line, so each batch costs one cache line
+ * transfer each way. Server threads are not pinned, so nothing places a
+ * tree's nodes near the core serving it. Range queries are not delegated.
+ */
+class AVLTreeDG {
+public:
+    // Server key ranges come from shardBounds(numServers, sample)
+    AVLTreeDG(int numServers, std::vector<int> sample);
+    ~AVLTreeDG();
+
+    bool insert(int key);
+    bool deleteNode(int key);
+    bool search(int key);
+    // Apply ops[0, n) and store their results in out[0, n). Requests are
+    // grouped by server and posted to all servers before waiting, so a
+    // client keeps every server busy with one message per batch.
+    void execute(const DelegatedOp* ops, size_t n, bool* out);
+    // Only valid before any other operation
+    bool bulkLoad(const int* sorted, size_t n);
+
+    int numServers() const { return bounds.size() + 1; }
+
+private:
+    // Written by the client only; seq changes once per posted message
+    struct alignas(64) Request {
+        std::atomic<unsigned> seq;
+        int count;
+        struct { int key; int type; } ops[DG_BATCH];
+    };
+    // Written by the server only; seq echoes the request it answers
+    struct alignas(64) Response {
+        std::atomic<unsigned> seq;
+        bool results[DG_BATCH];
+    };
+    struct Mailbox {
+        Request request;
+        Response response;
+    };
+    // Message type for bulk loading, outside the client-visible op types
+    static const int BULK_LOAD = -1;
+
+    std::vector<int> bounds;
+    std::vector<std::thread> servers;
+    // mailboxes[client * numServers + server]
+    Mailbox* mailboxes;
+    std::vector<const int*> loadKeys;
+    std::vector<size_t> loadCount;
+    std::atomic<bool> stop;
+
+    int serverOf(int key) const;
+    Mailbox& mailbox(int client, int server) { return mailboxes[client * numServers() + server]; }
+    void post(Mailbox& box);
+    void wait(Mailbox& box);
+    bool single(int key, DelegatedOp::Type type);
+    void serve(int server);
+};
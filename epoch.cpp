@@ -0,0 +1,55 @@
+#include "epoch.h"
+#include "threadslot.h"
+#include <algorithm>
+
+typedef ThreadSlots<EPOCH_MAX_THREADS> EpochSlots;
+
+EpochManager::EpochManager() : global(1) {
+    for (int i = 0; i < EPOCH_MAX_THREADS; i++)
+        readers[i].epoch = 0;
+}
+
+EpochManager::~EpochManager() {
+    for (Retired& r : retired)
+        r.free(r.p);
+}
+
+// The fence keeps the announcement ahead of every shared pointer this reader
+// loads afterwards, so a writer that scans the readers either sees it or has
+// already unlinked what it is about to free
+void EpochManager::enter() {
+    readers[EpochSlots::id()].epoch.store(global.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochManager::leave() {
+    readers[EpochSlots::id()].epoch.store(0, std::memory_order_release);
+}
+
+void EpochManager::retire(void* p, void (*free)(void*)) {
+    std::lock_guard<std::mutex> guard(retireLock);
+    retired.push_back({p, free, global.load()});
+    if (retired.size() >= EPOCH_RECLAIM_BATCH)
+        reclaimLocked();
+}
+
+void EpochManager::reclaim() {
+    std::lock_guard<std::mutex> guard(retireLock);
+    reclaimLocked();
+}
+
+// An object retired in epoch e may be held by readers that entered in e or
+// earlier. Once the oldest reader inside entered after e, nobody can reach it.
+void EpochManager::reclaimLocked() {
+    unsigned long oldest = ++global;
+    int limit = EpochSlots::limit();
+    for (int i = 0; i < limit; i++) {
+        unsigned long e = readers[i].epoch.load();
+        if (e != 0 && e < oldest)
+            oldest = e;
+    }
+    auto keep = std::partition(retired.begin(), retired.end(), [oldest](const Retired& r) { return r.epoch >= oldest; });
+    for (auto it = keep; it != retired.end(); ++it)
+        it->free(it->p);
+    retired.erase(keep, retired.end());
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Upper bound on the number of threads reading under one EpochManager at once
+#define EPOCH_MAX_THREADS 512
+// Retired objects collected before the retiring thread tries to reclaim
+#define EPOCH_RECLAIM_BATCH 1024
+
+/*
+ * Epoch-based reclamation. Readers bracket every access to shared objects
+ * with enter() and leave(), which only write the reader's own cache line.
+ * Writers unlink an object first and then retire() it; it is freed once
+ * every reader that was inside when it was retired has left.
+ */
+class EpochManager {
+public:
+    EpochManager();
+    // Frees everything still retired; no reader may be inside
+    ~EpochManager();
+
+    void enter();
+    void leave();
+    // free(p) runs once no reader can still hold a reference to p
+    void retire(void* p, void (*free)(void*));
+    // Advance the epoch and free every retired object no reader can see
+    void reclaim();
+
+private:
+    // Epoch the reader entered in, 0 while it is outside
+    struct alignas(64) Reader {
+        std::atomic<unsigned long> epoch;
+    };
+    struct Retired {
+        void* p;
+        void (*free)(void*);
+        unsigned long epoch;
+    };
+
+    Reader readers[EPOCH_MAX_THREADS];
+    std::atomic<unsigned long> global;
+    std::mutex retireLock;
+    std::vector<Retired> retired;
+
+    void reclaimLocked();
+};
@@ -1,8 +1,10 @@
 #include "finegrained.h"
+#include "parallel.h"
 #include <iostream>
 #include <mutex>
+#include <algorithm>
 
-NodeFG::NodeFG(int k) : key(k), left(nullptr), right(nullptr), height(1), nodeLock() {}
+NodeFG::NodeFG(int k) : key(k), left(nullptr), right(nullptr), height(1), size(1), nodeLock() {}
 
 AVLTreeFG::AVLTreeFG() : root(nullptr) {}
 
@@ -24,7 +26,9 @@ NodeFG* AVLTreeFG::rightRotate(NodeFG* y) {
     x->right = y;
     y->left = T2;
     y->height = std::max(height(y->left), height(y->right)) + 1;
+    y->size = size(y->left) + size(y->right) + 1;
     x->height = std::max(height(x->left), height(x->right)) + 1;
+    x->size = size(x->left) + size(x->right) + 1;
     return x;
 }
 
@@ -35,7 +39,9 @@ NodeFG* AVLTreeFG::leftRotate(NodeFG* x) {
     y->left = x;
     x->right = T2;
     x->height = std::max(height(x->left), height(x->right)) + 1;
+    x->size = size(x->left) + size(x->right) + 1;
     y->height = std::max(height(y->left), height(y->right)) + 1;
+    y->size = size(y->left) + size(y->right) + 1;
     return y;
 }
 
@@ -46,6 +52,13 @@ int AVLTreeFG::height(NodeFG* N) const {
     return N->height;
 }
 
+// Number of nodes in the subtree rooted at N
+int AVLTreeFG::size(NodeFG* N) const {
+    if (N == nullptr)
+        return 0;
+    return N->size;
+}
+
 // Get balance factor of node N
 int AVLTreeFG::getBalance(NodeFG* N) const {
     if (N == nullptr)
@@ -102,8 +115,9 @@ NodeFG* AVLTreeFG::insertHelper(NodeFG* node, int key, bool& err) {
         err = true;
         return node;
     }
-    // 2. Update height of this ancestor node
+    // 2. Update height and size of this ancestor node
     node->height = 1 + std::max(height(node->left), height(node->right));
+    node->size = 1 + size(node->left) + size(node->right);
     // 3. Get the balance factor of this ancestor node to check this node's balance
     int balance = getBalance(node);
     // If this node becomes unbalanced, then there are 4 cases
@@ -174,35 +188,42 @@ NodeFG* AVLTreeFG::deleteHelper(NodeFG* node, int key, bool& err) {
         } else {
             node->right->nodeLock.lock();
             NodeFG* temp = minValueNode(node->right); // successor
-            node->key = temp->key; // both nodes should have lock here
+            int successor = temp->key;
+            node->key = successor; // both nodes should have lock here
             // Note: temp is not necessarily leaf node
             // Temp does not have a left child because it has min key in the
             // right branch of the node, but it might have a right child
+            temp->nodeLock.unlock();
+            // deleteHelper expects its node locked, and walks down to temp
+            // again, so temp's lock is dropped and node->right's retaken
+            node->right->nodeLock.lock();
             node->nodeLock.unlock(); // deletion complete
-            node->right = deleteHelper(node->right, temp->key, err);
+            node->right = deleteHelper(node->right, successor, err);
         }
     }
     if (node == nullptr) {
         err = true;
         return node;
     }
-    // Step 2: update height of the current node
+    // Step 2: update height and size of the current node
     node->height = 1 + std::max(height(node->left), height(node->right));
-    // Step 3: check whether this node became unbalanced
+    node->size = 1 + size(node->left) + size(node->right);
+    // Step 3: check whether this node became unbalanced. The deleted key
+    // says nothing about the shape of the taller side, so the cases go by
+    // the balance of the child instead, as in the coarse-grained tree.
     int balance = getBalance(node);
-    // If this node becomes unbalanced, then there are 4 cases
-    if (balance > 1 && key < node->left->key)
+    if (balance > 1 && getBalance(node->left) >= 0)
         return rightRotate(node);
-    else if (balance < -1 && key > node->right->key)
-        return leftRotate(node);
-    else if (balance > 1 && key > node->left->key) {
+    else if (balance > 1) {
         node->left = leftRotate(node->left);
         return rightRotate(node);
     }
-    else if (balance < -1 && key < node->right->key) {
+    else if (balance < -1 && getBalance(node->right) <= 0)
+        return leftRotate(node);
+    else if (balance < -1) {
         node->right = rightRotate(node->right);
         return leftRotate(node);
-    }    
+    }
     return node;
 }
 
@@ -235,6 +256,49 @@ bool AVLTreeFG::search(int key) {
     return found;
 }   
 
+// Keys of node's subtree below key, or up to key if inclusive: each step
+// right adds the node and everything in its left subtree
+size_t AVLTreeFG::countBelow(NodeFG* node, int key, bool inclusive) const {
+    size_t count = 0;
+    while (node != nullptr) {
+        if (node->key < key || (inclusive && node->key == key)) {
+            count += size(node->left) + 1;
+            node = node->right;
+        }
+        else
+            node = node->left;
+    }
+    return count;
+}
+
+size_t AVLTreeFG::rank(int key) {
+    return countBelow(root, key, false);
+}
+
+bool AVLTreeFG::select(size_t i, int& key) {
+    NodeFG* node = root;
+    while (node != nullptr) {
+        size_t left = size(node->left);
+        if (i < left)
+            node = node->left;
+        else if (i == left) {
+            key = node->key;
+            return true;
+        }
+        else {
+            i -= left + 1;
+            node = node->right;
+        }
+    }
+    return false;
+}
+
+size_t AVLTreeFG::countRange(int lo, int hi) {
+    if (lo > hi)
+        return 0;
+    return countBelow(root, hi, true) - countBelow(root, lo, false);
+}
+
 // A utility function to print preorder traversal of the tree.
 // The function also prints the height of every node.
 void AVLTreeFG::preOrderHelper(NodeFG* node) const {
@@ -250,4 +314,38 @@ void AVLTreeFG::preOrder() {
     std::cout << "preorder\n";
     preOrderHelper(root);
     std::cout << "\n";
-}
\ No newline at end of file
+}
+
+// Build a perfectly balanced subtree over sorted[lo, hi), forking the two
+// halves onto separate threads near the top of the recursion
+NodeFG* AVLTreeFG::buildHelper(const int* sorted, size_t lo, size_t hi, int depth) {
+    if (lo >= hi)
+        return nullptr;
+    size_t mid = lo + (hi - lo) / 2;
+    NodeFG* node = new NodeFG(sorted[mid]);
+    forkJoin(hi - lo > FORK_GRAIN ? depth : 0,
+        [&]() { node->left = buildHelper(sorted, lo, mid, depth - 1); },
+        [&]() { node->right = buildHelper(sorted, mid + 1, hi, depth - 1); });
+    node->height = 1 + std::max(height(node->left), height(node->right));
+    node->size = 1 + size(node->left) + size(node->right);
+    return node;
+}
+
+// Load n strictly increasing keys in O(n). Only valid on an empty tree;
+// returns false without modifying the tree otherwise.
+bool AVLTreeFG::bulkLoad(const int* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted + n, std::greater_equal<int>()) != sorted + n)
+        return false;
+    if (root != nullptr)
+        return false;
+    NodeFG* built = buildHelper(sorted, 0, n, forkDepth());
+    rootLock.lock();
+    if (root != nullptr) {
+        rootLock.unlock();
+        freeTree(built);
+        return false;
+    }
+    root = built;
+    rootLock.unlock();
+    return true;
+}
@@ -1,12 +1,15 @@
 #include <iostream>
 #include <mutex>
+#include "hugepage.h"
 
-class NodeFG {
+class NodeFG : public HugePageNode {
 public:
     int key;
     NodeFG* left;
     NodeFG* right;
     int height;
+    // Number of nodes in the subtree rooted here
+    int size;
     std::mutex nodeLock;
 
     NodeFG(int key);
@@ -22,6 +25,17 @@ public:
     bool deleteNode(int key);
     bool search(int key);
     void preOrder();
+    bool bulkLoad(const int* sorted, size_t n);
+
+    // Order statistics from the subtree sizes, O(log n): the number of keys
+    // below key, the i-th smallest key (from 0; false if there are at most i
+    // keys) and the number of keys in [lo, hi]. Like search they take no
+    // locks, and sizes are fixed on the way back up after the locks of an
+    // update are released, as heights are, so results are exact only while
+    // no update is in flight.
+    size_t rank(int key);
+    bool select(size_t i, int& key);
+    size_t countRange(int lo, int hi);
 
 private:
     std::mutex rootLock;
@@ -30,11 +44,14 @@ private:
     NodeFG* leftRotate(NodeFG* x);
     int getBalance(NodeFG* N) const;
     int height(NodeFG* N) const;
+    int size(NodeFG* N) const;
+    size_t countBelow(NodeFG* node, int key, bool inclusive) const;
     NodeFG* minValueNode(NodeFG* node);
 
     NodeFG* insertHelper(NodeFG* node, int key, bool& err);
     NodeFG* deleteHelper(NodeFG* node, int key, bool& err);
     bool searchHelper(NodeFG* node, int key) const;
     void preOrderHelper(NodeFG* node) const;
+    NodeFG* buildHelper(const int* sorted, size_t lo, size_t hi, int depth);
     void freeTree(NodeFG* node);
 };  
\ No newline at end of file
@@ -2,7 +2,9 @@
 #include <iostream>
 #include <mutex>
 #include <cassert>
+#include <algorithm>
 #include "finegrainedBronson.h"
+#include "parallel.h"
 
 /********************** Version manipulation constants **********************/
 // Grow: Get closer to the root due to rebalancing
@@ -16,11 +18,13 @@ static long Shrinking = 0x4L;
 static long ShrinkCountIncr = 1L << 11;
 static long IgnoreGrow = ~(Growing | GrowCountMask);
 
-// Next action for each node
-enum Cond : int {NothingRequired, UnlinkRequired, RebalanceRequired};
+// Next action for each node. Negative so they never collide with a repaired
+// height, which nodeCondition returns in the same channel
+enum Cond : int {NothingRequired = -3, RebalanceRequired = -2, UnlinkRequired = -1};
 
 //************************* Tree constructor **********************************/
-NodeFG::NodeFG(int k) : version(0), height(1), key(k), value(INT),
+template <typename Key>
+BronsonNode<Key>::BronsonNode(const Key& k, int v) : version(0), height(1), key(k), value(INT), val(v),
                         left(nullptr), right(nullptr), parent(nullptr), 
                         nodeLock() {}
 
@@ -28,14 +32,16 @@ NodeFG::NodeFG(int k) : version(0), height(1), key(k), value(INT),
 * Root holder has no key, whose right child is the root. It allows all mutable 
 * nodes to have a non-null parent.
 */
-// std::numeric_limits<int>::min()
-AVLTreeFG::AVLTreeFG() : rootHolder(new NodeFG(-1)) {}
+template <typename Key>
+BronsonTree<Key>::BronsonTree() : rootHolder(new Node(Key())) {}
 
-AVLTreeFG::~AVLTreeFG() {
+template <typename Key>
+BronsonTree<Key>::~BronsonTree() {
     freeTree(rootHolder);
 }
 
-void AVLTreeFG::freeTree(volatile NodeFG* node) {
+template <typename Key>
+void BronsonTree<Key>::freeTree(volatile Node* node) {
 	if (node == nullptr) return;
 	freeTree(node->left);
 	freeTree(node->right);
@@ -43,21 +49,24 @@ void AVLTreeFG::freeTree(volatile NodeFG* node) {
 }
 
 //***************************** Utility functions *****************************/
-int compare(int a, int b) {
-    if (a == b) return 0;
-    else if (a < b) return -1;
-    else return 1;
+// Keys only need operator<, like the keys of AVLMapCG
+template <typename Key>
+static int compare(const Key& a, const Key& b) {
+    if (a < b) return -1;
+    else if (b < a) return 1;
+    else return 0;
 }
 
 /******************** Helper functions for tree operations ********************/
 /* 
- * Return a child of a node based on given direction 
- * dir = 0: left, dir = 1: right
+ * Return a child of a node based on given direction, as returned by compare
+ * dir = -1: left, dir = 1: right
  */
-NodeFG* AVLTreeFG::getChild(NodeFG* node, int dir) {
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::getChild(Node* node, int dir) {
     assert(node != nullptr);
 
-    if (dir == 0)
+    if (dir == -1)
         return node->left;
     else if (dir == 1)
         return node->right;
@@ -69,7 +78,8 @@ NodeFG* AVLTreeFG::getChild(NodeFG* node, int dir) {
 /* 
  * Get height of tree
  */
-int AVLTreeFG::height(NodeFG* node) const {
+template <typename Key>
+int BronsonTree<Key>::height(Node* node) const {
     if (node == nullptr)
         return 0;
     return node->height;
@@ -78,7 +88,8 @@ int AVLTreeFG::height(NodeFG* node) const {
 /* 
  * Get balance factor of tree
  */
-int AVLTreeFG::getBalance(NodeFG* node) const {
+template <typename Key>
+int BronsonTree<Key>::getBalance(Node* node) const {
     if (node == nullptr)
         return 0;
     return height(node->left) - height(node->right);
@@ -88,15 +99,17 @@ int AVLTreeFG::getBalance(NodeFG* node) const {
  * A node can be unlinked if it has fewer than two children
  * It will be converted to a routing node/marked remove otherwise
  */
-bool AVLTreeFG::canUnlink(NodeFG* node) {
+template <typename Key>
+bool BronsonTree<Key>::canUnlink(Node* node) {
     return node->left == nullptr || node->right == nullptr;
 }
 
 /* 
  * Return the node with minimum key value in the given tree
  */
-NodeFG* AVLTreeFG::minValueNode(NodeFG* node) {
-    NodeFG* current = node;
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::minValueNode(Node* node) {
+    Node* current = node;
     while (current->left != nullptr) {
         current->left->nodeLock.lock();
         current->nodeLock.unlock();
@@ -115,19 +128,22 @@ NodeFG* AVLTreeFG::minValueNode(NodeFG* node) {
 /* 
  * Return label for a node during fixing interval
  */
-int AVLTreeFG::nodeCondition(NodeFG* node) {
-    NodeFG* left = node->left;
-    NodeFG* right = node->right;
+template <typename Key>
+int BronsonTree<Key>::nodeCondition(Node* node) {
+    Node* left = node->left;
+    Node* right = node->right;
 
     // Unlinking a routing node (a node that marked removed but only get unlinked
     // when they have zero or one child)
-    if (canUnlink(node) && (node->value == NodeFG::REM)) {
+    if ((left == nullptr || right == nullptr) && (node->value == Node::REM)) {
         return UnlinkRequired;
     }
 
     int height = node->height;
-    int heightRepaired = 1 + std::max(AVLTreeFG::height(left), AVLTreeFG::height(right));
-    int balance = getBalance(node);
+    int hL0 = BronsonTree::height(left);
+    int hR0 = BronsonTree::height(right);
+    int heightRepaired = 1 + std::max(hL0, hR0);
+    int balance = hL0 - hR0;
 
     // In a strict AVL, balance should never exceed 1 or -1
     // However, in this given setting, balance at a local point can be affected
@@ -142,7 +158,8 @@ int AVLTreeFG::nodeCondition(NodeFG* node) {
 /* 
  * Assign repaired height to a node that requires it
  */
-NodeFG* AVLTreeFG::fixHeightNoLock(NodeFG* node) {
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::fixHeightNoLock(Node* node) {
     int condition = nodeCondition(node);
     switch(condition){
         case RebalanceRequired:
@@ -159,14 +176,17 @@ NodeFG* AVLTreeFG::fixHeightNoLock(NodeFG* node) {
 /*
  * Right rotate subtree rooted at node
  */
-NodeFG* AVLTreeFG::rotateRight(NodeFG* parent, NodeFG* node, NodeFG* nL, int hR, int hLL, NodeFG* nLR, int hLR) {
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::rotateRight(Node* parent, Node* node, Node* nL, int hR, int hLL, Node* nLR, int hLR) {
     // Basic AVL rotation
-    NodeFG* nPL = parent->left;
+    Node* nPL = parent->left;
 
     // Reader cannot read from this point due to status change
     assert(nL != nullptr);
-    node->version |= Shrinking;
-    nL->version |= Growing;
+    long nodeV = node->version;
+    long nLV = nL->version;
+    node->version = nodeV | Shrinking;
+    nL->version = nLV | Growing;
 
     node->left = nLR;
     nL->right = node;
@@ -183,9 +203,9 @@ NodeFG* AVLTreeFG::rotateRight(NodeFG* parent, NodeFG* node, NodeFG* nL, int hR,
     node->height = heightRepaired;
     nL->height = std::max(hLL, heightRepaired) + 1;
 
-    // Version update
-    nL->version += GrowCountIncr;
-    node->version += ShrinkCountIncr;
+    // Version update, which also clears the change bits
+    nL->version = nLV + GrowCountIncr;
+    node->version = nodeV + ShrinkCountIncr;
 
     // Rebalance nodes at higher up levels
     int balanceNodeCheck = hLR - hR;
@@ -208,12 +228,15 @@ NodeFG* AVLTreeFG::rotateRight(NodeFG* parent, NodeFG* node, NodeFG* nL, int hR,
 /*
  * Left rotate subtree rooted at node
  */ 
-NodeFG* AVLTreeFG::rotateLeft(NodeFG* parent, NodeFG* node, NodeFG* nR, int hL, int hRR, NodeFG* nRL, int hRL) {
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::rotateLeft(Node* parent, Node* node, Node* nR, int hL, int hRR, Node* nRL, int hRL) {
     assert(nR != nullptr);
-    node->version |= Shrinking;
-    nR->version |= Growing;
+    long nodeV = node->version;
+    long nRV = nR->version;
+    node->version = nodeV | Shrinking;
+    nR->version = nRV | Growing;
 
-    NodeFG* nPL = parent->left;
+    Node* nPL = parent->left;
     node->right = nRL;
     nR->left = node;
 
@@ -227,8 +250,8 @@ NodeFG* AVLTreeFG::rotateLeft(NodeFG* parent, NodeFG* node, NodeFG* nR, int hL,
     node->height = heightRepaired;
     nR->height = std::max(hRR, heightRepaired) + 1;
 
-    nR->version += GrowCountIncr;
-    node->version += ShrinkCountIncr;
+    nR->version = nRV + GrowCountIncr;
+    node->version = nodeV + ShrinkCountIncr;
 
     int balanceNodeCheck = hRL - hL;
     if (balanceNodeCheck < -1 || 1 < balanceNodeCheck) {
@@ -246,13 +269,19 @@ NodeFG* AVLTreeFG::rotateLeft(NodeFG* parent, NodeFG* node, NodeFG* nR, int hL,
 /*
  * Right-Left rotate subtree rooted at node
  */
-NodeFG* AVLTreeFG::rotateRightOverLeft(NodeFG* parent, NodeFG* node, NodeFG* nL, int hR, int hLL, NodeFG* nLR, int hLRL) {
-    node->version |= Shrinking;
-    nL->version |= Growing;
-
-    NodeFG* nPL = parent->left;
-    NodeFG* nLRL = nLR->left;
-    NodeFG* nLRR = nLR->right;
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::rotateRightOverLeft(Node* parent, Node* node, Node* nL, int hR, int hLL, Node* nLR, int hLRL) {
+    // Both node and nL are pushed down, only nLR moves up
+    long nodeV = node->version;
+    long nLV = nL->version;
+    long nLRV = nLR->version;
+    node->version = nodeV | Shrinking;
+    nL->version = nLV | Shrinking;
+    nLR->version = nLRV | Growing;
+
+    Node* nPL = parent->left;
+    Node* nLRL = nLR->left;
+    Node* nLRR = nLR->right;
     int hLRR = height(nLRR);
 
     node->left = nLRR;
@@ -285,8 +314,9 @@ NodeFG* AVLTreeFG::rotateRightOverLeft(NodeFG* parent, NodeFG* node, NodeFG* nL,
     nL->height = heightLeftRepaired;
     nLR->height = 1 + std::max(heightRepaired, heightLeftRepaired);
 
-    nL->version += GrowCountIncr;
-    node->version += ShrinkCountIncr;
+    nLR->version = nLRV + GrowCountIncr;
+    nL->version = nLV + ShrinkCountIncr;
+    node->version = nodeV + ShrinkCountIncr;
 
     int balN = hLRR - hR;
     if(balN < -1 || balN > 1){
@@ -304,14 +334,19 @@ NodeFG* AVLTreeFG::rotateRightOverLeft(NodeFG* parent, NodeFG* node, NodeFG* nL,
 /*
  * Left-Right rotate subtree rooted at node
  */
-NodeFG* AVLTreeFG::rotateLeftOverRight(NodeFG* parent, NodeFG* node, NodeFG* nR, int hL, int hRR, NodeFG* nRL, int hRLR) {
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::rotateLeftOverRight(Node* parent, Node* node, Node* nR, int hL, int hRR, Node* nRL, int hRLR) {
     assert(nR != nullptr);
-    node->version |= Shrinking;
-    nR->version |= Growing;
-
-    NodeFG* nPL = parent->left;
-    NodeFG* nRLL = nRL->left;
-    NodeFG* nRLR = nRL->right;
+    long nodeV = node->version;
+    long nRV = nR->version;
+    long nRLV = nRL->version;
+    node->version = nodeV | Shrinking;
+    nR->version = nRV | Shrinking;
+    nRL->version = nRLV | Growing;
+
+    Node* nPL = parent->left;
+    Node* nRLL = nRL->left;
+    Node* nRLR = nRL->right;
     int hRLL = height(nRLL);
 
     node->right = nRLL;
@@ -343,8 +378,9 @@ NodeFG* AVLTreeFG::rotateLeftOverRight(NodeFG* parent, NodeFG* node, NodeFG* nR,
     nR->height = heightRightRepaired;
     nRL->height = std::max(heightRightRepaired, heightRepaired) + 1;
 
-    nR->version += GrowCountIncr;
-    node->version += ShrinkCountIncr;
+    nRL->version = nRLV + GrowCountIncr;
+    nR->version = nRV + ShrinkCountIncr;
+    node->version = nodeV + ShrinkCountIncr;
 
     int balN = hRLL - hL;
     if (balN < -1 || balN > 1) {
@@ -359,86 +395,92 @@ NodeFG* AVLTreeFG::rotateLeftOverRight(NodeFG* parent, NodeFG* node, NodeFG* nR,
 }
 
 /*
- * Decide rotation cases
+ * Decide rotation cases. Caller holds the locks on parent and node; the lock
+ * on nL (and nLR for a double rotation) is held for the rotation itself
  */
-NodeFG* AVLTreeFG::rebalanceToRight(NodeFG* parent, NodeFG* node, NodeFG* nL, int hR0) {
-    nL->nodeLock.lock();
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::rebalanceToRight(Node* parent, Node* node, Node* nL, int hR0) {
+    std::lock_guard<std::mutex> nLGuard(nL->nodeLock);
     int hL = nL->height;
     if (hL - hR0 <= 1) {
         return node;
     }
     else {
-        NodeFG* nLR = nL->right;
+        Node* nLR = nL->right;
         int hLL0 = height(nL->left);
         int hLR0 = height(nLR);
         if (hLL0 >= hLR0) {
             return rotateRight(parent, node, nL, hR0, hLL0, nLR, hLR0);
         }
         else {
-            nLR->nodeLock.lock();
-            int hLR = nLR->height;
-            if (hLL0 >= hLR) {
-                return rotateRight(parent, node, nL, hR0, hLL0, nLR, hLR);
-            }
-            else {
-                int hLRL = height(nLR->left);
-                int b = hLL0 - hLRL;
-                if (-1 <= b && b <= 1 && !((hLL0 == 0 || hLRL == 0) && nL->version == 0)) {
-                    return rotateRightOverLeft(parent, node, nL, hR0, hLL0, nLR, hLRL);
-                } 
+            {
+                std::lock_guard<std::mutex> nLRGuard(nLR->nodeLock);
+                int hLR = nLR->height;
+                if (hLL0 >= hLR) {
+                    return rotateRight(parent, node, nL, hR0, hLL0, nLR, hLR);
+                }
+                else {
+                    int hLRL = height(nLR->left);
+                    int b = hLL0 - hLRL;
+                    // Skip the double rotation if it would leave nL as a
+                    // routing node with a missing child
+                    if (-1 <= b && b <= 1 && !((hLL0 == 0 || hLRL == 0) && nL->value == Node::REM)) {
+                        return rotateRightOverLeft(parent, node, nL, hR0, hLL0, nLR, hLRL);
+                    }
+                }
             }
-            nLR->nodeLock.unlock();
+            return rebalanceToLeft(node, nL, nLR, hLL0);
         }
-        return rebalanceToLeft(node, nL, nLR, hLL0);
     }
-    nL->nodeLock.unlock();
 }
 
 /*
- * Decide rotation cases
+ * Decide rotation cases, mirror of rebalanceToRight
  */
-NodeFG* AVLTreeFG::rebalanceToLeft(NodeFG* parent, NodeFG* node, NodeFG* nR, int hL0) {
-    nR->nodeLock.lock();
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::rebalanceToLeft(Node* parent, Node* node, Node* nR, int hL0) {
+    std::lock_guard<std::mutex> nRGuard(nR->nodeLock);
     int hR = nR->height;
     if (hL0 - hR >= -1) {
         return node;
     }
     else {
-        NodeFG* nRL = nR->left;
+        Node* nRL = nR->left;
         int hRL0 = height(nRL);
         int hRR0 = height(nR->right);
         if (hRR0 >= hRL0) {
             return rotateLeft(parent, node, nR, hL0, hRR0, nRL, hRL0);
         }
         else {
-            nRL->nodeLock.lock();
-            int hRL = height(nRL);
-            if (hRR0 >= hRL) {
-                return rotateLeft(parent, node, nR, hL0, hRR0, nRL, hRL);
-            }
-            else {
-                int hRLR = height(nRL->right);
-                int b = hRR0 - hRLR;
-                if (-1 <= b && 1 <= b && !((hRR0 == 0 || hRLR == 0) && nR->version == 0)) {
-                    return rotateLeftOverRight(parent, node, nR, hL0, hRR0, nRL, hRLR);
+            {
+                std::lock_guard<std::mutex> nRLGuard(nRL->nodeLock);
+                int hRL = nRL->height;
+                if (hRR0 >= hRL) {
+                    return rotateLeft(parent, node, nR, hL0, hRR0, nRL, hRL);
+                }
+                else {
+                    int hRLR = height(nRL->right);
+                    int b = hRR0 - hRLR;
+                    if (-1 <= b && b <= 1 && !((hRR0 == 0 || hRLR == 0) && nR->value == Node::REM)) {
+                        return rotateLeftOverRight(parent, node, nR, hL0, hRR0, nRL, hRLR);
+                    }
                 }
             }
-            nRL->nodeLock.unlock();
             return rebalanceToRight(node, nR, nRL, hRR0);
         }
     }
-    nR->nodeLock.lock();
 }
 
 /* 
  * Fix structural imbalance issues to maintain strict AVL height invariant
  */
-NodeFG* AVLTreeFG::rebalanceNoLock(NodeFG* parent, NodeFG* node) {
-    NodeFG* nL = node->left;
-    NodeFG* nR = node->right;
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::rebalanceNoLock(Node* parent, Node* node) {
+    Node* nL = node->left;
+    Node* nR = node->right;
 
     // Unlink (delete structurally) a routing node (deleted logically, with "removed" label)
-    if(canUnlink(node) && (node->value == NodeFG::REM)){
+    if(canUnlink(node) && (node->value == Node::REM)){
         assert(node->parent == parent);
         if(attemptUnlinkNoLock(parent, node)){
             return fixHeightNoLock(parent);
@@ -449,10 +491,10 @@ NodeFG* AVLTreeFG::rebalanceNoLock(NodeFG* parent, NodeFG* node) {
     }
     
     int height = node->height;
-    int hL0 = AVLTreeFG::height(nL);
-    int hR0 = AVLTreeFG::height(nR);
+    int hL0 = BronsonTree::height(nL);
+    int hR0 = BronsonTree::height(nR);
     int heightRepaired = 1 + std::max(hL0, hR0);
-    int balance = getBalance(node);
+    int balance = hL0 - hR0;
 
     if(1 < balance){
         return rebalanceToRight(parent, node, nL, hR0);
@@ -476,7 +518,8 @@ NodeFG* AVLTreeFG::rebalanceNoLock(NodeFG* parent, NodeFG* node) {
  * The fix begins at error node, propagates up to the root, and stops when no
  * action required
  */
-void AVLTreeFG::fixHeightAndRebalance(NodeFG* node) {
+template <typename Key>
+void BronsonTree<Key>::fixHeightAndRebalance(Node* node) {
     // Performance would be impacted if these reads of height require locks
     // If one thread fails to repair correctly, there must be a case when
     // the fild is accesse by only one thread thus being atomic
@@ -489,23 +532,20 @@ void AVLTreeFG::fixHeightAndRebalance(NodeFG* node) {
         }
         // Fix height
         if ((condition != UnlinkRequired) && (condition != RebalanceRequired)) {
-            node->nodeLock.lock();
+            std::lock_guard<std::mutex> nodeGuard(node->nodeLock);
             // Propagate up to parent once finished
             node = fixHeightNoLock(node);
-            node->nodeLock.unlock();
         }
         else {
             // Rotation needed
-            NodeFG* parent = node->parent;
-            parent->nodeLock.lock();
+            Node* parent = node->parent;
+            std::lock_guard<std::mutex> parentGuard(parent->nodeLock);
             if ((parent->version != Unlinked) && (node->parent == parent)) {
-                node->nodeLock.lock();
+                std::lock_guard<std::mutex> nodeGuard(node->nodeLock);
                 // Propagate up to parent once finished
                 node = rebalanceNoLock(parent, node);
-                node->nodeLock.unlock();
             }
-            parent->nodeLock.unlock();
-            // Retry here
+            // Retry here otherwise
         }
     }
 }
@@ -515,7 +555,8 @@ void AVLTreeFG::fixHeightAndRebalance(NodeFG* node) {
  * Make a certain thread block until the change bit is not set
  */
 static int spinCount = 100;
-void AVLTreeFG::waitUntilNotChanging(NodeFG* node) {
+template <typename Key>
+void BronsonTree<Key>::waitUntilNotChanging(Node* node) {
     long v = node->version;
     if ((v & (Growing | Shrinking)) != 0) {
         int i = 0;
@@ -536,34 +577,58 @@ void AVLTreeFG::waitUntilNotChanging(NodeFG* node) {
 /* Main operations: get, insert, delete */
 /*
  * Public search function that wraps the helper
+ */
+template <typename Key>
+bool BronsonTree<Key>::search(const Key& key) {
+    return lookup(key, nullptr);
+}
+
+template <typename Key>
+std::optional<int> BronsonTree<Key>::get(const Key& key) {
+    int val;
+    if (lookup(key, &val))
+        return val;
+    return std::nullopt;
+}
+
+/*
  * Start searching from the root of the tree and traverse down until either the
- * key is found or we reach null
+ * key is found or we reach null. The value of a key found present is stored in
+ * val unless it is null; it is read after the presence marker, which writers
+ * set after the value, so it is never older than the key's presence
  */
-bool AVLTreeFG::search(int key) {
+template <typename Key>
+bool BronsonTree<Key>::lookup(const Key& key, int* val) {
     while (true) {
         // Note: actual root is the right child of rootHolder by definition
-        NodeFG* root = getChild(rootHolder, 1);
+        Node* root = getChild(rootHolder, 1);
         // Not found
         if (root == nullptr) {
             return false;
         }
         else {
             int dirNext = compare(key, root->key);
-            // Found 
+            // Found, how we got here is irrelevant
             if (dirNext == 0) {
+                if (root->value == Node::REM) {
+                    return false;
+                }
+                if (val != nullptr) {
+                    *val = root->val;
+                }
                 return true;
             }
             long rootV = root->version;
-            if ((rootV & Shrinking) != 0 || (rootV != Unlinked)) {
+            if ((rootV & (Shrinking | Unlinked)) != 0) {
                 waitUntilNotChanging(root);
             }
             // Check linking is still valid
             else if (root == rootHolder->right) {
-                AVLTreeFG::Status s = attemptSearch(key, root, dirNext, rootV);
-                if (s == AVLTreeFG::SUCCESS) {
+                BronsonTree::Status s = attemptSearch(key, root, dirNext, rootV, val);
+                if (s == BronsonTree::SUCCESS) {
                     return true;
                 }
-                else if (s == AVLTreeFG::FAILURE) {
+                else if (s == BronsonTree::FAILURE) {
                     return false;
                 }
                 // Retry here otherwise
@@ -578,28 +643,32 @@ bool AVLTreeFG::search(int key) {
  * Attempt a search of a key with hand-over-hand optimistic concurrency control
  * Return either a rollback signal, or found/not found boolean
  */
-AVLTreeFG::Status AVLTreeFG::attemptSearch(int key, NodeFG* node, int dir, long nodeV) {
+template <typename Key>
+typename BronsonTree<Key>::Status BronsonTree<Key>::attemptSearch(const Key& key, Node* node, int dir, long nodeV, int* val) {
     while(true) {
-        NodeFG* child = getChild(node, dir);
+        Node* child = getChild(node, dir);
 
         // Check valid read of parent node
         // Growing the subtree with this node does not affect the correctness
         // of the current search
         if (((node->version ^ nodeV) & IgnoreGrow) != 0)
-            return AVLTreeFG::RETRY;
+            return BronsonTree::RETRY;
 
         // Target is not in the tree
         if (child == nullptr)
-            return AVLTreeFG::FAILURE;
+            return BronsonTree::FAILURE;
 
         // Target is found
         int dirNext = compare(key, child->key);
         if (dirNext == 0) {
-            if (child->value == NodeFG::REM) {
+            if (child->value == Node::REM) {
                 // printf("Found a removed node \n");
-                return AVLTreeFG::FAILURE;
+                return BronsonTree::FAILURE;
+            }
+            if (val != nullptr) {
+                *val = child->val;
             }
-            return AVLTreeFG::SUCCESS;
+            return BronsonTree::SUCCESS;
         }
 
         // At time t1: Issue a read
@@ -617,82 +686,210 @@ AVLTreeFG::Status AVLTreeFG::attemptSearch(int key, NodeFG* node, int dir, long
             // At time t2: Validation
             // If version stays the same, read is valid
             if (((node->version ^ nodeV) & IgnoreGrow) != 0) {
-                return AVLTreeFG::RETRY;
+                return BronsonTree::RETRY;
             }
             // Commit
-            AVLTreeFG::Status p = attemptSearch(key, child, dirNext, childV);
+            BronsonTree::Status p = attemptSearch(key, child, dirNext, childV, val);
 
             // Read is successful
-            if (p != AVLTreeFG::RETRY)
+            if (p != BronsonTree::RETRY)
                 return p; 
         }
     }
 }
 
+/*
+ * Look up keys[0, n) into out[0, n). SEARCH_GROUP lookups advance one level
+ * at a time in lockstep, prefetching the next child of each so that their
+ * cache misses overlap. Every step performs the same version validation as
+ * attemptSearch; a lane whose validation fails is finished by a regular
+ * search instead of being retried in lockstep.
+ * Lanes start at rootHolder, which is never rotated, so the root needs no
+ * special case.
+ */
+template <typename Key>
+void BronsonTree<Key>::searchBatch(const Key* keys, size_t n, bool* out) {
+    Node* cur[SEARCH_GROUP];
+    long curV[SEARCH_GROUP];
+    int dir[SEARCH_GROUP];
+    size_t idx[SEARCH_GROUP];
+    size_t next = 0;
+    int live = 0;
+    for (int lane = 0; lane < SEARCH_GROUP; lane++) {
+        idx[lane] = next < n ? next++ : n;
+        cur[lane] = rootHolder;
+        curV[lane] = rootHolder->version;
+        dir[lane] = 1;
+        if (idx[lane] != n)
+            live++;
+    }
+    while (live > 0) {
+        for (int lane = 0; lane < SEARCH_GROUP; lane++) {
+            if (idx[lane] == n)
+                continue;
+            const Key& key = keys[idx[lane]];
+            Node* node = cur[lane];
+            Node* child = getChild(node, dir[lane]);
+            bool valid = ((node->version ^ curV[lane]) & IgnoreGrow) == 0;
+            if (valid && child != nullptr) {
+                int dirNext = compare(key, child->key);
+                if (dirNext != 0) {
+                    long childV = child->version;
+                    // Same hand-over-hand validation as attemptSearch
+                    if ((childV & (Shrinking | Unlinked)) == 0 && child == getChild(node, dir[lane])
+                        && ((node->version ^ curV[lane]) & IgnoreGrow) == 0) {
+                        __builtin_prefetch(getChild(child, dirNext));
+                        cur[lane] = child;
+                        curV[lane] = childV;
+                        dir[lane] = dirNext;
+                        continue;
+                    }
+                    valid = false;
+                }
+            }
+            // Lane done, record the result and start the next key
+            if (!valid)
+                out[idx[lane]] = search(key);
+            else
+                out[idx[lane]] = child != nullptr && child->value == Node::INT;
+            if (next < n) {
+                idx[lane] = next++;
+                cur[lane] = rootHolder;
+                curV[lane] = rootHolder->version;
+                dir[lane] = 1;
+            }
+            else {
+                idx[lane] = n;
+                live--;
+            }
+        }
+    }
+}
+
 /* 
  * Public insert function that wraps the helper
  */
-bool AVLTreeFG::insert(int key) {
+template <typename Key>
+bool BronsonTree<Key>::insert(const Key& key) {
+    return applyUpdate(key, [](const int* current, int& next) {
+        next = 0;
+        return current == nullptr;
+    });
+}
+
+template <typename Key>
+std::optional<int> BronsonTree<Key>::putIfAbsent(const Key& key, int val) {
+    std::optional<int> old;
+    applyUpdate(key, [&](const int* current, int& next) {
+        if (current != nullptr) {
+            old = *current;
+            return false;
+        }
+        next = val;
+        return true;
+    });
+    return old;
+}
+
+template <typename Key>
+bool BronsonTree<Key>::replace(const Key& key, int expected, int desired) {
+    return applyUpdate(key, [&](const int* current, int& next) {
+        next = desired;
+        return current != nullptr && *current == expected;
+    });
+}
+
+template <typename Key>
+int BronsonTree<Key>::compute(const Key& key, const std::function<int(std::optional<int>)>& fn) {
+    int result;
+    applyUpdate(key, [&](const int* current, int& next) {
+        next = fn(current != nullptr ? std::optional<int>(*current) : std::nullopt);
+        result = next;
+        return true;
+    });
+    return result;
+}
+
+/*
+ * Insert or update a key through the insert path. update is called once,
+ * with the lock held that makes its decision final: the key's node lock if
+ * the key has a node, present or routing, and the lock of the new node's
+ * parent otherwise. Returns whether update wrote
+ */
+template <typename Key>
+bool BronsonTree<Key>::applyUpdate(const Key& key, const Update& update) {
     while (true) {
-        NodeFG* root = getChild(rootHolder, 1);
+        Node* root = getChild(rootHolder, 1);
         // Insert into null root
         if (root == nullptr) {
-            rootHolder->nodeLock.lock();
-            rootHolder->right = new NodeFG(key);
+            std::lock_guard<std::mutex> holderGuard(rootHolder->nodeLock);
+            // Lost a race with another insert into the empty tree
+            if (rootHolder->right != nullptr) {
+                continue;
+            }
+            int next;
+            if (!update(nullptr, next)) {
+                return false;
+            }
+            Node* node = new Node(key, next);
+            node->parent = rootHolder;
+            rootHolder->right = node;
             rootHolder->height = 2;
-            rootHolder->nodeLock.unlock();
             return true;
         }
         else {
             int dirNext = compare(key, root->key);
-            // Ignore case of updating existing key 
+            // Key exists, possibly as a routing node that can be revived
             if (dirNext == 0) {
-                return false;
+                BronsonTree::Status s = attemptUpdateNode(root, update);
+                if (s == BronsonTree::RETRY) {
+                    continue;
+                }
+                return s == BronsonTree::SUCCESS;
             }
             long rootV = root->version;
-            if ((rootV & Shrinking) != 0 || (rootV != Unlinked)) {
+            if ((rootV & (Shrinking | Unlinked)) != 0) {
                 waitUntilNotChanging(root);
             }
             // Check linking is still valid
             else if (root == rootHolder->right) {
-                AVLTreeFG::Status s = attemptInsert(key, root, dirNext, rootV);
-                if (s == AVLTreeFG::SUCCESS) {
+                BronsonTree::Status s = attemptInsert(key, root, dirNext, rootV, update);
+                if (s == BronsonTree::SUCCESS) {
                     return true;
                 }
-                else if (s == AVLTreeFG::FAILURE) {
+                else if (s == BronsonTree::FAILURE) {
                     return false;
                 }
                 // Retry here otherwise
             } 
         }
     }
-    throw "Invalid behavior in insert! \n";
+    throw "Invalid behavior in update! \n";
     return false;
 }
 
 /*
- * Attempt an insert of a key with optimistic concurrency control
- * Only account for insertion of new key, not update of existing key
- * Return either a rollback signal, or found/not found boolean
+ * Attempt an insert or update of a key with optimistic concurrency control
+ * Return either a rollback signal, or whether update wrote
  */
- AVLTreeFG::Status AVLTreeFG::attemptInsert(int key, NodeFG* node, int dir, long nodeV) {
-    AVLTreeFG::Status p = AVLTreeFG::RETRY;
-    while (p == AVLTreeFG::RETRY) {
-        NodeFG* child = getChild(node, dir);
+template <typename Key>
+typename BronsonTree<Key>::Status BronsonTree<Key>::attemptInsert(const Key& key, Node* node, int dir, long nodeV, const Update& update) {
+    BronsonTree::Status p = BronsonTree::RETRY;
+    while (p == BronsonTree::RETRY) {
+        Node* child = getChild(node, dir);
         // Validation of parent link
         if (((node->version ^ nodeV) & IgnoreGrow) != 0) {
-            return AVLTreeFG::RETRY;
+            return BronsonTree::RETRY;
         }
         // Location of parent of the leaf node where new value will be inserted
         if (child == nullptr) {
-            p = attemptInsertHelper(key, node, dir, nodeV);
+            p = attemptInsertHelper(key, node, dir, nodeV, update);
         }
         else {
             int dirNext = compare(key, child->key);
             // Node with key exists in tree
             if (dirNext == 0) {
-                // Ignore this update case
-                return AVLTreeFG::FAILURE;
+                p = attemptUpdateNode(child, update);
             }
             else {
                 long childV = child->version;
@@ -704,9 +901,9 @@ bool AVLTreeFG::insert(int key) {
                 // Child is still in the tree
                 else if (childV != Unlinked && child == getChild(node, dir)) {
                     if (((node->version ^ nodeV) & IgnoreGrow) != 0) {
-                        return AVLTreeFG::RETRY;
+                        return BronsonTree::RETRY;
                     }
-                    p = attemptInsert(key, child, dirNext, childV);
+                    p = attemptInsert(key, child, dirNext, childV, update);
                 }
             }
         }
@@ -719,7 +916,8 @@ bool AVLTreeFG::insert(int key) {
  * of the new leaf, and we must also guarantee that no other inserting thread may 
  * decide ot perform an insertion of the same key into a different parent.\
  */
-AVLTreeFG::Status AVLTreeFG::attemptInsertHelper(int key, NodeFG* node, int dir, long nodeV) {
+template <typename Key>
+typename BronsonTree<Key>::Status BronsonTree<Key>::attemptInsertHelper(const Key& key, Node* node, int dir, long nodeV, const Update& update) {
     // Synchronized atomic region
     node->nodeLock.lock();
 
@@ -727,53 +925,87 @@ AVLTreeFG::Status AVLTreeFG::attemptInsertHelper(int key, NodeFG* node, int dir,
     // 2. Any rotation that could change the parent into which k should 
     //    be inserted will invalidate the implicit range of the traversal arrived 
     //    at the parent
-    if (((node->version ^ nodeV) & IgnoreGrow) != 0 || getChild(node, dir) != nullptr)
-        return AVLTreeFG::RETRY;
+    if (((node->version ^ nodeV) & IgnoreGrow) != 0 || getChild(node, dir) != nullptr) {
+        node->nodeLock.unlock();
+        return BronsonTree::RETRY;
+    }
+
+    // The key is absent for as long as the lock is held
+    int next;
+    if (!update(nullptr, next)) {
+        node->nodeLock.unlock();
+        return BronsonTree::FAILURE;
+    }
 
     // Create new node at child pointer
-    NodeFG* child = getChild(node, dir);
-    child = new NodeFG(key);
+    Node* child = new Node(key, next);
     child->parent = node;
+    if (dir == -1)
+        node->left = child;
+    else
+        node->right = child;
 
     node->nodeLock.unlock();
 
     fixHeightAndRebalance(node);
-    return AVLTreeFG::SUCCESS;
+    return BronsonTree::SUCCESS;
+}
+
+/*
+ * Update of a key that already has a node: overwrite the value of a present
+ * key, or revive a routing node in place with the new value. Fails if update
+ * declines to write
+ */
+template <typename Key>
+typename BronsonTree<Key>::Status BronsonTree<Key>::attemptUpdateNode(Node* node, const Update& update) {
+    std::lock_guard<std::mutex> nodeGuard(node->nodeLock);
+    // Regular version changes don't matter, but an unlinked node is gone
+    if (node->version == Unlinked) {
+        return BronsonTree::RETRY;
+    }
+    int current = node->val;
+    int next;
+    if (!update(node->value == Node::INT ? &current : nullptr, next)) {
+        return BronsonTree::FAILURE;
+    }
+    // Value before marker, as lock-free readers read them the other way round
+    node->val = next;
+    node->value = Node::INT;
+    return BronsonTree::SUCCESS;
 }
 
 /*
  * Public delete function that wraps the helper
  */ 
-bool AVLTreeFG::deleteNode(int key) {
+template <typename Key>
+bool BronsonTree<Key>::deleteNode(const Key& key) {
  while (true) {
-        NodeFG* root = getChild(rootHolder, 1);
-        // Insert into null root
+        Node* root = getChild(rootHolder, 1);
+        // Delete from empty tree
         if (root == nullptr) {
-            printf("Delete from empty tree! \n");
             return false;
         }
         else {
             int dirNext = compare(key, root->key);
             // Found node to be deleted
             if (dirNext == 0) {
-                if(attemptRemoveNode(rootHolder, root) == AVLTreeFG::SUCCESS) {
-                    return true;
-                }
-                else {
-                    return false;
+                BronsonTree::Status s = attemptRemoveNode(rootHolder, root);
+                if (s == BronsonTree::RETRY) {
+                    continue;
                 }
+                return s == BronsonTree::SUCCESS;
             }
             long rootV = root->version;
-            if ((rootV & Shrinking) != 0 || (rootV != Unlinked)) {
+            if ((rootV & (Shrinking | Unlinked)) != 0) {
                 waitUntilNotChanging(root);
             }
             // Check linking is still valid
             else if (root == rootHolder->right) {
-                AVLTreeFG::Status s = attemptDeleteNode(key, root, dirNext, rootV);
-                if (s == AVLTreeFG::SUCCESS) {
+                BronsonTree::Status s = attemptDeleteNode(key, root, dirNext, rootV);
+                if (s == BronsonTree::SUCCESS) {
                     return true;
                 }
-                else if (s == AVLTreeFG::FAILURE) {
+                else if (s == BronsonTree::FAILURE) {
                     return false;
                 }
                 // Retry here otherwise
@@ -789,17 +1021,18 @@ bool AVLTreeFG::deleteNode(int key) {
  * Given partially external tree design, node to be deleted will be a leaf node,
  * which allows for a fixed number of atomic operations
  */
-AVLTreeFG::Status AVLTreeFG::attemptDeleteNode(int key, NodeFG* node, int dir, long nodeV) {
-    AVLTreeFG::Status p = AVLTreeFG::RETRY;
-    while (p == AVLTreeFG::RETRY) {
-        NodeFG* child = getChild(node, dir);
+template <typename Key>
+typename BronsonTree<Key>::Status BronsonTree<Key>::attemptDeleteNode(const Key& key, Node* node, int dir, long nodeV) {
+    BronsonTree::Status p = BronsonTree::RETRY;
+    while (p == BronsonTree::RETRY) {
+        Node* child = getChild(node, dir);
         // Validation of parent link
         if (((node->version ^ nodeV) & IgnoreGrow) != 0) {
-            return AVLTreeFG::RETRY;
+            return BronsonTree::RETRY;
         }
         // Key is not found
         if (child == nullptr) {
-            return AVLTreeFG::FAILURE;
+            return BronsonTree::FAILURE;
         } 
         else {
             int dirNext = compare(key, child->key);
@@ -817,24 +1050,29 @@ AVLTreeFG::Status AVLTreeFG::attemptDeleteNode(int key, NodeFG* node, int dir, l
                 // Child is still in the tree
                 else if (childV != Unlinked && child == getChild(node, dir)) {
                     if (((node->version ^ nodeV) & IgnoreGrow) != 0) {
-                        return AVLTreeFG::RETRY;
+                        return BronsonTree::RETRY;
                     }
                     p = attemptDeleteNode(key, child, dirNext, childV);
                 }
             }
         }
     }
-    return AVLTreeFG::FAILURE;
+    return p;
 }
 
 /*
  * Attempt to unlink a node (delete structurally) from its parent
  */
-bool AVLTreeFG::attemptUnlinkNoLock(NodeFG* parent, NodeFG* node){
+template <typename Key>
+bool BronsonTree<Key>::attemptUnlinkNoLock(Node* parent, Node* node){
     if((parent->left != node && parent->right != node) || (node->parent != parent)){
         return false;
     }
-    NodeFG* child = node->left ? node->left : node->right;
+    // A child was linked in since the caller checked, splicing is no longer possible
+    if (!canUnlink(node)) {
+        return false;
+    }
+    Node* child = node->left ? node->left : node->right;
     // Zero child
     if (parent->left == node) {
         parent->left = child;
@@ -847,7 +1085,7 @@ bool AVLTreeFG::attemptUnlinkNoLock(NodeFG* parent, NodeFG* node){
         child->parent = parent;
     }
     node->version = Unlinked; // Delete node
-    node->value = NodeFG::REM;
+    node->value = Node::REM;
     return true;
 }
 
@@ -856,64 +1094,63 @@ bool AVLTreeFG::attemptUnlinkNoLock(NodeFG* parent, NodeFG* node){
  * (1) unlink/remove node if parent has zero or one child
  * (2) made into routing node if parent has two children 
  */
-AVLTreeFG::Status AVLTreeFG::attemptRemoveNode(NodeFG* parent, NodeFG* node) {
-    // Check that node is not a routing/removed node
-    if (node->value == NodeFG::REM) {
-        printf("Trying to delete removed node \n");
-        return AVLTreeFG::FAILURE;
+template <typename Key>
+typename BronsonTree<Key>::Status BronsonTree<Key>::attemptRemoveNode(Node* parent, Node* node) {
+    // Node is already a routing/removed node, key is not present
+    if (node->value == Node::REM) {
+        return BronsonTree::FAILURE;
     }
     
-    NodeFG::NodeType prev;
     // Check if the route should be unlinked or converted into routing node 
     if (!canUnlink(node)) {
-        node->nodeLock.lock();
+        std::lock_guard<std::mutex> nodeGuard(node->nodeLock);
         // Unlinking now becomes possible despite the initial state
         // Need to retry because the locks are not enough to perform unlinking
         // (acquiring lock of parent as well is needed)
         if ((node->version == Unlinked) || canUnlink(node)) {
-            node->nodeLock.unlock();
-            return AVLTreeFG::RETRY;
+            return BronsonTree::RETRY;
+        }
+        // Lost a race with another delete of the same key
+        if (node->value == Node::REM) {
+            return BronsonTree::FAILURE;
         }
         // Make routing/marked removed node
-        prev = node->value;
-        assert(prev == NodeFG::INT);
-        node->value = NodeFG::REM;
-        node->nodeLock.unlock();    
+        node->value = Node::REM;
+        return BronsonTree::SUCCESS;
     }
-    else {
+
+    Node* damaged;
+    {
         // Unlinking is possible here
-        parent->nodeLock.lock();
+        std::lock_guard<std::mutex> parentGuard(parent->nodeLock);
         // Validation again
-        if ((parent->version == Unlinked) || node->parent != parent || node->version == Unlinked) {
-            parent->nodeLock.unlock();
-            return AVLTreeFG::RETRY;
+        if ((parent->version == Unlinked) || node->parent != parent) {
+            return BronsonTree::RETRY;
         }
-
-        // Locks acquired for both parent and child for the unlinking to happen
-        node->nodeLock.lock();
-        
-        // Make routing/mark removed node
-        prev = node->value;
-        assert(prev == NodeFG::INT);
-        node->value = NodeFG::REM;
-
-        // Verify that unlinking is still possible --> Commit deletion
-        if (canUnlink(node)) {
-            attemptUnlinkNoLock(parent, node);
+        {
+            // Locks acquired for both parent and child for the unlinking to happen
+            std::lock_guard<std::mutex> nodeGuard(node->nodeLock);
+            if (node->value == Node::REM) {
+                return BronsonTree::FAILURE;
+            }
+            // Commit deletion, or retry if a child was linked in meanwhile
+            if (!attemptUnlinkNoLock(parent, node)) {
+                return BronsonTree::RETRY;
+            }
         }
-        // No need to have a rollback here
-        node->nodeLock.unlock();
-        parent->nodeLock.unlock();
+        // Fix the parent while its lock is still held
+        damaged = fixHeightNoLock(parent);
     }
-    fixHeightAndRebalance(parent);
-    return AVLTreeFG::SUCCESS;
+    fixHeightAndRebalance(damaged);
+    return BronsonTree::SUCCESS;
 }
 
 /*
  * A utility function to print preorder traversal of the tree.
  * The function also prints the height of every node.
  */
-void AVLTreeFG::preOrderHelper(NodeFG* node) const {
+template <typename Key>
+void BronsonTree<Key>::preOrderHelper(Node* node) const {
     if (node != nullptr) {
         std::cout << node->key << " ";
         preOrderHelper(node->left);
@@ -924,8 +1161,59 @@ void AVLTreeFG::preOrderHelper(NodeFG* node) const {
 /*
  * Preorder wrapper function
  */
-void AVLTreeFG::preOrder() {
+template <typename Key>
+void BronsonTree<Key>::preOrder() {
     std::cout << "preorder\n";
     preOrderHelper(rootHolder);
     std::cout << "\n";
-}
\ No newline at end of file
+}
+
+/*
+ * Build a perfectly balanced subtree over sorted[lo, hi) hanging off parent,
+ * forking the two halves onto separate threads near the top of the recursion.
+ * Fresh nodes start at version 0, as if they had been inserted one by one.
+ */
+template <typename Key>
+typename BronsonTree<Key>::Node* BronsonTree<Key>::buildHelper(const Key* sorted, size_t lo, size_t hi, Node* parent, int depth) {
+    if (lo >= hi)
+        return nullptr;
+    size_t mid = lo + (hi - lo) / 2;
+    Node* node = new Node(sorted[mid]);
+    node->parent = parent;
+    forkJoin(hi - lo > FORK_GRAIN ? depth : 0,
+        [&]() { node->left = buildHelper(sorted, lo, mid, node, depth - 1); },
+        [&]() { node->right = buildHelper(sorted, mid + 1, hi, node, depth - 1); });
+    node->height = 1 + std::max(height(node->left), height(node->right));
+    return node;
+}
+
+/*
+ * Load n strictly increasing keys in O(n). Only valid on an empty tree;
+ * returns false without modifying the tree otherwise.
+ */
+template <typename Key>
+bool BronsonTree<Key>::bulkLoad(const Key* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted + n, [](const Key& a, const Key& b) { return !(a < b); }) != sorted + n)
+        return false;
+    if (rootHolder->right != nullptr)
+        return false;
+    Node* root = buildHelper(sorted, 0, n, rootHolder, forkDepth());
+    rootHolder->nodeLock.lock();
+    if (rootHolder->right != nullptr) {
+        rootHolder->nodeLock.unlock();
+        freeTree(root);
+        return false;
+    }
+    rootHolder->right = root;
+    rootHolder->height = 1 + height(root);
+    rootHolder->nodeLock.unlock();
+    return true;
+}
+
+// Every key type the tree is used with
+template class BronsonNode<int>;
+template class BronsonTree<int>;
+template class BronsonNode<std::string>;
+template class BronsonTree<std::string>;
+template class BronsonNode<StringKey>;
+template class BronsonTree<StringKey>;
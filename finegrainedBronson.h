@@ -1,66 +1,100 @@
 /* Reference: https://stanford-ppl.github.io/website/papers/ppopp207-bronson.pdf */
 #include <iostream>
 #include <mutex>
+#include <functional>
+#include <optional>
+#include <string>
+#include "stringkey.h"
 
-class NodeFG {
+// Key is any copyable type ordered by operator<; BronsonTree is instantiated
+// for int, std::string and StringKey in finegrainedBronson.cpp
+template <typename Key>
+class BronsonNode {
 public:
     enum NodeType {INT, REM};
-    long version;
-    int height;
-    const int key;
-    NodeType value; // determinant for removed node
+    // Read optimistically without the node lock, so every mutable field is
+    // volatile to keep the compiler from caching it across validation reads
+    volatile long version;
+    volatile int height;
+    const Key key;
+    volatile NodeType value; // determinant for removed node
+    volatile int val; // mapped value, meaningful while value is INT
     
-    NodeFG* left;
-    NodeFG* right;
-    NodeFG* parent;
+    BronsonNode* volatile left;
+    BronsonNode* volatile right;
+    BronsonNode* volatile parent;
 
     std::mutex nodeLock;
 
-    NodeFG(int key);
+    BronsonNode(const Key& key, int val = 0);
 };
 
-class AVLTreeFG {
+template <typename Key>
+class BronsonTree {
 public:
-    // NodeFG* root;
-    AVLTreeFG();
-    ~AVLTreeFG();
+    typedef BronsonNode<Key> Node;
 
-    bool insert(int key);
-    bool deleteNode(int key);
-    bool search(int key);
+    BronsonTree();
+    ~BronsonTree();
+
+    bool insert(const Key& key);
+    bool deleteNode(const Key& key);
+    bool search(const Key& key);
+    void searchBatch(const Key* keys, size_t n, bool* out);
     void preOrder();
+    bool bulkLoad(const Key* sorted, size_t n);
+
+    // Map operations on the value kept with every key; insert maps to 0
+    std::optional<int> get(const Key& key);
+    // Returns the value already mapped, in which case the tree is unchanged
+    std::optional<int> putIfAbsent(const Key& key, int val);
+    bool replace(const Key& key, int expected, int desired);
+    // Atomically map key to fn(current value, nullopt if absent) and return
+    // the new value. fn runs once, under a node lock, and must not call back
+    // into the tree.
+    int compute(const Key& key, const std::function<int(std::optional<int>)>& fn);
 
 private:
     std::mutex rootLock;
-    NodeFG* rootHolder;
+    Node* rootHolder;
     // Specify the rollback of optimistic concurrency control
     enum Status {RETRY, SUCCESS, FAILURE};
+    // Decides the write of one update from the current value, nullptr if
+    // the key is absent: returns false to leave the tree as it is
+    typedef std::function<bool(const int* current, int& next)> Update;
 
-    int getBalance(NodeFG* node) const;
-    int height(NodeFG* node) const;
-    NodeFG* minValueNode(NodeFG* node);
-    NodeFG* getChild(NodeFG* node, int dir);
-    bool canUnlink(NodeFG* node);
-    void waitUntilNotChanging(NodeFG* node);
+    int getBalance(Node* node) const;
+    int height(Node* node) const;
+    Node* minValueNode(Node* node);
+    Node* getChild(Node* node, int dir);
+    bool canUnlink(Node* node);
+    void waitUntilNotChanging(Node* node);
 
-    int nodeCondition(NodeFG* node);
-    NodeFG* fixHeightNoLock(NodeFG* node);
-    void fixHeightAndRebalance(NodeFG* node);
-    NodeFG* rotateRight(NodeFG* parent, NodeFG* node, NodeFG* nL, int hR, int hLL, NodeFG* nLR, int hLR);
-    NodeFG* rotateLeft(NodeFG* parent, NodeFG* node, NodeFG* nR, int hL, int hRR, NodeFG* nRL, int hRL);
-    NodeFG* rotateRightOverLeft(NodeFG* parent, NodeFG* node, NodeFG* nL, int hR, int hLL, NodeFG* nLR, int hLRL);
-    NodeFG* rotateLeftOverRight(NodeFG* parent, NodeFG* node, NodeFG* nR, int hL, int hRR, NodeFG* nRL, int hRLR);
-    NodeFG* rebalanceToRight(NodeFG* parent, NodeFG* node, NodeFG* nL, int hR0);
-    NodeFG* rebalanceToLeft(NodeFG* parent, NodeFG* node, NodeFG* nR, int hL0);
-    NodeFG* rebalanceNoLock(NodeFG* parent, NodeFG* node);
+    int nodeCondition(Node* node);
+    Node* fixHeightNoLock(Node* node);
+    void fixHeightAndRebalance(Node* node);
+    Node* rotateRight(Node* parent, Node* node, Node* nL, int hR, int hLL, Node* nLR, int hLR);
+    Node* rotateLeft(Node* parent, Node* node, Node* nR, int hL, int hRR, Node* nRL, int hRL);
+    Node* rotateRightOverLeft(Node* parent, Node* node, Node* nL, int hR, int hLL, Node* nLR, int hLRL);
+    Node* rotateLeftOverRight(Node* parent, Node* node, Node* nR, int hL, int hRR, Node* nRL, int hRLR);
+    Node* rebalanceToRight(Node* parent, Node* node, Node* nL, int hR0);
+    Node* rebalanceToLeft(Node* parent, Node* node, Node* nR, int hL0);
+    Node* rebalanceNoLock(Node* parent, Node* node);
 
-    Status attemptInsert(int key, NodeFG* node, int dir, long nodeV);
-    Status attemptInsertHelper(int key, NodeFG* node, int dir, long nodeV);
-    Status attemptDeleteNode(int key, NodeFG* node, int dir, long nodeV);
-    Status attemptRemoveNode(NodeFG* parent, NodeFG* node);
-    bool attemptUnlinkNoLock(NodeFG* parent, NodeFG* node);
-    Status attemptSearch(int key, NodeFG* node, int dir, long nodeV);    
+    bool applyUpdate(const Key& key, const Update& update);
+    bool lookup(const Key& key, int* val);
+    Status attemptInsert(const Key& key, Node* node, int dir, long nodeV, const Update& update);
+    Status attemptInsertHelper(const Key& key, Node* node, int dir, long nodeV, const Update& update);
+    Status attemptDeleteNode(const Key& key, Node* node, int dir, long nodeV);
+    Status attemptRemoveNode(Node* parent, Node* node);
+    Status attemptUpdateNode(Node* node, const Update& update);
+    bool attemptUnlinkNoLock(Node* parent, Node* node);
+    Status attemptSearch(const Key& key, Node* node, int dir, long nodeV, int* val);
     
-    void preOrderHelper(NodeFG* node) const;
-    void freeTree(volatile NodeFG* node);
-};  
\ No newline at end of file
+    Node* buildHelper(const Key* sorted, size_t lo, size_t hi, Node* parent, int depth);
+    void preOrderHelper(Node* node) const;
+    void freeTree(volatile Node* node);
+};
+
+typedef BronsonNode<int> NodeFG;
+typedef BronsonTree<int> AVLTreeFG;
@@ -0,0 +1,101 @@
+#include "flatcombining.h"
+#include "threadslot.h"
+#include <thread>
+#include <algorithm>
+
+// Slot indices are per thread and shared by every AVLTreeFC, so a thread
+// owns the same slot in all trees
+typedef ThreadSlots<FC_MAX_THREADS> FCSlots;
+
+AVLTreeFC::AVLTreeFC() : rounds(0), ops(0) {
+    for (int i = 0; i < FC_MAX_THREADS; i++)
+        slots[i].state = EMPTY;
+}
+
+// Apply every pending request in key order, so consecutive operations walk
+// overlapping paths through the tree while they are still in cache
+void AVLTreeFC::combine() {
+    int limit = FCSlots::limit();
+    pending.clear();
+    for (int i = 0; i < limit; i++) {
+        if (slots[i].state.load(std::memory_order_acquire) == PENDING)
+            pending.push_back(i);
+    }
+    if (pending.empty())
+        return;
+    std::sort(pending.begin(), pending.end(), [this](int a, int b) { return slots[a].key < slots[b].key; });
+
+    tree.startWrite();
+    for (int i : pending) {
+        Slot& s = slots[i];
+        std::optional<Unit> old;
+        if (s.op == INSERT) {
+            tree.storeShared(tree.root, tree.insertHelper(tree.root, s.key, Unit(), false, old));
+            s.result = !old;
+        }
+        else if (s.op == DELETE) {
+            tree.storeShared(tree.root, tree.deleteHelper(tree.root, s.key, old));
+            s.result = old.has_value();
+        }
+        else {
+            s.result = tree.searchHelper(tree.root, s.key);
+        }
+    }
+    tree.endWrite();
+
+    rounds++;
+    ops += pending.size();
+    for (int i : pending)
+        slots[i].state.store(DONE, std::memory_order_release);
+}
+
+// Publish a request and wait for some combiner, possibly this thread, to
+// apply it
+bool AVLTreeFC::execute(OpType op, int key) {
+    Slot& s = slots[FCSlots::id()];
+    s.op = op;
+    s.key = key;
+    s.state.store(PENDING, std::memory_order_release);
+    while (s.state.load(std::memory_order_acquire) != DONE) {
+        if (combineLock.try_lock()) {
+            combine();
+            combineLock.unlock();
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    bool result = s.result;
+    s.state.store(EMPTY, std::memory_order_relaxed);
+    return result;
+}
+
+bool AVLTreeFC::insert(int key) {
+    return execute(INSERT, key);
+}
+
+bool AVLTreeFC::deleteNode(int key) {
+    return execute(DELETE, key);
+}
+
+bool AVLTreeFC::search(int key) {
+    return execute(SEARCH, key);
+}
+
+// Scans and bulk loads are not combined; they take the tree's own locks,
+// which exclude combiners as well
+void AVLTreeFC::rangeQuery(int lo, int hi, std::vector<int>& out) {
+    tree.rangeQuery(lo, hi, out);
+}
+
+bool AVLTreeFC::bulkLoad(const int* sorted, size_t n) {
+    return tree.bulkLoad(sorted, n);
+}
+
+long AVLTreeFC::combiningRounds() const {
+    return rounds;
+}
+
+long AVLTreeFC::combinedOps() const {
+    return ops;
+}
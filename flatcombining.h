@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "coarsegrained.h"
+
+// Upper bound on the number of threads using flat-combining trees at once
+#define FC_MAX_THREADS 512
+
+// Flat-combining front end for AVLTreeCG. A thread publishes its operation
+// in its own slot and then either becomes the combiner, applying every
+// pending operation under a single write lock, or waits until a combiner
+// has applied its operation. The global lock changes hands once per
+// combining round instead of once per operation.
+class AVLTreeFC {
+public:
+    AVLTreeCG tree;
+    AVLTreeFC();
+
+    bool insert(int key);
+    bool deleteNode(int key);
+    bool search(int key);
+    void rangeQuery(int lo, int hi, std::vector<int>& out);
+    bool bulkLoad(const int* sorted, size_t n);
+
+    // Combining rounds run and operations applied by them so far
+    long combiningRounds() const;
+    long combinedOps() const;
+
+private:
+    enum OpType {INSERT, DELETE, SEARCH};
+    enum SlotState {EMPTY, PENDING, DONE};
+
+    // One request slot per thread, on its own cache line so that waiting
+    // threads spin without disturbing each other
+    struct alignas(64) Slot {
+        std::atomic<int> state;
+        OpType op;
+        int key;
+        bool result;
+    };
+
+    Slot slots[FC_MAX_THREADS];
+    std::mutex combineLock;
+    // Only touched by the thread holding combineLock
+    std::vector<int> pending;
+    std::atomic<long> rounds;
+    std::atomic<long> ops;
+
+    bool execute(OpType op, int key);
+    void combine();
+};
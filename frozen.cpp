@@ -0,0 +1,119 @@
+#include "frozen.h"
+#include <cstdlib>
+#include <cstring>
+
+FrozenTree::FrozenTree(const int* sorted, size_t n, Layout layout) : layout(layout), n(n), height(0) {
+    while (height < 64 && (n >> height) != 0)
+        height++;
+    // Eytzinger leaves index 0 unused; VEB positions cover the perfect tree
+    slots = layout == EYTZINGER ? n + 1 : ((size_t)1 << height) - 1;
+    size_t bytes = (slots * sizeof(int) + 64) / 64 * 64;
+    keys = static_cast<int*>(aligned_alloc(64, bytes));
+    memset(keys, 0, bytes);
+    memset(topSize, 0, sizeof(topSize));
+    memset(bottomSize, 0, sizeof(bottomSize));
+    memset(topDepth, 0, sizeof(topDepth));
+    if (layout == VEB)
+        buildTables(0, height);
+    size_t next = 0;
+    size_t pathPos[FROZEN_MAX_HEIGHT];
+    fill(sorted, next, 1, 0, pathPos);
+}
+
+FrozenTree::~FrozenTree() {
+    free(keys);
+}
+
+size_t FrozenTree::size() const {
+    return n;
+}
+
+size_t FrozenTree::bytes() const {
+    return slots * sizeof(int);
+}
+
+// Split the levels-high tree rooted at depth into a top tree of half the
+// levels and the bottom trees below it, then lay out each part the same way
+void FrozenTree::buildTables(int depth, int levels) {
+    if (levels <= 1)
+        return;
+    int top = levels / 2;
+    int bottom = levels - top;
+    int d = depth + top;
+    topSize[d] = ((size_t)1 << top) - 1;
+    bottomSize[d] = ((size_t)1 << bottom) - 1;
+    topDepth[d] = depth;
+    buildTables(depth, top);
+    buildTables(d, bottom);
+}
+
+// Array index of BFS node i at the given depth. For VEB, pathPos holds the
+// indices of i's ancestors and records i's; a bottom tree is laid out after
+// its top tree, in BFS order of its root among the top tree's leaves.
+size_t FrozenTree::position(size_t i, int depth, size_t* pathPos) const {
+    if (layout == EYTZINGER)
+        return i;
+    size_t p = depth == 0 ? 0 : pathPos[topDepth[depth]] + topSize[depth] + (i & topSize[depth]) * bottomSize[depth];
+    pathPos[depth] = p;
+    return p;
+}
+
+// In-order walk of the implicit tree, assigning the sorted keys
+void FrozenTree::fill(const int* sorted, size_t& next, size_t i, int depth, size_t* pathPos) {
+    if (i > n)
+        return;
+    size_t p = position(i, depth, pathPos);
+    fill(sorted, next, 2 * i, depth + 1, pathPos);
+    keys[p] = sorted[next++];
+    fill(sorted, next, 2 * i + 1, depth + 1, pathPos);
+}
+
+void FrozenTree::collect(size_t i, int depth, size_t* pathPos, std::vector<int>& out) const {
+    if (i > n)
+        return;
+    size_t p = position(i, depth, pathPos);
+    collect(2 * i, depth + 1, pathPos, out);
+    out.push_back(keys[p]);
+    collect(2 * i + 1, depth + 1, pathPos, out);
+}
+
+void FrozenTree::sortedKeys(std::vector<int>& out) const {
+    out.clear();
+    out.reserve(n);
+    size_t pathPos[FROZEN_MAX_HEIGHT];
+    collect(1, 0, pathPos, out);
+}
+
+// Every level takes the same steps whatever the comparison says, so the
+// only branch is the loop's. When the walk falls off the tree, i ends with
+// the right turns taken since the last left turn; shifting them out leaves
+// the node where the search last went left, the smallest key >= key.
+bool FrozenTree::searchEytzinger(int key) const {
+    size_t i = 1;
+    while (i <= n) {
+        __builtin_prefetch(keys + FROZEN_PREFETCH_STRIDE * i);
+        i = 2 * i + (keys[i] < key);
+    }
+    i >>= __builtin_ffsll(~i);
+    return i != 0 && keys[i] == key;
+}
+
+bool FrozenTree::searchVEB(int key) const {
+    size_t pathPos[FROZEN_MAX_HEIGHT + 1];
+    pathPos[0] = 0;
+    size_t i = 1;
+    size_t p = 0;
+    bool found = false;
+    for (int depth = 1; i <= n; depth++) {
+        int k = keys[p];
+        found |= k == key;
+        i = 2 * i + (k < key);
+        p = pathPos[topDepth[depth]] + topSize[depth] + (i & topSize[depth]) * bottomSize[depth];
+        pathPos[depth] = p;
+    }
+    return found;
+}
+
+bool FrozenTree::search(int key) const {
+    return layout == EYTZINGER ? searchEytzinger(key) : searchVEB(key);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <climits>
+#include <cstddef>
+
+// Eytzinger search prefetches node 16i, i's first descendant four levels
+// down; the 16 descendants fill one cache line
+#define FROZEN_PREFETCH_STRIDE 16
+// Deepest implicit tree a FrozenTree can hold; distinct int keys need 33
+#define FROZEN_MAX_HEIGHT 40
+
+/*
+ * Immutable snapshot of a key set for read-only phases, stored as an
+ * implicit complete binary search tree in one aligned array: no pointers,
+ * no locks, and the whole top of the tree in a few cache lines. Node i
+ * (from 1, in BFS order) has children 2i and 2i + 1.
+ *
+ * EYTZINGER stores node i at index i. The search is branchless and
+ * prefetches the cache line holding the node's descendants four levels
+ * down, so consecutive levels' misses overlap.
+ *
+ * VEB stores the same tree in van Emde Boas order: recursively the top half
+ * of the levels, then each bottom subtree, so any path touches
+ * O(log_B n) blocks whatever the block size. Positions are computed from
+ * the BFS index with per-depth tables (Brodal, Fagerberg and Jacob). The
+ * array is sized for the perfect tree, up to twice the keys.
+ */
+class FrozenTree {
+public:
+    enum Layout { EYTZINGER, VEB };
+
+    FrozenTree(const int* sorted, size_t n, Layout layout = EYTZINGER);
+    ~FrozenTree();
+    FrozenTree(const FrozenTree&) = delete;
+    FrozenTree& operator=(const FrozenTree&) = delete;
+
+    bool search(int key) const;
+    // Keys in ascending order, for thaw()
+    void sortedKeys(std::vector<int>& out) const;
+    size_t size() const;
+    size_t bytes() const;
+
+private:
+    Layout layout;
+    size_t n;
+    size_t slots;
+    int height;
+    int* keys;
+    // VEB: a node at depth d roots one of the bottom trees of size
+    // bottomSize[d] under a top tree of size topSize[d] whose root is at
+    // depth topDepth[d]
+    size_t topSize[FROZEN_MAX_HEIGHT];
+    size_t bottomSize[FROZEN_MAX_HEIGHT];
+    int topDepth[FROZEN_MAX_HEIGHT];
+
+    void buildTables(int depth, int levels);
+    size_t position(size_t i, int depth, size_t* pathPos) const;
+    void fill(const int* sorted, size_t& next, size_t i, int depth, size_t* pathPos);
+    void collect(size_t i, int depth, size_t* pathPos, std::vector<int>& out) const;
+    bool searchEytzinger(int key) const;
+    bool searchVEB(int key) const;
+};
+
+// Export a tree's keys into a FrozenTree. Tree is any tree with rangeQuery;
+// the caller owns the result.
+template <typename Tree>
+FrozenTree* freeze(Tree& tree, FrozenTree::Layout layout = FrozenTree::EYTZINGER) {
+    std::vector<int> sorted;
+    tree.rangeQuery(INT_MIN, INT_MAX, sorted);
+    return new FrozenTree(sorted.data(), sorted.size(), layout);
+}
+
+// Load a frozen key set into tree, which must be empty, through its bulkLoad
+template <typename Tree>
+bool thaw(const FrozenTree& frozen, Tree& tree) {
+    std::vector<int> sorted;
+    frozen.sortedKeys(sorted);
+    return tree.bulkLoad(sorted.data(), sorted.size());
+}
@@ -0,0 +1,222 @@
+#include "hugepage.h"
+#include <mutex>
+#include <cstdint>
+#include <sys/mman.h>
+
+void* hugeMap(size_t bytes, bool hugeTLB) {
+    bytes = (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    if (bytes == 0)
+        return nullptr;
+#ifdef MAP_HUGETLB
+    // Fails unless the administrator reserved pages in vm.nr_hugepages
+    if (hugeTLB) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            return p;
+    }
+#endif
+    // Over-map by one huge page and trim both ends to get an aligned range
+    size_t span = bytes + HUGE_PAGE_BYTES;
+    void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return nullptr;
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+    if (aligned > start)
+        munmap(raw, aligned - start);
+    if (start + span > aligned + bytes)
+        munmap(reinterpret_cast<void*>(aligned + bytes), start + span - (aligned + bytes));
+#ifdef MADV_HUGEPAGE
+    // Only a hint: with transparent huge pages off the range stays on 4 KB pages
+    madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<void*>(aligned);
+}
+
+void hugeUnmap(void* p, size_t bytes) {
+    if (p != nullptr)
+        munmap(p, (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES);
+}
+
+namespace {
+
+struct FreeSlot {
+    FreeSlot* next;
+};
+
+struct SizeClass {
+    std::mutex lock;
+    FreeSlot* freeList;
+    char* slabNext;
+    char* slabEnd;
+};
+
+// Freed slots of one thread. Once the thread's cache is destroyed, late
+// frees, say from a tree destroyed at exit, go straight to the shared lists.
+struct ThreadCache {
+    FreeSlot* head[HUGE_SIZE_CLASSES];
+    int count[HUGE_SIZE_CLASSES];
+    bool dead;
+
+    ThreadCache() : head(), count(), dead(false) {}
+    ~ThreadCache();
+};
+
+std::atomic<bool> poolEnabled(false);
+bool poolHugeTLB = false;
+SizeClass classes[HUGE_SIZE_CLASSES];
+thread_local ThreadCache cache;
+
+// Readers scan the first numRegions entries without locking; a region is
+// written before numRegions is raised past it and never changes afterwards
+char* regions[HUGE_MAX_REGIONS];
+std::atomic<int> numRegions(0);
+std::mutex regionLock;
+char* regionNext = nullptr;
+char* regionEnd = nullptr;
+
+size_t slotBytes(int c) {
+    return (size_t)(c + 1) * HUGE_SIZE_STEP;
+}
+
+char* takeSlab() {
+    std::lock_guard<std::mutex> guard(regionLock);
+    if (regionNext == regionEnd) {
+        int n = numRegions.load(std::memory_order_relaxed);
+        if (n == HUGE_MAX_REGIONS)
+            return nullptr;
+        char* region = static_cast<char*>(hugeMap(HUGE_REGION_BYTES, poolHugeTLB));
+        if (region == nullptr)
+            return nullptr;
+        regions[n] = region;
+        numRegions.store(n + 1, std::memory_order_release);
+        regionNext = region;
+        regionEnd = region + HUGE_REGION_BYTES;
+    }
+    char* slab = regionNext;
+    regionNext += HUGE_SLAB_BYTES;
+    return slab;
+}
+
+// Take one slot of class c from the shared free list or the class's slab;
+// the caller holds the class lock
+FreeSlot* takeSlot(SizeClass& sc, int c) {
+    FreeSlot* s = sc.freeList;
+    if (s != nullptr) {
+        sc.freeList = s->next;
+        return s;
+    }
+    if ((size_t)(sc.slabEnd - sc.slabNext) < slotBytes(c)) {
+        char* slab = takeSlab();
+        if (slab == nullptr)
+            return nullptr;
+        sc.slabNext = slab;
+        sc.slabEnd = slab + HUGE_SLAB_BYTES;
+    }
+    s = reinterpret_cast<FreeSlot*>(sc.slabNext);
+    sc.slabNext += slotBytes(c);
+    return s;
+}
+
+// Move up to n slots from the thread's cache to the shared list
+void flush(ThreadCache& tc, int c, int n) {
+    SizeClass& sc = classes[c];
+    std::lock_guard<std::mutex> guard(sc.lock);
+    for (int i = 0; i < n && tc.head[c] != nullptr; i++) {
+        FreeSlot* s = tc.head[c];
+        tc.head[c] = s->next;
+        tc.count[c]--;
+        s->next = sc.freeList;
+        sc.freeList = s;
+    }
+}
+
+ThreadCache::~ThreadCache() {
+    for (int c = 0; c < HUGE_SIZE_CLASSES; c++)
+        flush(*this, c, count[c]);
+    dead = true;
+}
+
+}
+
+void HugePagePool::enable(bool hugeTLB) {
+    std::lock_guard<std::mutex> guard(regionLock);
+    poolHugeTLB = hugeTLB;
+    poolEnabled.store(true);
+}
+
+void HugePagePool::disable() {
+    poolEnabled.store(false);
+}
+
+bool HugePagePool::enabled() {
+    return poolEnabled.load(std::memory_order_relaxed);
+}
+
+bool HugePagePool::hugeTLB() {
+    return poolHugeTLB;
+}
+
+void* HugePagePool::allocate(size_t size) {
+    if (!enabled() || size == 0 || size > HUGE_MAX_OBJECT)
+        return nullptr;
+    int c = (int)((size - 1) / HUGE_SIZE_STEP);
+    ThreadCache& tc = cache;
+    SizeClass& sc = classes[c];
+    if (tc.dead) {
+        std::lock_guard<std::mutex> guard(sc.lock);
+        return takeSlot(sc, c);
+    }
+    if (tc.head[c] == nullptr) {
+        std::lock_guard<std::mutex> guard(sc.lock);
+        for (int i = 0; i < HUGE_CACHE_OBJECTS; i++) {
+            FreeSlot* s = takeSlot(sc, c);
+            if (s == nullptr)
+                break;
+            s->next = tc.head[c];
+            tc.head[c] = s;
+            tc.count[c]++;
+        }
+        if (tc.head[c] == nullptr)
+            return nullptr;
+    }
+    FreeSlot* s = tc.head[c];
+    tc.head[c] = s->next;
+    tc.count[c]--;
+    return s;
+}
+
+bool HugePagePool::release(void* p, size_t size) {
+    if (!owns(p))
+        return false;
+    int c = (int)((size - 1) / HUGE_SIZE_STEP);
+    FreeSlot* s = static_cast<FreeSlot*>(p);
+    ThreadCache& tc = cache;
+    if (tc.dead) {
+        SizeClass& sc = classes[c];
+        std::lock_guard<std::mutex> guard(sc.lock);
+        s->next = sc.freeList;
+        sc.freeList = s;
+        return true;
+    }
+    s->next = tc.head[c];
+    tc.head[c] = s;
+    if (++tc.count[c] > 2 * HUGE_CACHE_OBJECTS)
+        flush(tc, c, HUGE_CACHE_OBJECTS);
+    return true;
+}
+
+bool HugePagePool::owns(const void* p) {
+    uintptr_t a = reinterpret_cast<uintptr_t>(p);
+    int n = numRegions.load(std::memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        uintptr_t start = reinterpret_cast<uintptr_t>(regions[i]);
+        if (a >= start && a < start + HUGE_REGION_BYTES)
+            return true;
+    }
+    return false;
+}
+
+size_t HugePagePool::mappedBytes() {
+    return (size_t)numRegions.load() * HUGE_REGION_BYTES;
+}
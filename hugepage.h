@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+#define HUGE_PAGE_BYTES (2ul << 20)
+// Node memory is reserved from the kernel in regions of this many bytes
+#define HUGE_REGION_BYTES (64ul << 20)
+#define HUGE_MAX_REGIONS 1024
+// Each size class carves slabs of this size from the current region
+#define HUGE_SLAB_BYTES (256ul << 10)
+// Objects are rounded up to a multiple of HUGE_SIZE_STEP; larger than
+// HUGE_MAX_OBJECT go to the global operator new
+#define HUGE_SIZE_STEP 16
+#define HUGE_MAX_OBJECT 512
+#define HUGE_SIZE_CLASSES (HUGE_MAX_OBJECT / HUGE_SIZE_STEP)
+// A thread keeps up to twice this many freed objects per class before
+// handing this many back to the shared list
+#define HUGE_CACHE_OBJECTS 64
+
+// Map bytes, rounded up to whole huge pages, at a 2 MB-aligned address and
+// ask for transparent huge pages. With hugeTLB set, reserved MAP_HUGETLB
+// pages are tried first. Returns nullptr if nothing could be mapped.
+void* hugeMap(size_t bytes, bool hugeTLB);
+void hugeUnmap(void* p, size_t bytes);
+
+/*
+ * Fixed-size object pool on huge-page regions, for tree nodes. With nodes
+ * scattered over 4 KB pages, a lookup in a tree of 10M+ nodes misses the
+ * dTLB on nearly every level; on 2 MB pages the TLB covers 512 times as much
+ * memory. Each size class hands out slots from slabs in the current region,
+ * with a small per-thread cache of freed slots in front of a shared free
+ * list so concurrent trees do not serialize on the allocator.
+ *
+ * The pool is off until enable() and then serves every node type derived
+ * from HugePageNode. When it is off, or the kernel refuses a region,
+ * allocate() returns nullptr and nodes come from the global operator new as
+ * before. release() tells the two apart by address, so switching the pool
+ * on or off never strands a node. Regions are kept until the process exits.
+ */
+class HugePagePool {
+public:
+    static void enable(bool hugeTLB = false);
+    static void disable();
+    static bool enabled();
+    static bool hugeTLB();
+
+    // nullptr when the pool cannot serve size bytes
+    static void* allocate(size_t size);
+    // false, doing nothing, if p did not come from the pool
+    static bool release(void* p, size_t size);
+    static bool owns(const void* p);
+    // Bytes of regions mapped so far
+    static size_t mappedBytes();
+};
+
+// Base class that routes a node type's new and delete through HugePagePool
+class HugePageNode {
+public:
+    static void* operator new(size_t size) {
+        void* p = HugePagePool::allocate(size);
+        return p != nullptr ? p : ::operator new(size);
+    }
+
+    static void operator delete(void* p, size_t size) {
+        if (!HugePagePool::release(p, size))
+            ::operator delete(p);
+    }
+
+    // Over-aligned nodes such as the B+-tree's: rounding the size up to the
+    // alignment keeps every slot of the class aligned within its slab
+    static void* operator new(size_t size, std::align_val_t align) {
+        void* p = (size_t)align <= 64 ? HugePagePool::allocate(roundUp(size, align)) : nullptr;
+        return p != nullptr ? p : ::operator new(size, align);
+    }
+
+    static void operator delete(void* p, size_t size, std::align_val_t align) {
+        if ((size_t)align > 64 || !HugePagePool::release(p, roundUp(size, align)))
+            ::operator delete(p, align);
+    }
+
+private:
+    static size_t roundUp(size_t size, std::align_val_t align) {
+        return (size + (size_t)align - 1) / (size_t)align * (size_t)align;
+    }
+};
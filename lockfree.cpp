@@ -1,6 +1,8 @@
 #include "lockfree.h"
+#include "parallel.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <algorithm>
 
 #define FLAG_MASK 3UL
 #define NULL_MASK 1UL
@@ -125,6 +127,147 @@ bool AVLTreeLF::search(int k) {
     return find(k, parent, parent_op, curr, curr_op, &root) == FOUND;
 }
 
+#ifdef __cpp_impl_coroutine
+/*
+ * Coroutine flavor of search for interleavedSearch. The traversal, helping
+ * and restart conditions are those of find from the tree root; the only
+ * difference is that it prefetches each next node and suspends before
+ * reading it.
+ */
+LookupTask AVLTreeLF::searchCoro(int k) {
+    int result, current_key;
+    NodeBST* parent, *curr, *next, *last_right;
+    Operation* parent_op, *curr_op, *last_right_op;
+    bool is_occupied = false;
+
+    while (true) {
+        result = NOTFOUND_R;
+        curr = &root;
+        curr_op = curr->op;
+        if (GET_FLAG(curr_op) != NONE) {
+            helpChildCAS(DE_FLAG(curr_op), curr);
+            continue;
+        }
+        next = curr->right;
+        last_right = curr;
+        last_right_op = curr_op;
+
+        while (!IS_NULL(next)) {
+            co_await prefetchAndYield(next);
+            parent = curr;
+            parent_op = curr_op;
+            curr = next;
+            curr_op = next->op;
+            if (GET_FLAG(curr_op) != NONE) {
+                help(parent, parent_op, curr, curr_op);
+                is_occupied = true;
+                break;
+            }
+            current_key = curr->key;
+            if (k < current_key) {
+                result = NOTFOUND_L;
+                next = curr->left;
+            }
+            else if (k > current_key) {
+                result = NOTFOUND_R;
+                next = curr->right;
+                last_right = curr;
+                last_right_op = curr_op;
+            }
+            else {
+                result = FOUND;
+                break;
+            }
+        }
+
+        if (is_occupied) {
+            is_occupied = false;
+            continue;
+        }
+        if ((result == FOUND || last_right_op == last_right->op) && curr_op == curr->op) break;
+    }
+    co_return result == FOUND;
+}
+#endif
+
+/*
+ * Collect every key in [lo, hi] into out, in ascending order.
+ * Every node the scan reads a key or child pointer from is recorded together
+ * with the op word seen before the read. Any update to a key or child pointer
+ * installs a fresh op word first, so if re-reading the recorded op words finds
+ * them all unchanged, the collected keys were all in the tree at the moment
+ * validation began, which is the linearization point of the scan.
+ */
+void AVLTreeLF::rangeQuery(int lo, int hi, std::vector<int>& out) {
+    std::vector<std::pair<NodeBST*, Operation*>> visited;
+    while (true) {
+        out.clear();
+        visited.clear();
+        if (lo > hi) return;
+        if (!collectRange(lo, hi, out, visited)) continue;
+
+        bool valid = true;
+        for (auto& v : visited) {
+            if (v.first->op != v.second) {
+                valid = false;
+                break;
+            }
+        }
+        if (valid) return;
+    }
+}
+
+/*
+ * Pruned in-order walk used by rangeQuery, with an explicit stack since the
+ * BST is unbalanced. Returns false if an in-flight operation was met; it is
+ * helped first so the retry makes progress.
+ */
+bool AVLTreeLF::collectRange(int lo, int hi, std::vector<int>& out, std::vector<std::pair<NodeBST*, Operation*>>& visited) {
+    struct Frame {
+        NodeBST* node;
+        Operation* op;
+        int key;
+    };
+    std::vector<Frame> stack;
+
+    Operation* root_op = root.op;
+    if (GET_FLAG(root_op) != NONE) {
+        helpChildCAS(DE_FLAG(root_op), &root);
+        return false;
+    }
+    visited.push_back({&root, root_op});
+
+    NodeBST* parent = &root;
+    Operation* parent_op = root_op;
+    NodeBST* next = root.right;
+    while (true) {
+        while (!IS_NULL(next)) {
+            NodeBST* curr = next;
+            Operation* curr_op = curr->op;
+            if (GET_FLAG(curr_op) != NONE) {
+                help(parent, parent_op, curr, curr_op);
+                return false;
+            }
+            int current_key = curr->key;
+            visited.push_back({curr, curr_op});
+            stack.push_back({curr, curr_op, current_key});
+            parent = curr;
+            parent_op = curr_op;
+            next = (lo < current_key) ? curr->left : SET_NULL(curr);
+        }
+        if (stack.empty()) break;
+
+        Frame f = stack.back();
+        stack.pop_back();
+        if (lo <= f.key && f.key <= hi)
+            out.push_back(f.key);
+        parent = f.node;
+        parent_op = f.op;
+        next = (f.key < hi) ? f.node->right : SET_NULL(f.node);
+    }
+    return true;
+}
+
 bool AVLTreeLF::insert(int k) {
     NodeBST* parent, *curr, *new_node;
     Operation* parent_op, *curr_op, *cas_op;
@@ -171,6 +314,66 @@ bool AVLTreeLF::deleteNode(int k) {
     }
 }
 
+/*
+ * Build a perfectly balanced subtree over sorted[lo, hi), forking the two
+ * halves onto separate threads near the top of the recursion. Missing
+ * children keep the null-tagged pointers set by the constructor.
+ */
+NodeBST* AVLTreeLF::buildHelper(const int* sorted, size_t lo, size_t hi, int depth) {
+    if (lo >= hi)
+        return NULL;
+    size_t mid = lo + (hi - lo) / 2;
+    NodeBST* node = new NodeBST(sorted[mid]);
+    NodeBST* left = NULL;
+    NodeBST* right = NULL;
+    forkJoin(hi - lo > FORK_GRAIN ? depth : 0,
+        [&]() { left = buildHelper(sorted, lo, mid, depth - 1); },
+        [&]() { right = buildHelper(sorted, mid + 1, hi, depth - 1); });
+    if (left != NULL) node->left = left;
+    if (right != NULL) node->right = right;
+    return node;
+}
+
+void AVLTreeLF::freeSubtree(NodeBST* node) {
+    if (IS_NULL(node)) return;
+    freeSubtree(node->left);
+    freeSubtree(node->right);
+    delete node;
+}
+
+/*
+ * Load n strictly increasing keys in O(n). Only valid on an empty tree;
+ * returns false without modifying the tree otherwise. The subtree is built
+ * privately and published with the same child CAS an insert would use.
+ */
+bool AVLTreeLF::bulkLoad(const int* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted + n, std::greater_equal<int>()) != sorted + n)
+        return false;
+    if (!IS_NULL(root.right))
+        return false;
+    if (n == 0)
+        return true;
+    NodeBST* built = buildHelper(sorted, 0, n, forkDepth());
+
+    while (true) {
+        Operation* root_op = root.op;
+        if (GET_FLAG(root_op) != NONE) {
+            helpChildCAS(DE_FLAG(root_op), &root);
+            continue;
+        }
+        NodeBST* old = root.right;
+        if (!IS_NULL(old)) {
+            freeSubtree(built);
+            return false;
+        }
+        Operation* cas_op = new ChildCASOp(false, old, built);
+        if (__sync_bool_compare_and_swap(&root.op, root_op, SET_FLAG(cas_op, CHILDCAS))) {
+            helpChildCAS(cas_op, &root);
+            return true;
+        }
+    }
+}
+
 void AVLTreeLF::help(NodeBST* parent, Operation* parent_op, NodeBST* curr, Operation* curr_op) {
     if (GET_FLAG(curr_op) == CHILDCAS)
         helpChildCAS(DE_FLAG(curr_op), curr);
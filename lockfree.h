@@ -1,8 +1,14 @@
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include "coroutine.h"
+#include "hugepage.h"
+
 class Operation {
 
 };
 
-class NodeBST {
+class NodeBST : public HugePageNode {
 public:
     int volatile key;
     Operation* volatile op;
@@ -42,6 +48,11 @@ public:
     bool insert(int key);
     bool deleteNode(int key);
     bool search(int key);
+#ifdef __cpp_impl_coroutine
+    LookupTask searchCoro(int key);
+#endif
+    void rangeQuery(int lo, int hi, std::vector<int>& out);
+    bool bulkLoad(const int* sorted, size_t n);
 
 private:
     int find(int k, NodeBST*& parent, Operation*& parent_op, NodeBST*& curr, Operation*& curr_op, NodeBST* root);
@@ -49,4 +60,7 @@ private:
     void helpMarked(NodeBST* parent, Operation* parent_op, NodeBST* curr);
     void helpChildCAS(Operation* op, NodeBST* dest);
     bool helpRelocate(Operation* op, NodeBST* parent, Operation* parentOp, NodeBST* curr);
+    NodeBST* buildHelper(const int* sorted, size_t lo, size_t hi, int depth);
+    void freeSubtree(NodeBST* node);
+    bool collectRange(int lo, int hi, std::vector<int>& out, std::vector<std::pair<NodeBST*, Operation*>>& visited);
 };
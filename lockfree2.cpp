@@ -1,10 +1,13 @@
 #include "lockfree2.h"
+#include "parallel.h"
 #include <limits.h>
+#include <algorithm>
+#include <deque>
 
 
 
 thread_local TIDGenerator kcas_tid;
-KCASHTM<100000> kcas::instance;
+KCASHTM<KCAS_MAX_ENTRIES> kcas::instance;
 
 void kcas::writeInitPtr(uintptr_t volatile * addr, uintptr_t const newval) {
     instance.writeInitPtr(addr, newval);
@@ -73,7 +76,61 @@ AVLTree::AVLTree() {
 }
 AVLTree::~AVLTree() {}
 
+/*
+ * Build a perfectly balanced subtree over sorted[lo, hi) hanging off parent,
+ * forking the two halves onto separate threads near the top of the recursion.
+ * The subtree is private until published, so fields use plain initial writes.
+ */
+Node* AVLTree::buildHelper(const int* sorted, size_t lo, size_t hi, Node* parent, int depth) {
+    if (lo>=hi)
+        return NULL;
+    size_t mid = lo+(hi-lo)/2;
+    Node* n = new Node(sorted[mid], 0, parent);
+    Node* l = NULL;
+    Node* r = NULL;
+    forkJoin(hi-lo>FORK_GRAIN ? depth : 0,
+        [&]() { l = buildHelper(sorted, lo, mid, n, depth-1); },
+        [&]() { r = buildHelper(sorted, mid+1, hi, n, depth-1); });
+    int lHeight = (l==NULL ? 0 : (int)l->height);
+    int rHeight = (r==NULL ? 0 : (int)r->height);
+    n->left.setInitVal(l);
+    n->right.setInitVal(r);
+    n->height.setInitVal(1 + std::max(lHeight, rHeight));
+    return n;
+}
+
+/*
+ * Load n strictly increasing keys strictly between the two sentinel keys in
+ * O(n). Only valid on an empty tree; returns false otherwise. The subtree is
+ * published with one KCAS on the min sentinel's right child and version.
+ */
+bool AVLTree::bulkLoad(const int* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted+n, std::greater_equal<int>())!=sorted+n)
+        return false;
+    if (n==0)
+        return true;
+    Node* minNode = minRoot;
+    Node* maxNode = maxRoot;
+    if (sorted[0]<=minNode->key || sorted[n-1]>=maxNode->key)
+        return false;
+    if (minNode->right!=NULL)
+        return false;
+    Node* root = buildHelper(sorted, 0, n, minNode, forkDepth());
+    while (true) {
+        uint64_t minVer = minNode->ver;
+        if (minNode->right!=NULL)
+            return false; // The built nodes leak, as nodes unlinked by erase do
+        kcas::start();
+        kcas::add(&minNode->right, (Node*)NULL, root,
+        &minNode->ver, minVer, minVer+2);
+        if (kcas::execute())
+            return true;
+    }
+}
+
 bool AVLTree::search(int k) {
+    if (!isKey(k))
+        return false;
     auto [n, nvers, p, pvers, res] = searchHelper(k);
     return res;
 }
@@ -112,6 +169,45 @@ std::tuple<Node*, uint64_t, Node*, uint64_t, bool> AVLTree::searchHelper(int key
     }
 }
 
+#ifdef __cpp_impl_coroutine
+// Coroutine flavor of search for interleavedSearch: the traversal of
+// searchHelper, prefetching each node and suspending before reading it.
+// A miss is only reported once validatePath confirms the path, as in
+// searchHelper; otherwise the traversal restarts from maxRoot.
+LookupTask AVLTree::searchCoro(int key) {
+    if (!isKey(key))
+        co_return false;
+    std::vector<Node*> path;
+    std::vector<uint64_t> vers;
+    while (true) { //Retry loop
+        path.clear();
+        vers.clear();
+        path.push_back(maxRoot);
+        vers.push_back(maxRoot->ver);
+        Node* n = maxRoot->left;
+        size_t sz = 1;
+        while (true) {
+            if (n==nullptr) { // Reached a leaf
+                if (validatePath(path, vers, sz))
+                    co_return false;
+                break; // Failed validation
+            }
+            co_await prefetchAndYield(n);
+            path.push_back(n);
+            vers.push_back(n->ver);
+            int currKey = n->key;
+            sz++;
+            if (key>currKey)
+                n = n->right;
+            else if (key<currKey)
+                n = n->left;
+            else
+                co_return true;
+        }
+    }
+}
+#endif
+
 bool AVLTree::validatePath(std::vector<Node*> path, std::vector<uint64_t> vers, size_t sz) {
     for (size_t i = 0; i<sz; i++) {
         if (path[i]->ver!=vers[i] || isMarked(vers[i]))
@@ -125,18 +221,97 @@ bool AVLTree::insert(int k) {
 }
 
 bool AVLTree::insertIfAbsent(int k, int v) {
+    return applyUpdate(k, [v](const int* current, int& next) {
+        next = v;
+        return current == nullptr;
+    });
+}
+
+std::optional<int> AVLTree::get(int k) {
+    if (!isKey(k))
+        return std::nullopt;
+    while (true) {
+        auto [n, nVer, p, pVer, res] = searchHelper(k);
+        if (!res)
+            return std::nullopt;
+        int v = n->val;
+        // An unchanged version means n still held k when val was read
+        if (!isMarked(nVer) && n->ver==nVer)
+            return v;
+    }
+}
+
+std::optional<int> AVLTree::putIfAbsent(int k, int v) {
+    std::optional<int> old;
+    applyUpdate(k, [&](const int* current, int& next) {
+        old.reset();
+        if (current!=nullptr) {
+            old = *current;
+            return false;
+        }
+        next = v;
+        return true;
+    });
+    return old;
+}
+
+bool AVLTree::replace(int k, int expected, int desired) {
+    return applyUpdate(k, [&](const int* current, int& next) {
+        next = desired;
+        return current!=nullptr && *current==expected;
+    });
+}
+
+int AVLTree::compute(int k, const std::function<int(std::optional<int>)>& fn) {
+    int result = 0;
+    applyUpdate(k, [&](const int* current, int& next) {
+        next = fn(current!=nullptr ? std::optional<int>(*current) : std::nullopt);
+        result = next;
+        return true;
+    });
+    return result;
+}
+
+/*
+ * Insert or update k. A present key's value changes with one KCAS over its
+ * value word that also checks the node's version, so the write fails if the
+ * node was removed or took another key meanwhile. An absent key is linked in
+ * as a new leaf, as in the original insert. Returns whether update wrote.
+ */
+bool AVLTree::applyUpdate(int k, const Update& update) {
+    if (!isKey(k))
+        return false;
     while (true) {
         auto [a, aVer, p, pVer, res] = searchHelper(k);
-        if (res)
+        int next;
+        if (res) {
+            // For a present key, a is its node
+            if (isMarked(aVer))
+                continue;
+            int current = a->val;
+            if (!update(&current, next)) {
+                if (a->ver==aVer)
+                    return false;
+                continue;
+            }
+            kcas::start();
+            kcas::add(&a->val, current, next,
+            &a->ver, aVer, aVer);
+            if (kcas::execute())
+                return true;
+            continue;
+        }
+        int pKey = p->key;
+        if (k==pKey)
+            continue;
+        if (!update(nullptr, next))
             return false;
         kcas::start();
-        Node* n = new Node(k, v, p);
-        if (k > p->key)
+        Node* n = new Node(k, next, p);
+        if (k > pKey)
             kcas::add(&p->right, (Node*)NULL, n);
-        else if (k < p->key)
-            kcas::add(&p->left, (Node*)NULL, n);
         else
-            continue;
+            kcas::add(&p->left, (Node*)NULL, n);
         uint64_t pVerNew = pVer+2;
         kcas::add(&a->ver, aVer, aVer,
         &p->ver, pVer, pVerNew);
@@ -144,6 +319,7 @@ bool AVLTree::insertIfAbsent(int k, int v) {
             rebalance(p);
             return true;
         }
+        delete n;
     }
 }
 
@@ -151,11 +327,17 @@ bool AVLTree::isMarked(uint64_t version) {
     return (version&1) == 1;
 }
 
+bool AVLTree::isKey(int k) {
+    return k>minRoot->key && k<maxRoot->key;
+}
+
 bool AVLTree::deleteNode(int k) {
     return erase(k);
 }
 
 bool AVLTree::erase(int k) {
+    if (!isKey(k))
+        return false;
     while (true) {
         auto [n, nVer, p, pVer, res] = searchHelper(k);
         if (!res)
@@ -196,7 +378,9 @@ bool AVLTree::eraseTwoChild(Node* n, uint64_t nVer, Node* p, uint64_t pVer) {
         kcas::add(&sp->left, s, sr);
     else
         return false;
+    // s->val is checked too: value updates leave s->ver alone
     kcas::add(&n->val, nVal, sVal,
+    &s->val, sVal, sVal,
     &n->key, nKey, sKey,
     &s->ver, sVer, sVer+1,
     &sp->ver, spVer, spVer+2);
@@ -633,3 +817,455 @@ bool AVLTree::rotateRightLeft(Node* p, uint64_t pVer, Node* n, uint64_t nVer, No
         return true;
     return false;
 }
+
+/*
+ * Private working copy of the part of the tree a transaction touches. A
+ * TxNode stands for a tree node, read lazily: its children are only read
+ * when the transaction descends below it or rotates it, and untouched
+ * subtrees stay shared. The ops run on the copy with plain sequential AVL
+ * code; commit then turns the difference between the copy and what was read
+ * into one KCAS: every word written goes from the value read to the new
+ * one, every node whose fields changed has its version raised by 2 and
+ * every erased node is marked, as in the single-key operations, and every
+ * other node read has its version checked.
+ */
+namespace {
+
+struct TxNode {
+    Node* orig; // nullptr for a key inserted by the transaction
+    uint64_t ver;
+    Node* origParent;
+    Node* origLeft;
+    Node* origRight;
+    int origKey, origHeight, origVal;
+    int key, height, val;
+    TxNode* left;
+    TxNode* right;
+    TxNode* parent; // in the final tree, set by commit
+    bool expanded; // children read
+    bool valRead;
+    bool erased;
+    Node* real; // the node in the final tree
+};
+
+class TxPlan {
+public:
+    explicit TxPlan(Node* holder) {
+        maxKey = holder->parent->key;
+        this->holder = stub(holder, NULL);
+        expand(this->holder);
+    }
+
+    ~TxPlan() {
+        if (!committed)
+            for (TxNode& t : nodes)
+                if (t.orig==NULL && t.real!=NULL)
+                    delete t.real;
+    }
+
+    bool apply(const AVLTree::TxOp& op);
+    // Words the KCAS of validate() and of commit() would cover; commit's
+    // count is only known once prepare() has built the final tree
+    size_t validateEntries();
+    size_t commitEntries();
+    bool validate();
+    void prepare();
+    bool commit();
+
+private:
+    std::deque<TxNode> nodes;
+    TxNode* holder; // the min sentinel, whose right child is the root
+    int maxKey;
+    bool committed = false;
+
+    // Keys live strictly between the sentinels
+    bool inRange(int key) const {
+        return key>holder->key && key<maxKey;
+    }
+
+    TxNode* stub(Node* n, Node* parent);
+    TxNode* fresh(int key, int val);
+    void expand(TxNode* t);
+    int value(TxNode* t);
+    void setValue(TxNode* t, int v);
+    TxNode* find(int key);
+    template <typename Add>
+    void forEachCheck(Add add);
+    template <typename Add>
+    void forEachWrite(Add add);
+
+    static int height(TxNode* t) {
+        return t==NULL ? 0 : t->height;
+    }
+    void fix(TxNode* t) {
+        t->height = 1 + std::max(height(t->left), height(t->right));
+    }
+    int balance(TxNode* t) {
+        if (t==NULL)
+            return 0;
+        expand(t);
+        return height(t->left) - height(t->right);
+    }
+    TxNode* rotateRight(TxNode* y);
+    TxNode* rotateLeft(TxNode* x);
+    TxNode* rebalance(TxNode* t);
+    TxNode* insert(TxNode* t, int key, int val, bool& done);
+    TxNode* erase(TxNode* t, int key, bool& done);
+    TxNode* eraseMin(TxNode* t, TxNode*& min);
+};
+
+// Versions are read before the fields they cover, so that the check of the
+// version at commit also covers the fields
+TxNode* TxPlan::stub(Node* n, Node* parent) {
+    TxNode t = {};
+    t.orig = n;
+    t.ver = n->ver;
+    t.origParent = parent;
+    t.origKey = t.key = n->key;
+    t.origHeight = t.height = n->height;
+    nodes.push_back(t);
+    return &nodes.back();
+}
+
+TxNode* TxPlan::fresh(int key, int val) {
+    TxNode t = {};
+    t.key = key;
+    t.val = val;
+    t.height = 1;
+    t.expanded = true;
+    nodes.push_back(t);
+    return &nodes.back();
+}
+
+void TxPlan::expand(TxNode* t) {
+    if (t->expanded)
+        return;
+    t->expanded = true;
+    t->origLeft = t->orig->left;
+    t->origRight = t->orig->right;
+    t->left = t->origLeft==NULL ? NULL : stub(t->origLeft, t->orig);
+    t->right = t->origRight==NULL ? NULL : stub(t->origRight, t->orig);
+}
+
+int TxPlan::value(TxNode* t) {
+    if (t->orig!=NULL && !t->valRead) {
+        t->valRead = true;
+        t->origVal = t->val = t->orig->val;
+    }
+    return t->val;
+}
+
+void TxPlan::setValue(TxNode* t, int v) {
+    value(t);
+    t->val = v;
+}
+
+TxNode* TxPlan::find(int key) {
+    TxNode* t = holder->right;
+    while (t!=NULL) {
+        expand(t);
+        if (key<t->key)
+            t = t->left;
+        else if (key>t->key)
+            t = t->right;
+        else
+            return t;
+    }
+    return NULL;
+}
+
+TxNode* TxPlan::rotateRight(TxNode* y) {
+    expand(y);
+    TxNode* x = y->left;
+    expand(x);
+    y->left = x->right;
+    x->right = y;
+    fix(y);
+    fix(x);
+    return x;
+}
+
+TxNode* TxPlan::rotateLeft(TxNode* x) {
+    expand(x);
+    TxNode* y = x->right;
+    expand(y);
+    x->right = y->left;
+    y->left = x;
+    fix(x);
+    fix(y);
+    return y;
+}
+
+TxNode* TxPlan::rebalance(TxNode* t) {
+    expand(t);
+    fix(t);
+    int b = balance(t);
+    if (b>1) {
+        if (balance(t->left)<0)
+            t->left = rotateLeft(t->left);
+        return rotateRight(t);
+    }
+    if (b<-1) {
+        if (balance(t->right)>0)
+            t->right = rotateRight(t->right);
+        return rotateLeft(t);
+    }
+    return t;
+}
+
+TxNode* TxPlan::insert(TxNode* t, int key, int val, bool& done) {
+    if (t==NULL) {
+        done = true;
+        return fresh(key, val);
+    }
+    expand(t);
+    if (key<t->key)
+        t->left = insert(t->left, key, val, done);
+    else if (key>t->key)
+        t->right = insert(t->right, key, val, done);
+    else
+        return t;
+    return done ? rebalance(t) : t;
+}
+
+TxNode* TxPlan::eraseMin(TxNode* t, TxNode*& min) {
+    expand(t);
+    if (t->left==NULL) {
+        min = t;
+        return t->right;
+    }
+    t->left = eraseMin(t->left, min);
+    return rebalance(t);
+}
+
+// A node with two children takes its successor's key and value, and the
+// successor is erased instead, as in eraseTwoChild
+TxNode* TxPlan::erase(TxNode* t, int key, bool& done) {
+    if (t==NULL)
+        return NULL;
+    expand(t);
+    if (key<t->key)
+        t->left = erase(t->left, key, done);
+    else if (key>t->key)
+        t->right = erase(t->right, key, done);
+    else {
+        done = true;
+        if (t->left==NULL || t->right==NULL) {
+            t->erased = true;
+            return t->left!=NULL ? t->left : t->right;
+        }
+        TxNode* s;
+        t->right = eraseMin(t->right, s);
+        t->key = s->key;
+        setValue(t, value(s));
+        s->erased = true;
+    }
+    return done ? rebalance(t) : t;
+}
+
+bool TxPlan::apply(const AVLTree::TxOp& op) {
+    bool done = false;
+    switch (op.kind) {
+        case AVLTree::TxOp::INSERT:
+            if (!inRange(op.key))
+                return false;
+            holder->right = insert(holder->right, op.key, op.arg, done);
+            return done;
+        case AVLTree::TxOp::ERASE:
+            holder->right = erase(holder->right, op.key, done);
+            return done;
+        case AVLTree::TxOp::SET: {
+            TxNode* t = find(op.key);
+            if (t==NULL)
+                return false;
+            setValue(t, op.arg);
+            return true;
+        }
+        case AVLTree::TxOp::MOVE: {
+            TxNode* t = find(op.key);
+            if (t==NULL)
+                return false;
+            if (op.key==op.arg)
+                return true;
+            if (find(op.arg)!=NULL)
+                return false;
+            if (!inRange(op.arg))
+                return false;
+            int v = value(t);
+            bool inserted = false;
+            holder->right = erase(holder->right, op.key, done);
+            holder->right = insert(holder->right, op.arg, v, inserted);
+            return true;
+        }
+        case AVLTree::TxOp::SWAP: {
+            TxNode* a = find(op.key);
+            TxNode* b = find(op.arg);
+            if (a==NULL || b==NULL)
+                return false;
+            int v = value(a);
+            setValue(a, value(b));
+            setValue(b, v);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Call add(word, old, new) for every word read, each checked against the
+// value read without being written
+template <typename Add>
+void TxPlan::forEachCheck(Add add) {
+    for (TxNode& t : nodes) {
+        if (t.orig==NULL)
+            continue;
+        if (t.expanded || t.valRead)
+            add(&t.orig->ver, t.ver, t.ver);
+        if (t.valRead)
+            add(&t.orig->val, t.origVal, t.origVal);
+    }
+}
+
+size_t TxPlan::validateEntries() {
+    size_t n = 0;
+    forEachCheck([&n](auto, auto, auto) { n++; });
+    return n;
+}
+
+// Check everything read without writing, to confirm a failed condition
+bool TxPlan::validate() {
+    kcas::start();
+    forEachCheck([](auto word, auto oldVal, auto newVal) { kcas::add(word, oldVal, newVal); });
+    return kcas::execute();
+}
+
+// Link every node of the final tree to its parent and allocate the nodes
+// of inserted keys, which stay private until the KCAS publishes them
+void TxPlan::prepare() {
+    std::vector<TxNode*> stack = {holder};
+    while (!stack.empty()) {
+        TxNode* t = stack.back();
+        stack.pop_back();
+        for (TxNode* c : {t->left, t->right}) {
+            if (c==NULL)
+                continue;
+            c->parent = t;
+            if (c->expanded)
+                stack.push_back(c);
+        }
+    }
+    for (TxNode& t : nodes) {
+        if (t.orig!=NULL)
+            t.real = t.orig;
+        else if (!t.erased)
+            t.real = new Node(t.key, t.val, NULL);
+    }
+}
+
+// Call add(word, old, new) for every word of the commit KCAS
+template <typename Add>
+void TxPlan::forEachWrite(Add add) {
+    auto real = [](TxNode* t) { return t==NULL ? (Node*)NULL : t->real; };
+    for (TxNode& t : nodes) {
+        if (t.erased) {
+            if (t.orig!=NULL)
+                add(&t.orig->ver, t.ver, t.ver+1);
+            continue;
+        }
+        if (t.orig==NULL)
+            continue;
+        Node* n = t.orig;
+        bool changed = false;
+        if (t.expanded) {
+            if (real(t.left)!=t.origLeft) {
+                add(&n->left, t.origLeft, real(t.left));
+                changed = true;
+            }
+            if (real(t.right)!=t.origRight) {
+                add(&n->right, t.origRight, real(t.right));
+                changed = true;
+            }
+            if (t.key!=t.origKey) {
+                add(&n->key, t.origKey, t.key);
+                changed = true;
+            }
+            if (&t!=holder && t.height!=t.origHeight) {
+                add(&n->height, t.origHeight, t.height);
+                changed = true;
+            }
+        }
+        if (&t!=holder && real(t.parent)!=t.origParent) {
+            add(&n->parent, t.origParent, real(t.parent));
+            changed = true;
+        }
+        if (t.valRead)
+            add(&n->val, t.origVal, t.val);
+        if (changed)
+            add(&n->ver, t.ver, t.ver+2);
+        else if (t.expanded || t.valRead)
+            add(&n->ver, t.ver, t.ver);
+    }
+}
+
+size_t TxPlan::commitEntries() {
+    size_t n = 0;
+    forEachWrite([&n](auto, auto, auto) { n++; });
+    return n;
+}
+
+bool TxPlan::commit() {
+    auto real = [](TxNode* t) { return t==NULL ? (Node*)NULL : t->real; };
+    for (TxNode& t : nodes) {
+        if (t.orig!=NULL || t.erased)
+            continue;
+        t.real->left.setInitVal(real(t.left));
+        t.real->right.setInitVal(real(t.right));
+        t.real->parent.setInitVal(real(t.parent));
+        t.real->height.setInitVal(t.height);
+    }
+    kcas::start();
+    forEachWrite([](auto word, auto oldVal, auto newVal) { kcas::add(word, oldVal, newVal); });
+    committed = kcas::execute();
+    return committed;
+}
+
+}
+
+bool AVLTree::transact(const std::vector<TxOp>& ops) {
+    while (true) {
+        TxPlan plan(minRoot);
+        bool ok = true;
+        for (const TxOp& op : ops) {
+            if (!plan.apply(op)) {
+                ok = false;
+                break;
+            }
+        }
+        // A plan too large for one descriptor is refused before its KCAS
+        // starts, whatever its conditions
+        if (!ok) {
+            if (plan.validateEntries()>KCAS_MAX_ENTRIES || plan.validate())
+                return false;
+            continue;
+        }
+        plan.prepare();
+        if (plan.commitEntries()>KCAS_MAX_ENTRIES)
+            return false;
+        if (plan.commit())
+            return true;
+    }
+}
+
+bool AVLTree::move(int from, int to) {
+    return transact({{TxOp::MOVE, from, to}});
+}
+
+bool AVLTree::swap(int a, int b) {
+    return transact({{TxOp::SWAP, a, b}});
+}
+
+bool AVLTree::insertAll(const int* keys, size_t n) {
+    std::vector<TxOp> ops;
+    for (size_t i = 0; i<n; i++)
+        ops.push_back({TxOp::INSERT, keys[i], 0});
+    return transact(ops);
+}
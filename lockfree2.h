@@ -1,11 +1,16 @@
 #pragma once
 #include <vector>
+#include <algorithm>
 #include <cassert>
 #include <stdint.h>
 #include <sstream>
 #include <cstring>
 #include <immintrin.h>
 #include <limits.h>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include "coroutine.h"
 
 
 #define CASWORD_BITS_TYPE casword_t
@@ -13,6 +18,13 @@
 #define SHIFT_BITS 2
 #define CASWORD_CAST(x) ((CASWORD_BITS_TYPE) (x))
 
+// Value words zero-extend, so negative ints keep clear of the top bits the
+// shift and the descriptor tags use, and read back unchanged
+template <typename T>
+inline casword_t caswordBits(T* p) { return CASWORD_CAST(p); }
+template <typename T>
+inline casword_t caswordBits(T v) { return CASWORD_CAST((typename std::make_unsigned<T>::type)v); }
+
 
 
 
@@ -172,7 +184,10 @@ typedef intptr_t seqbits_t;
 #define kcastagptr_t uintptr_t
 #define rdcsstagptr_t uintptr_t
 #define rdcssptr_t rdcssdesc_t*
-#define kcasptr_t kcasdesc_t<100000>*
+// Entries of one KCAS descriptor: the most words a single KCAS, such as the
+// one a transaction commits, can cover
+#define KCAS_MAX_ENTRIES 100000
+#define kcasptr_t kcasdesc_t<KCAS_MAX_ENTRIES>*
 #define RDCSS_TAGBIT 0x1
 #define KCAS_TAGBIT 0x2
 
@@ -192,7 +207,8 @@ typedef intptr_t seqbits_t;
 class TIDGenerator {
 public:
     int myslot = -1;
-    void * volatile thread_ids[KCAS_MAX_THREADS] = {};
+    // Shared by every thread's generator, so that no two threads take the same slot
+    static inline void * volatile thread_ids[KCAS_MAX_THREADS] = {};
     inline TIDGenerator() {
 	    int i;
         while (true) {
@@ -458,19 +474,13 @@ bool KCASHTM<MAX_K>::help(kcastagptr_t tagptr, kcasptr_t snapshot, bool helpingO
     return succeeded;
 }
 
-// TODO: replace crappy bubblesort with something fast for large MAX_K (maybe even use insertion sort for small MAX_K)
+// Sort by address so that helpers lock words in one global order. Transactions
+// make descriptors long enough for a quadratic sort to dominate execute().
 template <int MAX_K>
 static void kcasdesc_sort(kcasptr_t ptr) {
-    kcasentry_t temp;
-    for (int i = 0; i < ptr->numEntries; i++) {
-        for (int j = 0; j < ptr->numEntries - i - 1; j++) {
-            if (ptr->entries[j].addr > ptr->entries[j + 1].addr) {
-                temp = ptr->entries[j];
-                ptr->entries[j] = ptr->entries[j + 1];
-                ptr->entries[j + 1] = temp;
-            }
-        }
-    }
+    std::sort(ptr->entries, ptr->entries + ptr->numEntries, [](const kcasentry_t& a, const kcasentry_t& b) {
+        return a.addr < b.addr;
+    });
 }
 
 template <int MAX_K>
@@ -579,7 +589,7 @@ casword<T>::casword(){
 
 
 namespace kcas {
-    extern KCASHTM<100000> instance;
+    extern KCASHTM<KCAS_MAX_ENTRIES> instance;
 
     void writeInitPtr(uintptr_t volatile * addr, uintptr_t const newval);
     void writeInitVal(uintptr_t volatile * addr, uintptr_t const newval);
@@ -605,7 +615,7 @@ T casword<T>::setInitVal(T other) {
 	bits = CASWORD_CAST(other);
     }
     else {
-	bits = CASWORD_CAST(other);
+	bits = caswordBits(other);
 	assert((bits & 0xE000000000000000) == 0);
 	bits = bits << SHIFT_BITS;
     }
@@ -642,8 +652,8 @@ T casword<T>::getValue(){
 template <typename T>
 void casword<T>::addToDescriptor(T oldVal, T newVal){
     auto descriptor = kcas::instance.getDescriptor();
-    auto c_oldVal = (casword_t)oldVal;
-    auto c_newVal = (casword_t)newVal;
+    auto c_oldVal = caswordBits(oldVal);
+    auto c_newVal = caswordBits(newVal);
     assert(((c_oldVal & 0xE000000000000000) == 0) && ((c_newVal & 0xE000000000000000) == 0));
 
     if(std::is_pointer<T>::value){
@@ -684,16 +694,62 @@ public:
     casword<Node*> minRoot;
     
     bool search(int k);
+#ifdef __cpp_impl_coroutine
+    LookupTask searchCoro(int k);
+#endif
     bool insert(int k);
     bool deleteNode(int k);
+    bool bulkLoad(const int* sorted, size_t n);
+
+    // Map operations on the value word of every key; insert maps to 0.
+    // Keys must lie strictly between the sentinel keys: others are never
+    // present, and compute leaves them unmapped.
+    std::optional<int> get(int k);
+    // Returns the value already mapped, in which case the tree is unchanged
+    std::optional<int> putIfAbsent(int k, int v);
+    bool replace(int k, int expected, int desired);
+    // Atomically map k to fn(current value, nullopt if absent) and return the
+    // new value. fn is retried along with the KCAS, so it must have no side
+    // effects.
+    int compute(int k, const std::function<int(std::optional<int>)>& fn);
+
+    // One operation of a transaction
+    struct TxOp {
+        enum Kind {INSERT, ERASE, SET, MOVE, SWAP};
+        Kind kind;
+        int key;
+        // The value for INSERT and SET, the second key for MOVE and SWAP
+        int arg;
+    };
+    // Apply ops in order, all or nothing, as one KCAS. INSERT needs key
+    // absent, ERASE and SET need it present; MOVE erases key and inserts arg
+    // with key's value, SWAP exchanges the values of key and arg. Returns
+    // false, leaving the tree unchanged, if any op's condition fails. Also
+    // returns false, leaving the tree unchanged, if the KCAS would cover
+    // more than KCAS_MAX_ENTRIES words. A touched node takes at most seven,
+    // so a transaction that touches up to 14000 nodes always fits.
+    bool transact(const std::vector<TxOp>& ops);
+    bool move(int from, int to);
+    bool swap(int a, int b);
+    // Insert every key as one transaction, so at most as many keys as the
+    // KCAS_MAX_ENTRIES bound of transact allows
+    bool insertAll(const int* keys, size_t n);
 
     AVLTree();
     ~AVLTree();
 private:
     std::tuple<Node*, uint64_t, Node*, uint64_t, bool> searchHelper(int key);
+    Node* buildHelper(const int* sorted, size_t lo, size_t hi, Node* parent, int depth);
     bool validatePath(std::vector<Node*> path, std::vector<uint64_t> vers, size_t sz);
+    // Decides the write of one update from the current value, nullptr if
+    // the key is absent: returns false to leave the tree as it is
+    typedef std::function<bool(const int* current, int& next)> Update;
+    bool applyUpdate(int k, const Update& update);
     bool insertIfAbsent(int k, int val);
     bool isMarked(uint64_t ver);
+    // Whether k lies strictly between the sentinel keys, the only keys the
+    // tree can hold; any other key would find a sentinel
+    bool isKey(int k);
     bool erase(int k);
     bool eraseTwoChild(Node* n, uint64_t nVer, Node* p, uint64_t pVer);
     bool eraseSimple(int key, Node* n, uint64_t nVer, Node* p, uint64_t pVer);
@@ -0,0 +1,47 @@
+#pragma once
+#include <thread>
+#include <utility>
+
+// Subproblems smaller than this are not worth a thread of their own
+#define FORK_GRAIN 4096
+// AVL subtrees of at most this height hold at most about FORK_GRAIN keys
+#define FORK_GRAIN_HEIGHT 12
+// Update batches smaller than this are applied on the calling thread; each
+// update costs a full split and join, so the grain is finer than FORK_GRAIN
+#define BATCH_GRAIN 256
+// Lookups that searchBatch keeps in flight at once. Each lane stalls on one
+// cache miss per level, so this many lanes overlap that many DRAM misses
+#define SEARCH_GROUP 16
+
+/*
+ * Fork-join for divide-and-conquer over subtrees: while depth > 0 the left
+ * half runs on a new thread and the right half on the caller, otherwise both
+ * run inline. Callers pass depth - 1 down to the halves, so the total number
+ * of threads is bounded by 2^depth.
+ */
+template <typename Left, typename Right>
+void forkJoin(int depth, Left&& left, Right&& right) {
+    if (depth <= 0) {
+        left();
+        right();
+        return;
+    }
+    std::thread t(std::forward<Left>(left));
+    right();
+    t.join();
+}
+
+/*
+ * Fork depth that yields about one leaf task per thread, for numThreads
+ * threads or one per hardware thread by default
+ */
+inline int forkDepth(unsigned int numThreads) {
+    int depth = 0;
+    while ((1u << depth) < numThreads)
+        depth++;
+    return depth;
+}
+
+inline int forkDepth() {
+    return forkDepth(std::thread::hardware_concurrency());
+}
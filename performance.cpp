@@ -3,16 +3,36 @@
 #include "finegrained.h"
 // #include "lockfree2.h"
 #include "lockfree.h"
+#include "flatcombining.h"
+#include "sharded.h"
+#include "catree.h"
+#include "delegation.h"
+#include "rcu.h"
+#include "bptree.h"
+#include "frozen.h"
+#include "compact.h"
+#include <malloc.h>
+#include "hugepage.h"
+#include "stringkey.h"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
 using namespace std;
 
-// Coarse-grained: IMPL=1, fine-grained: IMPL=2, lock-free: IMPL=3
+// Coarse-grained: IMPL=1, fine-grained: IMPL=2, lock-free: IMPL=3, flat-combining coarse-grained: IMPL=5,
+// contention-adapting: IMPL=6, RCU: IMPL=7, B+-tree: IMPL=8
 int IMPL;
 
 AVLTreeCG *treeCG;
 AVLTreeFG *treeFG;
 // AVLTree *treeLF;
 AVLTreeLF *treeBST;
+AVLTreeFC *treeFC;
+AVLTreeCA *treeCA;
+AVLTreeRCU *treeRCU;
+BPlusTreeOLC *treeBP;
 
 /* UTILITY FUNCTIONS */
 void printImpl() {
@@ -20,6 +40,10 @@ void printImpl() {
     if (IMPL == 2) printf("Fine-Grained AVL Tree\n");
     // if (IMPL == 3) printf("Lock-free AVL Tree \n");
     if (IMPL == 4) printf("Lock-free BST \n");
+    if (IMPL == 5) printf("Flat-Combining AVL Tree\n");
+    if (IMPL == 6) printf("Contention-Adapting AVL Tree\n");
+    if (IMPL == 7) printf("RCU AVL Tree\n");
+    if (IMPL == 8) printf("OLC B+-Tree\n");
 }
 
 void initTree() {
@@ -27,6 +51,10 @@ void initTree() {
     if (IMPL==2) treeFG = new AVLTreeFG();
     // if (IMPL==3) treeLF = new AVLTree();
     if (IMPL==4) treeBST = new AVLTreeLF();
+    if (IMPL==5) treeFC = new AVLTreeFC();
+    if (IMPL==6) treeCA = new AVLTreeCA();
+    if (IMPL==7) treeRCU = new AVLTreeRCU();
+    if (IMPL==8) treeBP = new BPlusTreeOLC();
     printf("Tree initialized\n");
 }
 
@@ -35,6 +63,10 @@ void deleteTree() {
     if (IMPL==2) delete treeFG;
     // if (IMPL==3) delete treeLF;
     if (IMPL==4) delete treeBST;    
+    if (IMPL==5) delete treeFC;
+    if (IMPL==6) delete treeCA;
+    if (IMPL==7) delete treeRCU;
+    if (IMPL==8) delete treeBP;
 }
 
 std::vector<int> getBlockVector(int low, int high) {
@@ -57,6 +89,10 @@ bool flexInsert(int k) {
     if (IMPL==2) return treeFG->insert(k);
     // if (IMPL==3) return treeLF->insert(k);
     if (IMPL==4) return treeBST->insert(k);
+    if (IMPL==5) return treeFC->insert(k);
+    if (IMPL==6) return treeCA->insert(k);
+    if (IMPL==7) return treeRCU->insert(k);
+    if (IMPL==8) return treeBP->insert(k);
 }
 
 bool flexDelete(int k) {
@@ -64,6 +100,10 @@ bool flexDelete(int k) {
     if (IMPL==2) return treeFG->deleteNode(k);
     // if (IMPL==3) return treeLF->deleteNode(k);
     if (IMPL==4) return treeBST->deleteNode(k);
+    if (IMPL==5) return treeFC->deleteNode(k);
+    if (IMPL==6) return treeCA->deleteNode(k);
+    if (IMPL==7) return treeRCU->deleteNode(k);
+    if (IMPL==8) return treeBP->deleteNode(k);
 }
 
 bool flexSearch(int k) {
@@ -71,8 +111,39 @@ bool flexSearch(int k) {
     if (IMPL==2) return treeFG->search(k);
     // if (IMPL==3) return treeLF->search(k);
     if (IMPL==4) return treeBST->search(k);
+    if (IMPL==5) return treeFC->search(k);
+    if (IMPL==6) return treeCA->search(k);
+    if (IMPL==7) return treeRCU->search(k);
+    if (IMPL==8) return treeBP->search(k);
 }
 
+bool flexBulkLoad(const int* sorted, size_t n) {
+    if (IMPL==1) return treeCG->bulkLoad(sorted, n);
+    if (IMPL==2) return treeFG->bulkLoad(sorted, n);
+    // if (IMPL==3) return treeLF->bulkLoad(sorted, n);
+    if (IMPL==4) return treeBST->bulkLoad(sorted, n);
+    if (IMPL==5) return treeFC->bulkLoad(sorted, n);
+    if (IMPL==6) return treeCA->bulkLoad(sorted, n);
+    if (IMPL==7) return treeRCU->bulkLoad(sorted, n);
+    if (IMPL==8) return treeBP->bulkLoad(sorted, n);
+}
+
+void flexRangeQuery(int lo, int hi, std::vector<int>& out) {
+    if (IMPL==1) treeCG->rangeQuery(lo, hi, out);
+    if (IMPL==4) treeBST->rangeQuery(lo, hi, out);
+    if (IMPL==5) treeFC->rangeQuery(lo, hi, out);
+    if (IMPL==6) treeCA->rangeQuery(lo, hi, out);
+    if (IMPL==7) treeRCU->rangeQuery(lo, hi, out);
+    if (IMPL==8) treeBP->rangeQuery(lo, hi, out);
+}
+
+#ifdef __cpp_impl_coroutine
+void flexInterleavedSearch(const int* keys, size_t n, bool* out, int depth) {
+    // if (IMPL==3) interleavedSearch(treeLF, keys, n, out, depth);
+    if (IMPL==4) interleavedSearch(treeBST, keys, n, out, depth);
+}
+#endif
+
 /* HELPER FUNCTIONS */
 void insertRange(int low, int high, std::vector<int> keyVector) {
     for (int i = low; i < min(high, (int)keyVector.size()); i++) {
@@ -259,11 +330,942 @@ void testRandom1(int numThreads, int threadCapacity, ofstream& outFile) {
     outFile << endl;
 }
 
+// Prefill cost: parallel inserts of shuffled keys against one bulkLoad of the same keys
+void testBulkLoad(int numThreads, int threadCapacity, ofstream& outFile) {
+    initTree();
+    std::vector<int> keyVector = getShuffledVector(0, numThreads * threadCapacity);
+    const double insertTime = parallelInsert(threadCapacity, numThreads, keyVector);
+    deleteTree();
+
+    initTree();
+    std::vector<int> sortedKeys = getBlockVector(0, numThreads * threadCapacity);
+    const auto startTime = std::chrono::steady_clock::now();
+    flexBulkLoad(sortedKeys.data(), sortedKeys.size());
+    const double loadTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    outFile << "Prefill of " << sortedKeys.size() << " keys: " << insertTime << " milliseconds with " << numThreads << " inserting threads, " << loadTime << " milliseconds with bulkLoad\n";
+    deleteTree();
+}
+
+// Range scans of a fixed width mixed with updates: (insert, delete, scan) = (45%, 45%, 10%)
+void rangeQueryMixRange(int low, int high, int width, int keySpace, std::vector<int> keyVector) {
+    std::vector<int> out;
+    for (int i = low; i < min(high, (int)keyVector.size()); i++) {
+        int k = keyVector[i];
+        int r = i % 20;
+        if (r < 2) flexRangeQuery(k, min(keySpace, k + width - 1), out);
+        else if (r < 11) flexInsert(k);
+        else flexDelete(k);
+    }
+}
+
+void testRangeQueryMix(int numThreads, int threadCapacity, int width, ofstream& outFile) {
+    initTree();
+    int keySpace = numThreads * threadCapacity;
+    // Prefill half of the key space so scans see a populated tree
+    std::vector<int> prefill = getShuffledVector(0, keySpace);
+    prefill.resize(keySpace / 2);
+    insertRange(0, prefill.size(), prefill);
+
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread(rangeQueryMixRange, i * threadCapacity, (i + 1) * threadCapacity, width, keySpace, std::ref(keyVector)));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    outFile << "Range scan mix (width " << width << ") for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond\n";
+    deleteTree();
+}
+
+// Full-range scans through RangeIteratorCG while one writer churns the tree
+void testScanBatch(int numThreads, int threadCapacity, int batchSize, ofstream& outFile) {
+    if (IMPL != 1) return;
+    initTree();
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+    insertRange(0, keyVector.size(), keyVector);
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> writes(0);
+    std::thread writer([&]() {
+        long n = 0;
+        for (int i = 0; !stop; i = (i + 1) % keySpace, n++) {
+            if (n % 2 == 0) treeCG->deleteNode(keyVector[i]);
+            else treeCG->insert(keyVector[i]);
+        }
+        writes = n;
+    });
+
+    std::vector<long> scanned(numThreads, 0);
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([&scanned, i, keySpace, batchSize]() {
+            RangeIteratorCG it(treeCG, 0, keySpace, batchSize);
+            int key;
+            while (it.next(key)) scanned[i]++;
+        }));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    stop = true;
+    writer.join();
+
+    long total = std::accumulate(scanned.begin(), scanned.end(), 0L);
+    outFile << "Batched scan (batch " << batchSize << ") for " << keySpace << " keys and " << numThreads << " threads: " << computeTime << " milliseconds, " << total / computeTime << " keys scanned per millisecond, " << writes / computeTime << " writer operations per millisecond\n";
+    deleteTree();
+}
+
+// Lookups of random keys where every thread keeps depth coroutine lookups in
+// flight; depth 0 runs plain searches one by one for reference
+void testInterleavedSearch(int numThreads, int threadCapacity, int depth, ofstream& outFile) {
+#ifdef __cpp_impl_coroutine
+    if (IMPL != 3 && IMPL != 4) return;
+    initTree();
+    int keySpace = numThreads * threadCapacity;
+    // Even keys are present, so half of the lookups hit
+    std::vector<int> sortedKeys(keySpace);
+    for (int i = 0; i < keySpace; i++) sortedKeys[i] = 2 * i;
+    flexBulkLoad(sortedKeys.data(), sortedKeys.size());
+    std::vector<int> keyVector = getShuffledVector(0, 2 * keySpace);
+    std::unique_ptr<bool[]> out(new bool[keyVector.size()]);
+
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([&, i]() {
+            if (depth == 0)
+                searchRange(i * threadCapacity, (i + 1) * threadCapacity, keyVector);
+            else
+                flexInterleavedSearch(keyVector.data() + i * threadCapacity, threadCapacity, out.get() + i * threadCapacity, depth);
+        }));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    outFile << "Interleaved search (depth " << depth << ") for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond\n";
+    deleteTree();
+#endif
+}
+
+// Mixed updates and lookups on a prefilled tree, (insert, delete, search) =
+// (25%, 25%, 50%), all threads running at once. For flat combining also
+// reports how many operations each combining round, and so each handoff of
+// the tree's write lock, covered on average
+void mixedRange(int low, int high, std::vector<int> keyVector) {
+    for (int i = low; i < min(high, (int)keyVector.size()); i++) {
+        int r = i % 4;
+        if (r == 0) flexInsert(keyVector[i]);
+        else if (r == 1) flexDelete(keyVector[i]);
+        else flexSearch(keyVector[i]);
+    }
+}
+
+void testCombining(int numThreads, int threadCapacity, ofstream& outFile) {
+    if (IMPL != 1 && IMPL != 5) return;
+    initTree();
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> sortedKeys(keySpace / 2);
+    for (int i = 0; i < keySpace / 2; i++) sortedKeys[i] = 2 * i;
+    flexBulkLoad(sortedKeys.data(), sortedKeys.size());
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread(mixedRange, i * threadCapacity, (i + 1) * threadCapacity, std::ref(keyVector)));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    outFile << "Mixed operations for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond";
+    if (IMPL == 5)
+        outFile << ", " << (double)treeFC->combinedOps() / treeFC->combiningRounds() << " operations per combining round";
+    outFile << "\n";
+    deleteTree();
+}
+
+// The mixed workload of testCombining on a ShardedTree over the current
+// implementation, with shard boundaries taken from a 1% sample of the keys
+template <typename Impl>
+double runSharded(int numThreads, int threadCapacity, int numShards) {
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> sortedKeys(keySpace / 2);
+    for (int i = 0; i < keySpace / 2; i++) sortedKeys[i] = 2 * i;
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+    std::vector<int> sample(keyVector.begin(), keyVector.begin() + keySpace / 100 + 1);
+    ShardedTree<Impl>* tree = new ShardedTree<Impl>(numShards, sample);
+    tree->bulkLoad(sortedKeys.data(), sortedKeys.size());
+
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([&, i]() {
+            for (int j = i * threadCapacity; j < (i + 1) * threadCapacity; j++) {
+                int r = j % 4;
+                if (r == 0) tree->insert(keyVector[j]);
+                else if (r == 1) tree->deleteNode(keyVector[j]);
+                else tree->search(keyVector[j]);
+            }
+        }));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    delete tree;
+    return computeTime;
+}
+
+void testSharded(int numThreads, int threadCapacity, int numShards, ofstream& outFile) {
+    double computeTime;
+    if (IMPL == 1) computeTime = runSharded<AVLTreeCG>(numThreads, threadCapacity, numShards);
+    else if (IMPL == 2) computeTime = runSharded<AVLTreeFG>(numThreads, threadCapacity, numShards);
+    else if (IMPL == 4) computeTime = runSharded<AVLTreeLF>(numThreads, threadCapacity, numShards);
+    else return;
+    outFile << "Sharded mix (" << numShards << " shards) for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond\n";
+}
+
+// Skewed workload: 90% of the operations fall into a hot range of 1% of the
+// key space, (insert, delete, search) = (25%, 25%, 50%). When shifting is set
+// the hot range moves to a new place in each quarter of the run.
+std::vector<int> getSkewedVector(int numThreads, int threadCapacity, bool shifting) {
+    int keySpace = numThreads * threadCapacity;
+    int hotWidth = max(1, keySpace / 100);
+    std::mt19937 eng(12345);
+    std::uniform_int_distribution<> any(0, keySpace - 1);
+    std::uniform_int_distribution<> hot(0, hotWidth - 1);
+    std::vector<int> keyVector(keySpace);
+    for (int i = 0; i < keySpace; i++) {
+        int phase = shifting ? (i % threadCapacity) * 4 / threadCapacity : 0;
+        int hotStart = (keySpace / 8) + phase * (keySpace / 4);
+        keyVector[i] = eng() % 10 == 0 ? any(eng) : min(keySpace - 1, hotStart + hot(eng));
+    }
+    return keyVector;
+}
+
+template <typename Tree>
+double runSkewed(Tree* tree, int numThreads, int threadCapacity, std::vector<int>& keyVector) {
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> sortedKeys(keySpace / 2);
+    for (int i = 0; i < keySpace / 2; i++) sortedKeys[i] = 2 * i;
+    tree->bulkLoad(sortedKeys.data(), sortedKeys.size());
+
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([&, i]() {
+            for (int j = i * threadCapacity; j < (i + 1) * threadCapacity; j++) {
+                int r = j % 4;
+                if (r == 0) tree->insert(keyVector[j]);
+                else if (r == 1) tree->deleteNode(keyVector[j]);
+                else tree->search(keyVector[j]);
+            }
+        }));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// The contention-adapting tree (IMPL 6) against coarse-grained shards at
+// every static shard count (IMPL 1) on the skewed workload
+void testAdaptive(int numThreads, int threadCapacity, bool shifting, const std::vector<int>& shardCounts, ofstream& outFile) {
+    if (IMPL != 1 && IMPL != 6) return;
+    const char* name = shifting ? "Shifting skewed mix" : "Skewed mix";
+    std::vector<int> keyVector = getSkewedVector(numThreads, threadCapacity, shifting);
+    if (IMPL == 6) {
+        initTree();
+        double computeTime = runSkewed(treeCA, numThreads, threadCapacity, keyVector);
+        outFile << name << " (adaptive) for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond, " << treeCA->numBases() << " base nodes\n";
+        deleteTree();
+        return;
+    }
+    for (int numShards : shardCounts) {
+        ShardedTree<AVLTreeCG>* tree = new ShardedTree<AVLTreeCG>(numShards, getShuffledVector(0, numThreads * threadCapacity));
+        double computeTime = runSkewed(tree, numThreads, threadCapacity, keyVector);
+        outFile << name << " (" << numShards << " shards) for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond\n";
+        delete tree;
+    }
+}
+
+// The mixed workload of testCombining against numServers delegation servers,
+// with every client posting one request at a time and then batches of
+// batchSize requests; compare with IMPL 1 on the same workload
+void testDelegation(int numThreads, int threadCapacity, int numServers, int batchSize, ofstream& outFile) {
+    if (IMPL != 1) return;
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> sortedKeys(keySpace / 2);
+    for (int i = 0; i < keySpace / 2; i++) sortedKeys[i] = 2 * i;
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+    std::vector<int> sample(keyVector.begin(), keyVector.begin() + keySpace / 100 + 1);
+
+    for (int batched = 0; batched < 2; batched++) {
+        AVLTreeDG* tree = new AVLTreeDG(numServers, sample);
+        tree->bulkLoad(sortedKeys.data(), sortedKeys.size());
+        std::vector<thread> threads;
+        const auto startTime = std::chrono::steady_clock::now();
+        for (int i = 0; i < numThreads; i++) {
+            threads.push_back(std::thread([&, i]() {
+                std::vector<DelegatedOp> ops;
+                std::unique_ptr<bool[]> out(new bool[batchSize]);
+                for (int j = i * threadCapacity; j < (i + 1) * threadCapacity; j++) {
+                    int r = j % 4;
+                    DelegatedOp::Type type = r == 0 ? DelegatedOp::INSERT : r == 1 ? DelegatedOp::DELETE : DelegatedOp::SEARCH;
+                    if (!batched) {
+                        if (type == DelegatedOp::INSERT) tree->insert(keyVector[j]);
+                        else if (type == DelegatedOp::DELETE) tree->deleteNode(keyVector[j]);
+                        else tree->search(keyVector[j]);
+                        continue;
+                    }
+                    ops.push_back({keyVector[j], type});
+                    if ((int)ops.size() == batchSize || j == (i + 1) * threadCapacity - 1) {
+                        tree->execute(ops.data(), ops.size(), out.get());
+                        ops.clear();
+                    }
+                }
+            }));
+        }
+        for (int i = 0; i < numThreads; i++) {
+            threads[i].join();
+        }
+        const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+        delete tree;
+        outFile << "Delegated mix (" << numServers << " servers, " << (batched ? batchSize : 1) << " requests per call) for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond\n";
+    }
+}
+
+// Lookups on numThreads reader threads while one extra writer thread
+// alternates inserts and deletes at full speed, or stays idle when writer is
+// not set. Reports reader throughput, which for IMPL 7 should not depend on
+// the writer.
+void testReadMostly(int numThreads, int threadCapacity, bool writer, ofstream& outFile) {
+    initTree();
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> sortedKeys(keySpace / 2);
+    for (int i = 0; i < keySpace / 2; i++) sortedKeys[i] = 2 * i;
+    flexBulkLoad(sortedKeys.data(), sortedKeys.size());
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> writes(0);
+    std::thread writerThread([&]() {
+        long n = 0;
+        for (int i = 0; writer && !stop; i = (i + 1) % keySpace, n++) {
+            if (n % 2 == 0) flexInsert(keyVector[i]);
+            else flexDelete(keyVector[i]);
+        }
+        writes = n;
+    });
+    const double readTime = parallelSearch(threadCapacity, numThreads, keyVector);
+    stop = true;
+    writerThread.join();
+    outFile << "Read-mostly search" << (writer ? " with writer" : "") << " for " << threadCapacity << " capacity and " << numThreads << " threads: " << readTime << " milliseconds, " << threadCapacity * numThreads / readTime << " lookups per millisecond, " << writes / readTime << " writer operations per millisecond\n";
+    deleteTree();
+}
+
+// Mixed workload with updatePercent% updates and the rest lookups, reporting
+// how often the coarse-grained tree's speculative searches had to retry
+// under the read lock
+void testOptimisticSearch(int numThreads, int threadCapacity, int updatePercent, ofstream& outFile) {
+    if (IMPL != 1) return;
+    initTree();
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> sortedKeys(keySpace / 2);
+    for (int i = 0; i < keySpace / 2; i++) sortedKeys[i] = 2 * i;
+    flexBulkLoad(sortedKeys.data(), sortedKeys.size());
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+
+    std::atomic<long> searches(0);
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([&, i]() {
+            long n = 0;
+            for (int j = i * threadCapacity; j < (i + 1) * threadCapacity; j++) {
+                int r = j % 100;
+                if (r < updatePercent / 2) flexInsert(keyVector[j]);
+                else if (r < updatePercent) flexDelete(keyVector[j]);
+                else {
+                    flexSearch(keyVector[j]);
+                    n++;
+                }
+            }
+            searches += n;
+        }));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    outFile << "Optimistic search (" << updatePercent << "% updates) for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond, " << (double)treeCG->searchRetries() / max(1L, searches.load()) << " retries per search\n";
+    deleteTree();
+}
+
+// Updates on numThreads threads contending for the coarse-grained tree's
+// write lock. Every thread runs until the first one finishes its
+// threadCapacity operations, so the per-thread counts show how evenly the
+// lock was shared: fairness is Jain's index over them (1 when perfectly
+// even, 1/numThreads when one thread got everything).
+template <typename Tree>
+void runLockFairness(const char* lockName, int numThreads, int threadCapacity, ofstream& outFile) {
+    Tree* tree = new Tree();
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> sortedKeys(keySpace / 2);
+    for (int i = 0; i < keySpace / 2; i++) sortedKeys[i] = 2 * i;
+    tree->bulkLoad(sortedKeys.data(), sortedKeys.size());
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+
+    std::atomic<bool> stop(false);
+    std::vector<long> counts(numThreads);
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([&, i]() {
+            long n = 0;
+            for (int j = i * threadCapacity; j < (i + 1) * threadCapacity && !stop.load(std::memory_order_relaxed); j++, n++) {
+                if (j % 2 == 0) tree->insert(keyVector[j]);
+                else tree->deleteNode(keyVector[j]);
+            }
+            stop = true;
+            counts[i] = n;
+        }));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    delete tree;
+    double sum = 0, sumSquares = 0;
+    for (long n : counts) {
+        sum += n;
+        sumSquares += (double)n * n;
+    }
+    outFile << "Write lock " << lockName << " for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << sum / computeTime << " operations per millisecond, fairness " << sum * sum / (numThreads * sumSquares) << ", min/max operations per thread " << *std::min_element(counts.begin(), counts.end()) << "/" << *std::max_element(counts.begin(), counts.end()) << "\n";
+}
+
+void testLockFairness(int numThreads, int threadCapacity, ofstream& outFile) {
+    if (IMPL != 1) return;
+    runLockFairness<AVLTreeCG>("std::mutex", numThreads, threadCapacity, outFile);
+    runLockFairness<AVLTreeCGMCS>("MCS", numThreads, threadCapacity, outFile);
+    runLockFairness<AVLTreeCGCLH>("CLH", numThreads, threadCapacity, outFile);
+    runLockFairness<AVLTreeCGCohort>("cohort", numThreads, threadCapacity, outFile);
+}
+
+// Lookups of numThreads * threadCapacity keys, half of them present, in the
+// coarse-grained tree and then in frozen copies of it in both layouts.
+// Also reports how long freezing and thawing back into a tree take.
+void testFrozenSearch(int numThreads, int threadCapacity, ofstream& outFile) {
+    if (IMPL != 1) return;
+    initTree();
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> sortedKeys(keySpace);
+    for (int i = 0; i < keySpace; i++) sortedKeys[i] = 2 * i;
+    flexBulkLoad(sortedKeys.data(), sortedKeys.size());
+    std::vector<int> keyVector = getShuffledVector(0, 2 * keySpace);
+
+    const double treeTime = parallelSearch(threadCapacity, numThreads, keyVector);
+    outFile << "Tree search over " << keySpace << " keys for " << threadCapacity << " capacity and " << numThreads << " threads: " << treeTime << " milliseconds, " << threadCapacity * numThreads / treeTime << " operations per millisecond\n";
+    for (FrozenTree::Layout layout : {FrozenTree::EYTZINGER, FrozenTree::VEB}) {
+        const char* name = layout == FrozenTree::EYTZINGER ? "Eytzinger" : "vEB";
+        auto freezeStart = std::chrono::steady_clock::now();
+        FrozenTree* frozen = freeze(*treeCG, layout);
+        const double freezeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - freezeStart).count();
+
+        std::vector<thread> threads;
+        const auto startTime = std::chrono::steady_clock::now();
+        for (int i = 0; i < numThreads; i++) {
+            threads.push_back(std::thread([&, i]() {
+                for (int j = i * threadCapacity; j < (i + 1) * threadCapacity; j++)
+                    frozen->search(keyVector[j]);
+            }));
+        }
+        for (int i = 0; i < numThreads; i++) {
+            threads[i].join();
+        }
+        const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+
+        AVLTreeCG* thawed = new AVLTreeCG();
+        auto thawStart = std::chrono::steady_clock::now();
+        thaw(*frozen, *thawed);
+        const double thawTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - thawStart).count();
+        delete thawed;
+        outFile << "Frozen " << name << " search over " << keySpace << " keys for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond, " << (double)frozen->bytes() / keySpace << " bytes per key, freeze " << freezeTime << ", thaw " << thawTime << "\n";
+        delete frozen;
+    }
+    deleteTree();
+}
+
+// Heap bytes in use, to charge each tree for its nodes and allocator
+// overhead; large blocks such as arena chunks are mmap'ed and counted apart
+size_t heapInUse() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+// Build a tree of numThreads * threadCapacity keys by random inserts, then
+// look up as many keys, half of them present, on numThreads threads.
+template <typename Tree>
+void runCompact(const char* name, int numThreads, int threadCapacity, std::vector<int>& insertOrder, std::vector<int>& keyVector, ofstream& outFile) {
+    int keySpace = numThreads * threadCapacity;
+    size_t heapBefore = heapInUse();
+    Tree* tree = new Tree();
+    for (int k : insertOrder)
+        tree->insert(2 * k);
+    const double bytesPerKey = (double)(heapInUse() - heapBefore) / keySpace;
+
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([&, i]() {
+            for (int j = i * threadCapacity; j < (i + 1) * threadCapacity; j++)
+                tree->search(keyVector[j]);
+        }));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    delete tree;
+    outFile << name << " search for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond, " << bytesPerKey << " bytes per key\n";
+}
+
+void testCompact(int numThreads, int threadCapacity, ofstream& outFile) {
+    if (IMPL != 1) return;
+    std::vector<int> insertOrder = getShuffledVector(0, numThreads * threadCapacity);
+    std::vector<int> keyVector = getShuffledVector(0, 2 * numThreads * threadCapacity);
+    runCompact<AVLTreeCG>("Pointer node", numThreads, threadCapacity, insertOrder, keyVector, outFile);
+    runCompact<AVLTreeCompact>("Compact node", numThreads, threadCapacity, insertOrder, keyVector, outFile);
+}
+
+// Lookups of numThreads * threadCapacity random keys, half of them present
+template <typename Tree>
+double timeSearch(Tree* tree, int numThreads, int threadCapacity, std::vector<int>& keyVector) {
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread([&, i]() {
+            for (int j = i * threadCapacity; j < (i + 1) * threadCapacity; j++)
+                tree->search(keyVector[j]);
+        }));
+    }
+    for (int i = 0; i < numThreads; i++) {
+        threads[i].join();
+    }
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Fill a tree with the even keys, then churn it: delete every even key and
+// insert an odd one in its place, in unrelated random orders, so each new
+// node lands in the heap slot of a node from elsewhere in the tree. Lookups
+// run on the churned tree, again after compact(), and on a bulk-loaded tree
+// of the same keys for reference.
+template <typename Tree>
+void runCompaction(const char* name, int numThreads, int threadCapacity, ofstream& outFile) {
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> insertOrder = getShuffledVector(0, keySpace);
+    std::vector<int> deleteOrder = getShuffledVector(0, keySpace);
+    std::vector<int> churnOrder = getShuffledVector(0, keySpace);
+    std::vector<int> keyVector = getShuffledVector(0, 2 * keySpace);
+    Tree* tree = new Tree();
+    for (int k : insertOrder)
+        tree->insert(2 * k);
+    for (int i = 0; i < keySpace; i++) {
+        tree->deleteNode(2 * deleteOrder[i]);
+        tree->insert(2 * churnOrder[i] + 1);
+    }
+
+    const double churnedTime = timeSearch(tree, numThreads, threadCapacity, keyVector);
+    outFile << name << " churned search for " << threadCapacity << " capacity and " << numThreads << " threads: " << churnedTime << " milliseconds, " << threadCapacity * numThreads / churnedTime << " operations per millisecond\n";
+
+    auto compactStart = std::chrono::steady_clock::now();
+    tree->compact();
+    const double compactTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - compactStart).count();
+    const double compactedTime = timeSearch(tree, numThreads, threadCapacity, keyVector);
+    outFile << name << " compacted search for " << threadCapacity << " capacity and " << numThreads << " threads: " << compactedTime << " milliseconds, " << threadCapacity * numThreads / compactedTime << " operations per millisecond, compact " << compactTime << "\n";
+    delete tree;
+
+    std::vector<int> sortedKeys(keySpace);
+    for (int i = 0; i < keySpace; i++) sortedKeys[i] = 2 * i + 1;
+    tree = new Tree();
+    tree->bulkLoad(sortedKeys.data(), sortedKeys.size());
+    const double freshTime = timeSearch(tree, numThreads, threadCapacity, keyVector);
+    outFile << name << " bulk-loaded search for " << threadCapacity << " capacity and " << numThreads << " threads: " << freshTime << " milliseconds, " << threadCapacity * numThreads / freshTime << " operations per millisecond\n";
+    delete tree;
+}
+
+void testCompaction(int numThreads, int threadCapacity, ofstream& outFile) {
+    if (IMPL != 1) return;
+    runCompaction<AVLTreeCG>("Coarse-grained", numThreads, threadCapacity, outFile);
+    runCompaction<AVLTree>("Sequential", numThreads, threadCapacity, outFile);
+}
+
+// One perf event counted in this process and in every thread it starts
+// from now on, for user space only. value() is -1 when the kernel or the
+// machine does not provide the event, as in many VMs.
+class PerfCounter {
+public:
+    PerfCounter(uint32_t type, uint64_t config) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    ~PerfCounter() {
+        if (fd >= 0) close(fd);
+    }
+
+    long long value() {
+        long long count;
+        if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+            return -1;
+        return count;
+    }
+
+private:
+    int fd;
+};
+
+static uint64_t dtlbReadEvent(uint64_t result) {
+    return PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+}
+
+// Anonymous memory of this process currently backed by transparent huge pages
+size_t anonHugeBytes() {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(smaps, line)) {
+        size_t kb;
+        if (sscanf(line.c_str(), "AnonHugePages: %zu kB", &kb) == 1)
+            return kb * 1024;
+    }
+    return 0;
+}
+
+// Random lookups in a tree of numThreads * threadCapacity keys built by
+// random inserts, with nodes from the global allocator and then from
+// HugePagePool. Reports the dTLB miss rate of the lookups where the machine
+// has the counters, plus the page faults taken while building and how much
+// memory ended up on huge pages, which show whether the kernel granted them.
+// The pool keeps its regions, so later runs in the same process reuse them.
+void testHugePages(int numThreads, int threadCapacity, bool hugeTLB, ofstream& outFile) {
+    for (bool huge : {false, true}) {
+        if (huge)
+            HugePagePool::enable(hugeTLB);
+        initTree();
+        std::vector<int> keyVector = getShuffledVector(0, numThreads * threadCapacity);
+        long long faultCount;
+        {
+            PerfCounter faults(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+            parallelInsert(threadCapacity, numThreads, keyVector);
+            faultCount = faults.value();
+        }
+        keyVector = getShuffledVector(0, numThreads * threadCapacity);
+        const size_t hugeBytes = anonHugeBytes();
+
+        PerfCounter misses(PERF_TYPE_HW_CACHE, dtlbReadEvent(PERF_COUNT_HW_CACHE_RESULT_MISS));
+        PerfCounter loads(PERF_TYPE_HW_CACHE, dtlbReadEvent(PERF_COUNT_HW_CACHE_RESULT_ACCESS));
+        const double computeTime = parallelSearch(threadCapacity, numThreads, keyVector);
+        long long missCount = misses.value(), loadCount = loads.value();
+
+        outFile << (huge ? "Huge-page" : "Default") << " node search for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond, ";
+        if (missCount < 0)
+            outFile << "dTLB counters unavailable";
+        else
+            outFile << (double)missCount / (threadCapacity * numThreads) << " dTLB misses per lookup, " << (loadCount > 0 ? 100.0 * missCount / loadCount : 0) << "% of dTLB loads";
+        outFile << ", " << faultCount << " page faults while building, " << hugeBytes / 1048576 << " MB of the process on huge pages\n";
+        deleteTree();
+        HugePagePool::disable();
+    }
+}
+
+struct Payload64 {
+    uint64_t words[8];
+};
+
+// The mixed workload of testCombining on a map: put, remove and get of
+// keys drawn from keyOf(0 .. keySpace), half of them present at the start.
+// AVLTreeCG, the <int, Unit> instance, runs it as an int set for reference.
+template <typename Map, typename Key, typename Value>
+void runMap(const char* name, int numThreads, int threadCapacity, Key (*keyOf)(int), ofstream& outFile) {
+    int keySpace = numThreads * threadCapacity;
+    Map* map = new Map();
+    std::vector<int> insertOrder = getShuffledVector(0, keySpace / 2);
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+    for (int i : insertOrder)
+        map->put(keyOf(2 * i), Value());
+
+    // The map is all inline, so lookup results must be used or the
+    // compiler drops the lookups
+    std::atomic<size_t> hits(0);
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            size_t found = 0;
+            for (int i = t * threadCapacity; i < (t + 1) * threadCapacity; i++) {
+                Key key = keyOf(keyVector[i]);
+                int r = i % 4;
+                if (r == 0) map->put(key, Value());
+                else if (r == 1) map->remove(key);
+                else found += map->get(key).has_value();
+            }
+            hits += found;
+        }));
+    }
+    for (int t = 0; t < numThreads; t++) {
+        threads[t].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    delete map;
+    outFile << name << " mixed operations for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond, " << sizeof(typename Map::Node) << "-byte nodes\n";
+}
+
+static int intKey(int i) {
+    return i;
+}
+
+// Spread the keys over the whole 64-bit range like hashed IDs, keeping them
+// distinct
+static uint64_t idKey(int i) {
+    return (uint64_t)i * 0x9e3779b97f4a7c15ull;
+}
+
+void testMap(int numThreads, int threadCapacity, ofstream& outFile) {
+    if (IMPL != 1) return;
+    runMap<AVLTreeCG, int, Unit>("Int set", numThreads, threadCapacity, intKey, outFile);
+    runMap<AVLMapCG<uint64_t, uint64_t>, uint64_t, uint64_t>("64-bit map with 8-byte values", numThreads, threadCapacity, idKey, outFile);
+    runMap<AVLMapCG<uint64_t, Payload64>, uint64_t, Payload64>("64-bit map with 64-byte values", numThreads, threadCapacity, idKey, outFile);
+}
+
+// URL-like keys: a shared scheme, one of a thousand hosts, a section and a
+// unique id, so keys under one host tie on most of their inline prefix
+std::vector<std::string> getUrlKeys(int n) {
+    std::mt19937 g(1);
+    std::vector<std::string> hosts(1000);
+    for (std::string& host : hosts)
+        for (int len = 5 + g() % 8; len > 0; len--)
+            host.push_back('a' + g() % 26);
+    const char* sections[] = {"users", "items", "posts", "search"};
+    std::vector<std::string> keys(n);
+    for (int i = 0; i < n; i++)
+        keys[i] = "https://" + hosts[g() % hosts.size()] + ".example.com/" + sections[g() % 4] + "/" + std::to_string(i);
+    return keys;
+}
+
+// Random version 4 UUIDs in the usual 36-character form
+std::vector<std::string> getUuidKeys(int n) {
+    std::mt19937_64 g(1);
+    std::vector<std::string> keys(n);
+    char buf[40];
+    for (int i = 0; i < n; i++) {
+        uint64_t hi = g(), lo = g();
+        snprintf(buf, sizeof(buf), "%08x-%04x-4%03x-%04x-%012llx", (unsigned)(hi >> 32), (unsigned)(hi >> 16) & 0xffff, (unsigned)hi & 0xfff, (((unsigned)(lo >> 48) & 0x3fff) | 0x8000), (unsigned long long)lo & 0xffffffffffffull);
+        keys[i] = buf;
+    }
+    return keys;
+}
+
+// Lookups of all numThreads * threadCapacity keys, half of them present,
+// in a map keyed by Key, which is std::string or StringKey
+template <typename Key>
+void runStringMap(const char* name, std::vector<std::string>& keys, int numThreads, int threadCapacity, ofstream& outFile) {
+    int keySpace = numThreads * threadCapacity;
+    AVLMapCG<Key, uint64_t>* map = new AVLMapCG<Key, uint64_t>();
+    std::vector<int> insertOrder = getShuffledVector(0, keySpace / 2);
+    for (int i : insertOrder)
+        map->put(Key(keys[2 * i]), i);
+    std::vector<int> keyVector = getShuffledVector(0, keySpace);
+
+    std::atomic<size_t> hits(0);
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            size_t found = 0;
+            for (int i = t * threadCapacity; i < (t + 1) * threadCapacity; i++) {
+                if constexpr (std::is_same<Key, StringKey>::value) found += map->get(StringKey::borrow(keys[keyVector[i]])).has_value();
+                else found += map->get(keys[keyVector[i]]).has_value();
+            }
+            hits += found;
+        }));
+    }
+    for (int t = 0; t < numThreads; t++) {
+        threads[t].join();
+    }
+    const double computeTime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+    delete map;
+    outFile << name << " search for " << threadCapacity << " capacity and " << numThreads << " threads: " << computeTime << " milliseconds, " << threadCapacity * numThreads / computeTime << " operations per millisecond\n";
+}
+
+void testStringKeys(int numThreads, int threadCapacity, ofstream& outFile) {
+    if (IMPL != 1) return;
+    std::vector<std::string> urls = getUrlKeys(numThreads * threadCapacity);
+    runStringMap<std::string>("URL std::string", urls, numThreads, threadCapacity, outFile);
+    runStringMap<StringKey>("URL StringKey", urls, numThreads, threadCapacity, outFile);
+    std::vector<std::string> uuids = getUuidKeys(numThreads * threadCapacity);
+    runStringMap<std::string>("UUID std::string", uuids, numThreads, threadCapacity, outFile);
+    runStringMap<StringKey>("UUID StringKey", uuids, numThreads, threadCapacity, outFile);
+}
+
+// Queries answered by walking the tree in order, the way rank, select and
+// countRange had to be computed before subtree sizes: ORDER_SCAN_QUERIES in
+// total across the threads, since each costs O(n)
+#define ORDER_SCAN_QUERIES 1000
+
+// Visit the keys of the subtree at node from lo upwards in ascending order
+// while visit returns true
+template <typename Node, typename Visit>
+void walkInOrder(Node* node, int lo, Visit visit) {
+    std::vector<Node*> stack;
+    while (node != nullptr) {
+        if (node->key >= lo) {
+            stack.push_back(node);
+            node = node->left;
+        }
+        else
+            node = node->right;
+    }
+    while (!stack.empty()) {
+        Node* t = stack.back();
+        stack.pop_back();
+        if (!visit(t->key))
+            return;
+        for (node = t->right; node != nullptr; node = node->left)
+            stack.push_back(node);
+    }
+}
+
+// Run query(i) for perThread consecutive i on each of numThreads threads and
+// return the elapsed time; results are summed so the calls are not elided
+template <typename Query>
+double timeQueries(int numThreads, int perThread, Query query) {
+    std::atomic<size_t> sink(0);
+    std::vector<thread> threads;
+    const auto startTime = std::chrono::steady_clock::now();
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            size_t sum = 0;
+            for (int i = t * perThread; i < (t + 1) * perThread; i++)
+                sum += query(i);
+            sink += sum;
+        }));
+    }
+    for (int t = 0; t < numThreads; t++) {
+        threads[t].join();
+    }
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// rank, select and countRange on a tree of the even keys below
+// 2 * numThreads * threadCapacity, through the subtree sizes and by in-order
+// counting
+template <typename Tree>
+void runOrderStatistics(const char* name, int numThreads, int threadCapacity, ofstream& outFile) {
+    int keySpace = numThreads * threadCapacity;
+    std::vector<int> sortedKeys(keySpace);
+    for (int i = 0; i < keySpace; i++) sortedKeys[i] = 2 * i;
+    Tree* tree = new Tree();
+    tree->bulkLoad(sortedKeys.data(), sortedKeys.size());
+    std::mt19937 g(1);
+    std::vector<int> lo(keySpace), hi(keySpace);
+    for (int i = 0; i < keySpace; i++) {
+        lo[i] = g() % (2 * keySpace);
+        hi[i] = g() % (2 * keySpace);
+        if (lo[i] > hi[i]) std::swap(lo[i], hi[i]);
+    }
+    int scanPerThread = std::max(1, std::min(threadCapacity, ORDER_SCAN_QUERIES / numThreads));
+
+    for (int op = 0; op < 3; op++) {
+        double sizeTime, scanTime;
+        if (op == 0) {
+            sizeTime = timeQueries(numThreads, threadCapacity, [&](int i) { return tree->rank(lo[i]); });
+            scanTime = timeQueries(numThreads, scanPerThread, [&](int i) {
+                size_t count = 0;
+                walkInOrder(tree->root, INT_MIN, [&](int k) {
+                    if (k >= lo[i]) return false;
+                    count++;
+                    return true;
+                });
+                return count;
+            });
+        }
+        if (op == 1) {
+            sizeTime = timeQueries(numThreads, threadCapacity, [&](int i) {
+                int key = 0;
+                tree->select(lo[i] / 2, key);
+                return (size_t)key;
+            });
+            scanTime = timeQueries(numThreads, scanPerThread, [&](int i) {
+                int key = 0;
+                size_t left = lo[i] / 2;
+                walkInOrder(tree->root, INT_MIN, [&](int k) {
+                    key = k;
+                    return left-- > 0;
+                });
+                return (size_t)key;
+            });
+        }
+        if (op == 2) {
+            sizeTime = timeQueries(numThreads, threadCapacity, [&](int i) { return tree->countRange(lo[i], hi[i]); });
+            scanTime = timeQueries(numThreads, scanPerThread, [&](int i) {
+                size_t count = 0;
+                walkInOrder(tree->root, lo[i], [&](int k) {
+                    if (k > hi[i]) return false;
+                    count++;
+                    return true;
+                });
+                return count;
+            });
+        }
+        const char* query = op == 0 ? "rank" : op == 1 ? "select" : "countRange";
+        outFile << name << " " << query << " on " << keySpace << " keys with " << numThreads << " threads: subtree sizes " << threadCapacity * numThreads / sizeTime << " operations per millisecond, in-order counting " << scanPerThread * numThreads / scanTime << " operations per millisecond\n";
+    }
+    delete tree;
+}
+
+void testOrderStatistics(int numThreads, int threadCapacity, ofstream& outFile) {
+    if (IMPL == 1) {
+        runOrderStatistics<AVLTreeCG>("Coarse-grained", numThreads, threadCapacity, outFile);
+        runOrderStatistics<AVLTree>("Sequential", numThreads, threadCapacity, outFile);
+    }
+    if (IMPL == 2)
+        runOrderStatistics<AVLTreeFG>("Fine-grained", numThreads, threadCapacity, outFile);
+}
+
 /* MAIN FUNCTION */
 int main(int argc, char const *argv[]) {
     std::vector<int> numThreads = {1, 2, 4, 8, 16, 32, 64, 128};
     std::vector<int> threadCapacities = {1000000, 100000, 10000};
+    // Add 5 to compare flat combining against the plain coarse-grained lock,
+    // and 8 for the fat-node B+-tree baseline
     std::vector<int> impl = {1};
+    std::vector<int> scanWidths = {10, 100, 1000, 10000};
+    std::vector<int> scanBatchSizes = {1, 16, 256, 4096};
+    std::vector<int> interleaveDepths = {0, 1, 2, 4, 8, 16, 32};
+    std::vector<int> shardCounts = {1, 2, 4, 8, 16, 32, 64};
+    std::vector<int> serverCounts = {1, 2, 4, 8};
+    std::vector<int> updatePercents = {0, 1, 5, 10, 25, 50};
+    std::vector<int> frozenSizes = {1000000, 10000000, 100000000};
 
     // Throughput
     for (int m : impl) {
@@ -294,8 +1296,36 @@ int main(int argc, char const *argv[]) {
                 // testRandomSearch(threads, capacity/threads, outFile);
                 outFile << "Implementation: " << m << ", Capacity: " << capacity / threads << ", Threads: " << threads << endl;
                 testRandom1(threads, capacity/threads, outFile);
+                // testBulkLoad(threads, capacity/threads, outFile);
+                // for (int width : scanWidths)
+                //     testRangeQueryMix(threads, capacity/threads, width, outFile);
+                // for (int batchSize : scanBatchSizes)
+                //     testScanBatch(threads, capacity/threads, batchSize, outFile);
+                // for (int depth : interleaveDepths)
+                //     testInterleavedSearch(threads, capacity/threads, depth, outFile);
+                // testCombining(threads, capacity/threads, outFile);
+                // for (int shards : shardCounts)
+                //     testSharded(threads, capacity/threads, shards, outFile);
+                // testAdaptive(threads, capacity/threads, false, shardCounts, outFile);
+                // testAdaptive(threads, capacity/threads, true, shardCounts, outFile);
+                // for (int servers : serverCounts)
+                //     testDelegation(threads, capacity/threads, servers, 64, outFile);
+                // testReadMostly(threads, capacity/threads, false, outFile);
+                // testReadMostly(threads, capacity/threads, true, outFile);
+                // for (int updatePercent : updatePercents)
+                //     testOptimisticSearch(threads, capacity/threads, updatePercent, outFile);
+                // testLockFairness(threads, capacity/threads, outFile);
+                // testCompact(threads, capacity/threads, outFile);
+                // testCompaction(threads, capacity/threads, outFile);
+                // testHugePages(threads, capacity/threads, false, outFile);
+                // testMap(threads, capacity/threads, outFile);
+                // testStringKeys(threads, capacity/threads, outFile);
+                // testOrderStatistics(threads, capacity/threads, outFile);
             }
         }
+        // for (int keys : frozenSizes)
+        //     for (int threads : numThreads)
+        //         testFrozenSearch(threads, keys/threads, outFile);
 
         // Close the file
         outFile.close();
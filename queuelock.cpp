@@ -0,0 +1,135 @@
+#include "queuelock.h"
+#include "threadslot.h"
+#include <thread>
+#include <cstdio>
+#include <sched.h>
+
+typedef ThreadSlots<QLOCK_MAX_THREADS> QueueSlots;
+
+// States of a queue node
+enum { WAITING, GRANTED, PASSED };
+
+int queueLockSlot() {
+    return QueueSlots::id() + 1;
+}
+
+// Spin until done() holds, yielding once the spin budget runs out
+template <typename Done>
+static void waitUntil(Done done) {
+    for (int spins = 0; !done(); spins++) {
+        if (spins < QLOCK_SPIN_LIMIT)
+            __builtin_ia32_pause();
+        else
+            std::this_thread::yield();
+    }
+}
+
+// Join the queue at tail and wait for the predecessor to grant the lock.
+// Returns the state it was granted with, GRANTED if the queue was empty.
+static int mcsAcquire(std::atomic<QNode*>& tail, QNode* me) {
+    me->next.store(nullptr, std::memory_order_relaxed);
+    me->state.store(WAITING, std::memory_order_relaxed);
+    QNode* pred = tail.exchange(me, std::memory_order_acq_rel);
+    if (pred == nullptr)
+        return GRANTED;
+    pred->next.store(me, std::memory_order_release);
+    waitUntil([me]() { return me->state.load(std::memory_order_acquire) != WAITING; });
+    return me->state.load(std::memory_order_relaxed);
+}
+
+// Hand the lock to the next waiter with the given state, or empty the queue
+static void mcsRelease(std::atomic<QNode*>& tail, QNode* me, int state) {
+    QNode* succ = me->next.load(std::memory_order_acquire);
+    if (succ == nullptr) {
+        QNode* expected = me;
+        if (tail.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel))
+            return;
+        // A waiter swapped itself in but has not linked to us yet
+        waitUntil([&]() { return (succ = me->next.load(std::memory_order_acquire)) != nullptr; });
+    }
+    succ->state.store(state, std::memory_order_release);
+}
+
+MCSLock::MCSLock() : tail(nullptr) {}
+
+void MCSLock::lock(int slot) {
+    mcsAcquire(tail, &nodes[slot]);
+}
+
+void MCSLock::unlock(int slot) {
+    mcsRelease(tail, &nodes[slot], GRANTED);
+}
+
+// In CLH a node is WAITING while its owner holds or waits for the lock
+CLHLock::CLHLock() : tail(&pool[0]) {
+    pool[0].state.store(GRANTED, std::memory_order_relaxed);
+    for (int i = 0; i < QLOCK_SLOTS; i++)
+        slots[i].mine = &pool[i + 1];
+}
+
+void CLHLock::lock(int slot) {
+    QNode* me = slots[slot].mine;
+    me->state.store(WAITING, std::memory_order_relaxed);
+    QNode* pred = tail.exchange(me, std::memory_order_acq_rel);
+    waitUntil([pred]() { return pred->state.load(std::memory_order_acquire) != WAITING; });
+    slots[slot].pred = pred;
+}
+
+// Our successor may still be reading our node, but nobody reads the
+// predecessor's any more, so the slot takes that one for next time
+void CLHLock::unlock(int slot) {
+    QNode* me = slots[slot].mine;
+    slots[slot].mine = slots[slot].pred;
+    me->state.store(GRANTED, std::memory_order_release);
+}
+
+// Socket of the CPU the calling thread first ran on. Threads may migrate
+// later; that only costs locality, never correctness.
+static int currentSocket() {
+    static thread_local int socket = -1;
+    if (socket == -1) {
+        socket = 0;
+        int cpu = sched_getcpu();
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        if (FILE* f = cpu >= 0 ? fopen(path, "r") : nullptr) {
+            if (fscanf(f, "%d", &socket) != 1 || socket < 0)
+                socket = 0;
+            fclose(f);
+        }
+        socket %= QLOCK_MAX_SOCKETS;
+    }
+    return socket;
+}
+
+CohortLock::CohortLock() : nextTicket(0), nowServing(0) {
+    for (int i = 0; i < QLOCK_MAX_SOCKETS; i++) {
+        cohorts[i].tail.store(nullptr, std::memory_order_relaxed);
+        cohorts[i].handoffs = 0;
+    }
+}
+
+void CohortLock::lock(int slot) {
+    QNode* me = &nodes[slot];
+    me->cohort = currentSocket();
+    if (mcsAcquire(cohorts[me->cohort].tail, me) == PASSED)
+        return;
+    unsigned ticket = nextTicket.fetch_add(1, std::memory_order_relaxed);
+    waitUntil([&]() { return nowServing.load(std::memory_order_acquire) == ticket; });
+}
+
+// The tail only moves past us when a waiter joins, so tail != me means a
+// local successor exists even if it has not linked itself yet
+void CohortLock::unlock(int slot) {
+    QNode* me = &nodes[slot];
+    Cohort& cohort = cohorts[me->cohort];
+    bool waiter = me->next.load(std::memory_order_acquire) != nullptr || cohort.tail.load(std::memory_order_acquire) != me;
+    if (waiter && cohort.handoffs < COHORT_MAX_HANDOFFS) {
+        cohort.handoffs++;
+        mcsRelease(cohort.tail, me, PASSED);
+        return;
+    }
+    cohort.handoffs = 0;
+    nowServing.store(nowServing.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    mcsRelease(cohort.tail, me, GRANTED);
+}
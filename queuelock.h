@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+
+// Upper bound on the number of threads taking one queue lock at once
+#define QLOCK_MAX_THREADS 512
+// Slot 0 is shared: see queueLockSlot()
+#define QLOCK_SLOTS (QLOCK_MAX_THREADS + 1)
+// Busy-wait iterations before a waiter starts yielding its core, so that
+// oversubscribed runs do not spin against a preempted holder
+#define QLOCK_SPIN_LIMIT 128
+// Cohorts the cohort lock distinguishes; sockets beyond this share one
+#define QLOCK_MAX_SOCKETS 8
+// Consecutive handoffs within one socket before the cohort lock lets
+// another socket in
+#define COHORT_MAX_HANDOFFS 64
+
+/*
+ * Every lock here is taken and released through a slot: lock(slot) and
+ * unlock(slot) with the same slot, at most one acquisition per slot
+ * outstanding. The slot owns the queue node, so unlock() may run on a
+ * different thread than lock() did as long as the two are ordered, which
+ * is what AVLTreeCG's reader group needs. Threads use queueLockSlot();
+ * slot 0 is left to callers that hand a lock between threads.
+ */
+int queueLockSlot();
+
+// std::mutex behind the slot interface, for BasicAVLTreeCG's default
+class MutexLock {
+public:
+    void lock(int) { m.lock(); }
+    void unlock(int) { m.unlock(); }
+
+private:
+    std::mutex m;
+};
+
+struct alignas(64) QNode {
+    std::atomic<QNode*> next;
+    std::atomic<int> state;
+    // Socket whose local queue the node joined, for CohortLock
+    int cohort;
+};
+
+// MCS lock: waiters queue up in arrival order and each spins on its own
+// node, so a release touches only the next waiter's cache line
+class MCSLock {
+public:
+    MCSLock();
+    void lock(int slot);
+    void unlock(int slot);
+
+private:
+    QNode nodes[QLOCK_SLOTS];
+    alignas(64) std::atomic<QNode*> tail;
+};
+
+// CLH lock: FIFO like MCS, but each waiter spins on its predecessor's node
+// and adopts it on release, so releasing is one store with no atomics
+class CLHLock {
+public:
+    CLHLock();
+    void lock(int slot);
+    void unlock(int slot);
+
+private:
+    struct alignas(64) Slot {
+        QNode* mine;
+        QNode* pred;
+    };
+
+    // One node per slot plus the initial tail; nodes migrate between slots
+    QNode pool[QLOCK_SLOTS + 1];
+    Slot slots[QLOCK_SLOTS];
+    alignas(64) std::atomic<QNode*> tail;
+};
+
+// Cohort lock (Dice et al.): an MCS queue per socket in front of a global
+// ticket lock. A releaser with a waiter on its own socket passes the global
+// lock along with the local one, up to COHORT_MAX_HANDOFFS times in a row,
+// so the lock and the data it guards mostly stay in one socket's caches.
+class CohortLock {
+public:
+    CohortLock();
+    void lock(int slot);
+    void unlock(int slot);
+
+private:
+    struct alignas(64) Cohort {
+        std::atomic<QNode*> tail;
+        // Handoffs since the global lock was taken, under the local lock
+        int handoffs;
+    };
+
+    QNode nodes[QLOCK_SLOTS];
+    Cohort cohorts[QLOCK_MAX_SOCKETS];
+    alignas(64) std::atomic<unsigned> nextTicket;
+    alignas(64) std::atomic<unsigned> nowServing;
+};
@@ -0,0 +1,203 @@
+#include "rcu.h"
+#include <algorithm>
+#include <functional>
+
+NodeRCU::NodeRCU(int key, unsigned long version) : key(key), left(nullptr), right(nullptr), height(1), version(version) {}
+
+static void freeNodeRCU(void* p) {
+    delete static_cast<NodeRCU*>(p);
+}
+
+AVLTreeRCU::AVLTreeRCU() : root(nullptr), version(0) {}
+
+AVLTreeRCU::~AVLTreeRCU() {
+    freeTree(root);
+}
+
+void AVLTreeRCU::freeTree(NodeRCU* node) {
+    if (node == nullptr)
+        return;
+    freeTree(node->left);
+    freeTree(node->right);
+    delete node;
+}
+
+int AVLTreeRCU::height(NodeRCU* node) const {
+    return node == nullptr ? 0 : node->height;
+}
+
+int AVLTreeRCU::getBalance(NodeRCU* node) const {
+    return node == nullptr ? 0 : height(node->left) - height(node->right);
+}
+
+// Return a node of the current update to modify in place of node: node
+// itself if this update created it, otherwise a copy, with node queued for
+// retirement once the new version is published
+NodeRCU* AVLTreeRCU::own(NodeRCU* node) {
+    if (node->version == version)
+        return node;
+    NodeRCU* copy = new NodeRCU(*node);
+    copy->version = version;
+    replaced.push_back(node);
+    return copy;
+}
+
+// Make newRoot visible to readers, then hand the nodes it replaced to the
+// epoch manager; readers that loaded the old root may still be reading them
+void AVLTreeRCU::publish(NodeRCU* newRoot) {
+    root.store(newRoot, std::memory_order_release);
+    for (NodeRCU* node : replaced)
+        epochs.retire(node, freeNodeRCU);
+    replaced.clear();
+}
+
+// Rotations take an owned y (x) and own the child they pull up
+NodeRCU* AVLTreeRCU::rightRotate(NodeRCU* y) {
+    NodeRCU* x = own(y->left);
+    y->left = x->right;
+    x->right = y;
+    y->height = std::max(height(y->left), height(y->right)) + 1;
+    x->height = std::max(height(x->left), height(x->right)) + 1;
+    return x;
+}
+
+NodeRCU* AVLTreeRCU::leftRotate(NodeRCU* x) {
+    NodeRCU* y = own(x->right);
+    x->right = y->left;
+    y->left = x;
+    x->height = std::max(height(x->left), height(x->right)) + 1;
+    y->height = std::max(height(y->left), height(y->right)) + 1;
+    return y;
+}
+
+// Fix the height of an owned node and restore its balance
+NodeRCU* AVLTreeRCU::rebalance(NodeRCU* node) {
+    node->height = 1 + std::max(height(node->left), height(node->right));
+    int balance = getBalance(node);
+    if (balance > 1) {
+        if (getBalance(node->left) < 0)
+            node->left = leftRotate(own(node->left));
+        return rightRotate(node);
+    }
+    if (balance < -1) {
+        if (getBalance(node->right) > 0)
+            node->right = rightRotate(own(node->right));
+        return leftRotate(node);
+    }
+    return node;
+}
+
+// Callers have checked that key is absent, so every node on the path changes
+NodeRCU* AVLTreeRCU::insertHelper(NodeRCU* node, int key) {
+    if (node == nullptr)
+        return new NodeRCU(key, version);
+    node = own(node);
+    if (key < node->key)
+        node->left = insertHelper(node->left, key);
+    else
+        node->right = insertHelper(node->right, key);
+    return rebalance(node);
+}
+
+// Callers have checked that key is present
+NodeRCU* AVLTreeRCU::deleteHelper(NodeRCU* node, int key) {
+    if (key == node->key) {
+        if (node->left == nullptr || node->right == nullptr) {
+            replaced.push_back(node);
+            return node->left ? node->left : node->right;
+        }
+        NodeRCU* successor = node->right;
+        while (successor->left != nullptr)
+            successor = successor->left;
+        node = own(node);
+        node->key = successor->key;
+        node->right = deleteHelper(node->right, successor->key);
+        return rebalance(node);
+    }
+    node = own(node);
+    if (key < node->key)
+        node->left = deleteHelper(node->left, key);
+    else
+        node->right = deleteHelper(node->right, key);
+    return rebalance(node);
+}
+
+bool AVLTreeRCU::insert(int key) {
+    std::lock_guard<std::mutex> guard(writeLock);
+    NodeRCU* current = root.load(std::memory_order_relaxed);
+    if (searchHelper(current, key))
+        return false;
+    version++;
+    publish(insertHelper(current, key));
+    return true;
+}
+
+bool AVLTreeRCU::deleteNode(int key) {
+    std::lock_guard<std::mutex> guard(writeLock);
+    NodeRCU* current = root.load(std::memory_order_relaxed);
+    if (!searchHelper(current, key))
+        return false;
+    version++;
+    publish(deleteHelper(current, key));
+    return true;
+}
+
+bool AVLTreeRCU::searchHelper(NodeRCU* node, int key) const {
+    while (node != nullptr) {
+        if (key == node->key)
+            return true;
+        node = key < node->key ? node->left : node->right;
+    }
+    return false;
+}
+
+bool AVLTreeRCU::search(int key) {
+    epochs.enter();
+    bool found = searchHelper(root.load(std::memory_order_acquire), key);
+    epochs.leave();
+    return found;
+}
+
+void AVLTreeRCU::rangeHelper(NodeRCU* node, int lo, int hi, std::vector<int>& out) const {
+    if (node == nullptr)
+        return;
+    if (lo < node->key)
+        rangeHelper(node->left, lo, hi, out);
+    if (lo <= node->key && node->key <= hi)
+        out.push_back(node->key);
+    if (node->key < hi)
+        rangeHelper(node->right, lo, hi, out);
+}
+
+// Replace out with the keys in [lo, hi] in ascending order, all from the
+// same version of the tree
+void AVLTreeRCU::rangeQuery(int lo, int hi, std::vector<int>& out) {
+    out.clear();
+    epochs.enter();
+    rangeHelper(root.load(std::memory_order_acquire), lo, hi, out);
+    epochs.leave();
+}
+
+NodeRCU* AVLTreeRCU::buildHelper(const int* sorted, size_t lo, size_t hi) {
+    if (lo >= hi)
+        return nullptr;
+    size_t mid = lo + (hi - lo) / 2;
+    NodeRCU* node = new NodeRCU(sorted[mid], version);
+    node->left = buildHelper(sorted, lo, mid);
+    node->right = buildHelper(sorted, mid + 1, hi);
+    node->height = 1 + std::max(height(node->left), height(node->right));
+    return node;
+}
+
+// Load n strictly increasing keys in O(n). Only valid on an empty tree;
+// returns false without modifying the tree otherwise.
+bool AVLTreeRCU::bulkLoad(const int* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted + n, std::greater_equal<int>()) != sorted + n)
+        return false;
+    std::lock_guard<std::mutex> guard(writeLock);
+    if (root.load(std::memory_order_relaxed) != nullptr)
+        return false;
+    version++;
+    publish(buildHelper(sorted, 0, n));
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include "epoch.h"
+#include "hugepage.h"
+
+// Nodes are immutable once published. version is the update that created
+// the node; that update may still modify it in place.
+class NodeRCU : public HugePageNode {
+public:
+    int key;
+    NodeRCU* left;
+    NodeRCU* right;
+    int height;
+    unsigned long version;
+
+    NodeRCU(int key, unsigned long version);
+};
+
+// AVL tree with lock-free, wait-free readers in the style of RCU. Writers
+// are serialized by a lock as in AVLTreeCG but never modify published
+// nodes: they copy the path they change and publish the new version with
+// one store to root. Readers load root and work on that version without
+// locks or shared writes. Replaced nodes are freed by epoch.
+class AVLTreeRCU {
+public:
+    std::atomic<NodeRCU*> root;
+    AVLTreeRCU();
+    ~AVLTreeRCU();
+
+    bool insert(int key);
+    bool deleteNode(int key);
+    bool search(int key);
+    void rangeQuery(int lo, int hi, std::vector<int>& out);
+    bool bulkLoad(const int* sorted, size_t n);
+
+private:
+    std::mutex writeLock;
+    EpochManager epochs;
+    // Current update, under writeLock
+    unsigned long version;
+    // Nodes replaced by the current update, retired once it is published
+    std::vector<NodeRCU*> replaced;
+
+    NodeRCU* own(NodeRCU* node);
+    void publish(NodeRCU* newRoot);
+    NodeRCU* rightRotate(NodeRCU* y);
+    NodeRCU* leftRotate(NodeRCU* x);
+    int height(NodeRCU* node) const;
+    int getBalance(NodeRCU* node) const;
+    NodeRCU* rebalance(NodeRCU* node);
+
+    NodeRCU* insertHelper(NodeRCU* node, int key);
+    NodeRCU* deleteHelper(NodeRCU* node, int key);
+    bool searchHelper(NodeRCU* node, int key) const;
+    void rangeHelper(NodeRCU* node, int lo, int hi, std::vector<int>& out) const;
+    NodeRCU* buildHelper(const int* sorted, size_t lo, size_t hi);
+    void freeTree(NodeRCU* node);
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include "hugepage.h"
+
+/*
+ * Cache-locality compaction for pointer-based AVL trees. After long runs of
+ * inserts and deletes, the nodes of a tree are scattered over the heap and
+ * each level of a search misses cache and TLB. compact() copies every node
+ * into one contiguous NodeArena in van Emde Boas order: recursively the top
+ * half of the levels, then each subtree hanging below them, so a search
+ * touches O(log_B n) blocks whatever the block size, as in FrozenTree.
+ *
+ * Node is any copyable node with key, left, right and height fields; a copy
+ * keeps every other field too, such as subtree sizes. Arena nodes are never
+ * freed one by one: a node deleted after compaction keeps its slot until the
+ * next compact() frees the arena.
+ * While HugePagePool is enabled, arenas are mapped on huge pages as well.
+ */
+template <typename Node>
+struct NodeArena {
+    Node* nodes;
+    size_t n;
+    // Whether nodes came from hugeMap rather than operator new
+    bool mapped;
+
+    bool owns(const Node* p) const {
+        uintptr_t a = reinterpret_cast<uintptr_t>(p);
+        return a >= reinterpret_cast<uintptr_t>(nodes) && a < reinterpret_cast<uintptr_t>(nodes + n);
+    }
+};
+
+template <typename Node>
+NodeArena<Node> allocArena(size_t n) {
+    if (HugePagePool::enabled() && n > 0) {
+        void* p = hugeMap(n * sizeof(Node), HugePagePool::hugeTLB());
+        if (p != nullptr)
+            return NodeArena<Node>{static_cast<Node*>(p), n, true};
+    }
+    return NodeArena<Node>{static_cast<Node*>(::operator new(n * sizeof(Node))), n, false};
+}
+
+// Nodes are trivially destructible, so the storage goes back as it is
+template <typename Node>
+void freeArena(NodeArena<Node>& arena) {
+    if (arena.mapped)
+        hugeUnmap(arena.nodes, arena.n * sizeof(Node));
+    else
+        ::operator delete(arena.nodes);
+    arena.nodes = nullptr;
+    arena.n = 0;
+}
+
+template <typename Node>
+size_t countNodes(const Node* node) {
+    size_t n = 0;
+    std::vector<const Node*> stack;
+    if (node != nullptr)
+        stack.push_back(node);
+    while (!stack.empty()) {
+        const Node* t = stack.back();
+        stack.pop_back();
+        n++;
+        if (t->left != nullptr) stack.push_back(t->left);
+        if (t->right != nullptr) stack.push_back(t->right);
+    }
+    return n;
+}
+
+// A source node still to be copied and the child pointer of its copied
+// parent that must point at the copy
+template <typename Node>
+struct PendingCopy {
+    Node* src;
+    Node** slot;
+};
+
+// Copy the top levels of the subtree at src into arena, in vEB order, and
+// append the subtrees hanging below them to below
+template <typename Node>
+void copyLevelsVEB(Node* src, Node** slot, int levels, Node* arena, size_t& next, std::vector<PendingCopy<Node>>& below) {
+    if (levels == 1) {
+        // Child pointers are copied too, and overwritten once the
+        // children themselves are copied
+        Node* copy = ::new (arena + next++) Node(*src);
+        *slot = copy;
+        if (src->left != nullptr) below.push_back({src->left, &copy->left});
+        if (src->right != nullptr) below.push_back({src->right, &copy->right});
+        return;
+    }
+    int top = levels / 2;
+    std::vector<PendingCopy<Node>> middle;
+    copyLevelsVEB(src, slot, top, arena, next, middle);
+    for (const PendingCopy<Node>& p : middle)
+        copyLevelsVEB(p.src, p.slot, levels - top, arena, next, below);
+}
+
+// Copy the subtree at root into arena, which has room for all its nodes,
+// and return the copy's root. The source tree is left untouched.
+template <typename Node>
+Node* copyVEB(Node* root, Node* arena) {
+    if (root == nullptr)
+        return nullptr;
+    Node* copyRoot = nullptr;
+    size_t next = 0;
+    std::vector<PendingCopy<Node>> below;
+    copyLevelsVEB(root, &copyRoot, root->height, arena, next, below);
+    return copyRoot;
+}
@@ -1,6 +1,7 @@
 // Sequential implementation of AVL tree
 #include <bits/stdc++.h>
 #include "sequential.h"
+#include "parallel.h"
 using namespace std;
 
 // A utility function to get height of tree
@@ -10,7 +11,7 @@ int AVLTree::height(Node *N) {
     return N->height;
 }
 
-Node::Node(int k) : key(k), left(nullptr), right(nullptr), height(1) {}
+Node::Node(int k) : key(k), left(nullptr), right(nullptr), height(1), size(1) {}
 
 // A utility function to right rotate subtree rooted with y
 Node* AVLTree::rightRotate(Node *y) {
@@ -19,9 +20,11 @@ Node* AVLTree::rightRotate(Node *y) {
     // Perform rotation
     x->right = y;
     y->left = T2;
-    // Update heights
+    // Update heights and sizes
     y->height = std::max(height(y->left), height(y->right)) + 1;
+    y->size = size(y->left) + size(y->right) + 1;
     x->height = std::max(height(x->left), height(x->right)) + 1;
+    x->size = size(x->left) + size(x->right) + 1;
     // Return new root
     return x;
 }
@@ -33,13 +36,22 @@ Node* AVLTree::leftRotate(Node *x) {
     // Perform rotation
     y->left = x;
     x->right = T2;
-    // Update heights
+    // Update heights and sizes
     x->height = std::max(height(x->left), height(x->right))+1;
+    x->size = size(x->left)+size(x->right)+1;
     y->height = std::max(height(y->left), height(y->right))+1;
+    y->size = size(y->left)+size(y->right)+1;
     // Return new root
     return y;
 }
 
+// Number of nodes in the subtree rooted at N
+int AVLTree::size(Node *N) {
+    if (N==NULL)
+        return 0;
+    return N->size;
+}
+
 // Get balance factor of node N
 int AVLTree::getBalance(Node *N) {
     if (N == NULL)
@@ -64,8 +76,9 @@ Node* AVLTree::insertHelper(Node *node, int key) {
         node->right = insertHelper(node->right, key);
     else // Equal keys are not allowed in BST
         return node;
-    // 2. Update height of this ancestor node
+    // 2. Update height and size of this ancestor node
     node->height = 1 + std::max(height(node->left), height(node->right));
+    node->size = 1 + size(node->left) + size(node->right);
     // 3. Get the balance factor of this ancestor node to check this node's balance
     int balance = getBalance(node);
 
@@ -127,7 +140,7 @@ Node* AVLTree::deleteNodeHelper(Node *root, int key) {
             }
             else
                 *root = *temp; // Copy the contents of the non-empty child
-            free(temp);
+            freeNode(temp);
         }
         else {
             // Get the inorder successor (smallest in the right subtree)
@@ -142,8 +155,9 @@ Node* AVLTree::deleteNodeHelper(Node *root, int key) {
     if (root==NULL)
         return root;
 
-    // Step 2: update height of the current node 
+    // Step 2: update height and size of the current node
     root->height = 1+std::max(height(root->left), height(root->right));
+    root->size = 1+size(root->left)+size(root->right);
     // Step 3: check whether this node became unbalanced
     int balance = getBalance(root);
     // Left Left Case
@@ -182,6 +196,121 @@ bool AVLTree::searchHelper(Node* node, int key) {
     return searchHelper(node->left, key);
 }
 
+// Look up keys[0, n) into out[0, n). SEARCH_GROUP lookups advance one level
+// at a time in lockstep, prefetching each next node so that their cache
+// misses overlap; a lane that finishes is refilled with the next key.
+void AVLTree::searchBatch(const int* keys, size_t n, bool* out) {
+    Node *cur[SEARCH_GROUP];
+    size_t idx[SEARCH_GROUP];
+    size_t next = 0;
+    int live = 0;
+    for (int lane = 0; lane<SEARCH_GROUP; lane++) {
+        idx[lane] = next<n ? next++ : n;
+        cur[lane] = root;
+        if (idx[lane]!=n)
+            live++;
+    }
+    while (live>0) {
+        for (int lane = 0; lane<SEARCH_GROUP; lane++) {
+            if (idx[lane]==n)
+                continue;
+            Node *node = cur[lane];
+            int key = keys[idx[lane]];
+            if (node!=NULL && key!=node->key) {
+                node = key<node->key ? node->left : node->right;
+                __builtin_prefetch(node);
+                cur[lane] = node;
+                continue;
+            }
+            out[idx[lane]] = node!=NULL;
+            if (next<n) {
+                idx[lane] = next++;
+                cur[lane] = root;
+            }
+            else {
+                idx[lane] = n;
+                live--;
+            }
+        }
+    }
+}
+
+// Resolve a sorted slice of (key, position) pairs against the subtree rooted
+// at node, splitting the slice at node->key. Returns the nodes visited.
+size_t AVLTree::multiGetHelper(Node *node, const pair<int, size_t> *batch, size_t n, bool *out) {
+    if (n==0)
+        return 0;
+    if (node==NULL) {
+        for (size_t i = 0; i<n; i++)
+            out[batch[i].second] = false;
+        return 0;
+    }
+    const pair<int, size_t> *end = batch+n;
+    const pair<int, size_t> *lo = lower_bound(batch, end, make_pair(node->key, (size_t)0));
+    const pair<int, size_t> *hi = lo;
+    while (hi!=end && hi->first==node->key)
+        out[(hi++)->second] = true;
+    return 1+multiGetHelper(node->left, batch, lo-batch, out)
+            +multiGetHelper(node->right, hi, end-hi, out);
+}
+
+// Look up keys[0, n) into out[0, n) with one shared descent of the sorted
+// batch, so nodes near the root are read once per batch rather than once
+// per key. Returns the number of nodes visited.
+size_t AVLTree::multiGet(const int* keys, size_t n, bool* out) {
+    vector<pair<int, size_t>> batch(n);
+    for (size_t i = 0; i<n; i++)
+        batch[i] = make_pair(keys[i], i);
+    if (!is_sorted(keys, keys+n))
+        sort(batch.begin(), batch.end());
+    return multiGetHelper(root, batch.data(), n, out);
+}
+
+// Number of keys in the subtree rooted at node below key, or not above it if
+// inclusive. Every step right passes the node and its whole left subtree.
+size_t AVLTree::countBelow(Node *node, int key, bool inclusive) {
+    size_t count = 0;
+    while (node!=NULL) {
+        if (node->key<key || (inclusive && node->key==key)) {
+            count += size(node->left)+1;
+            node = node->right;
+        }
+        else
+            node = node->left;
+    }
+    return count;
+}
+
+size_t AVLTree::rank(int key) {
+    return countBelow(root, key, false);
+}
+
+// Descend by subtree sizes, dropping the left subtree and the node from i
+// whenever the walk goes right
+bool AVLTree::select(size_t i, int& key) {
+    Node *node = root;
+    while (node!=NULL) {
+        size_t left = size(node->left);
+        if (i<left)
+            node = node->left;
+        else if (i==left) {
+            key = node->key;
+            return true;
+        }
+        else {
+            i -= left+1;
+            node = node->right;
+        }
+    }
+    return false;
+}
+
+size_t AVLTree::countRange(int lo, int hi) {
+    if (lo>hi)
+        return 0;
+    return countBelow(root, hi, true)-countBelow(root, lo, false);
+}
+
 // A utility function to print preorder traversal of the tree.
 // The function also prints the height of every node.
 void AVLTree::preOrder(Node *root) {
@@ -192,6 +321,286 @@ void AVLTree::preOrder(Node *root) {
     }
 }
 
+// Build a perfectly balanced subtree over sorted[lo, hi), forking the two
+// halves onto separate threads near the top of the recursion
+Node* AVLTree::buildHelper(const int* sorted, size_t lo, size_t hi, int depth) {
+    if (lo>=hi)
+        return NULL;
+    size_t mid = lo+(hi-lo)/2;
+    Node *node = new Node(sorted[mid]);
+    forkJoin(hi-lo>FORK_GRAIN ? depth : 0,
+        [&]() { node->left = buildHelper(sorted, lo, mid, depth-1); },
+        [&]() { node->right = buildHelper(sorted, mid+1, hi, depth-1); });
+    node->height = 1+std::max(height(node->left), height(node->right));
+    node->size = 1+size(node->left)+size(node->right);
+    return node;
+}
+
+// Load n strictly increasing keys in O(n). Only valid on an empty tree;
+// returns false without modifying the tree otherwise.
+bool AVLTree::bulkLoad(const int* sorted, size_t n) {
+    if (root!=NULL || std::adjacent_find(sorted, sorted+n, std::greater_equal<int>())!=sorted+n)
+        return false;
+    root = buildHelper(sorted, 0, n, forkDepth());
+    return true;
+}
+
+AVLTree::~AVLTree() {
+    freeTree(root);
+    for (NodeArena<Node>& arena : arenas)
+        freeArena(arena);
+}
+
+void AVLTree::freeTree(Node *node) {
+    if (node==NULL)
+        return;
+    freeTree(node->left);
+    freeTree(node->right);
+    freeNode(node);
+}
+
+// Arena nodes are freed with their arena
+void AVLTree::freeNode(Node *node) {
+    for (const NodeArena<Node>& arena : arenas)
+        if (arena.owns(node))
+            return;
+    delete node;
+}
+
+void AVLTree::adoptArenas(AVLTree& other) {
+    arenas.insert(arenas.end(), other.arenas.begin(), other.arenas.end());
+    other.arenas.clear();
+}
+
+// Every node is copied out first, so all old arenas can go at once
+void AVLTree::compact() {
+    NodeArena<Node> fresh = allocArena<Node>(countNodes(root));
+    Node *old = root;
+    root = copyVEB(old, fresh.nodes);
+    freeTree(old);
+    for (NodeArena<Node>& arena : arenas)
+        freeArena(arena);
+    arenas.assign(1, fresh);
+}
+
+// Make k the root of l and r and fix its height. Requires l < k < r and
+// the heights of l and r to differ by at most one.
+Node* AVLTree::makeNode(Node *l, Node *k, Node *r) {
+    k->left = l;
+    k->right = r;
+    k->height = 1+std::max(height(l), height(r));
+    k->size = 1+size(l)+size(r);
+    return k;
+}
+
+// Join when l is taller than r by more than one: walk down the right spine
+// of l to a subtree c with height(c) <= height(r)+1, hang (c, k, r) there
+// and rebalance on the way back up
+Node* AVLTree::joinRight(Node *l, Node *k, Node *r) {
+    Node *c = l->right;
+    if (height(c)<=height(r)+1) {
+        Node *t = makeNode(c, k, r);
+        if (height(t)<=height(l->left)+1)
+            return makeNode(l->left, l, t);
+        makeNode(l->left, l, rightRotate(t));
+        return leftRotate(l);
+    }
+    Node *t = joinRight(c, k, r);
+    makeNode(l->left, l, t);
+    if (height(t)<=height(l->left)+1)
+        return l;
+    return leftRotate(l);
+}
+
+// Mirror image of joinRight, for r taller than l by more than one
+Node* AVLTree::joinLeft(Node *l, Node *k, Node *r) {
+    Node *c = r->left;
+    if (height(c)<=height(l)+1) {
+        Node *t = makeNode(l, k, c);
+        if (height(t)<=height(r->right)+1)
+            return makeNode(t, r, r->right);
+        makeNode(leftRotate(t), r, r->right);
+        return rightRotate(r);
+    }
+    Node *t = joinLeft(l, k, c);
+    makeNode(t, r, r->right);
+    if (height(t)<=height(r->right)+1)
+        return r;
+    return rightRotate(r);
+}
+
+// Return a balanced tree holding l, the single node k and r, given that every
+// key in l is below k->key and every key in r above it.
+// O(|height(l) - height(r)|).
+Node* AVLTree::join(Node *l, Node *k, Node *r) {
+    if (height(l)>height(r)+1)
+        return joinRight(l, k, r);
+    if (height(r)>height(l)+1)
+        return joinLeft(l, k, r);
+    return makeNode(l, k, r);
+}
+
+// Detach the largest node of t into last and return the rest of the tree
+Node* AVLTree::splitLast(Node *t, Node*& last) {
+    if (t->right==NULL) {
+        last = t;
+        return t->left;
+    }
+    Node *rest = splitLast(t->right, last);
+    return join(t->left, t, rest);
+}
+
+// Join two trees with every key in l below every key in r
+Node* AVLTree::join2(Node *l, Node *r) {
+    if (l==NULL)
+        return r;
+    Node *last;
+    Node *rest = splitLast(l, last);
+    return join(rest, last, r);
+}
+
+// Split t into the keys below key (l) and above it (r). If key is present,
+// its node is detached into m, otherwise m is NULL. O(log n).
+void AVLTree::split(Node *t, int key, Node*& l, Node*& m, Node*& r) {
+    if (t==NULL) {
+        l = m = r = NULL;
+        return;
+    }
+    Node *tl = t->left;
+    Node *tr = t->right;
+    if (key==t->key) {
+        l = tl;
+        r = tr;
+        m = makeNode(NULL, t, NULL);
+    }
+    else if (key<t->key) {
+        Node *rl;
+        split(tl, key, l, m, rl);
+        r = join(rl, t, tr);
+    }
+    else {
+        Node *lr;
+        split(tr, key, lr, m, r);
+        l = join(tl, t, lr);
+    }
+}
+
+// The set operations below split a at the root key of b and recurse on both
+// halves in parallel, which takes O(m log(n/m + 1)) work for sizes m <= n
+// and O(log n log m) span. Nodes of both inputs are reused for the result and
+// the ones that drop out are freed.
+Node* AVLTree::unionHelper(Node *a, Node *b, int depth) {
+    if (a==NULL)
+        return b;
+    if (b==NULL)
+        return a;
+    Node *bl = b->left;
+    Node *br = b->right;
+    Node *al, *am, *ar;
+    split(a, b->key, al, am, ar);
+    if (am!=NULL)
+        freeNode(am);
+    Node *tl, *tr;
+    forkJoin(height(b)>FORK_GRAIN_HEIGHT ? depth : 0,
+        [&]() { tl = unionHelper(al, bl, depth-1); },
+        [&]() { tr = unionHelper(ar, br, depth-1); });
+    return join(tl, b, tr);
+}
+
+Node* AVLTree::intersectHelper(Node *a, Node *b, int depth) {
+    if (a==NULL || b==NULL) {
+        freeTree(a);
+        freeTree(b);
+        return NULL;
+    }
+    Node *bl = b->left;
+    Node *br = b->right;
+    Node *al, *am, *ar;
+    split(a, b->key, al, am, ar);
+    Node *tl, *tr;
+    forkJoin(height(b)>FORK_GRAIN_HEIGHT ? depth : 0,
+        [&]() { tl = intersectHelper(al, bl, depth-1); },
+        [&]() { tr = intersectHelper(ar, br, depth-1); });
+    if (am!=NULL) {
+        freeNode(am);
+        return join(tl, b, tr);
+    }
+    freeNode(b);
+    return join2(tl, tr);
+}
+
+Node* AVLTree::differenceHelper(Node *a, Node *b, int depth) {
+    if (a==NULL || b==NULL) {
+        freeTree(b);
+        return a;
+    }
+    Node *bl = b->left;
+    Node *br = b->right;
+    Node *al, *am, *ar;
+    split(a, b->key, al, am, ar);
+    if (am!=NULL)
+        freeNode(am);
+    freeNode(b);
+    Node *tl, *tr;
+    forkJoin(height(bl)>FORK_GRAIN_HEIGHT || height(br)>FORK_GRAIN_HEIGHT ? depth : 0,
+        [&]() { tl = differenceHelper(al, bl, depth-1); },
+        [&]() { tr = differenceHelper(ar, br, depth-1); });
+    return join2(tl, tr);
+}
+
+// Replace this tree with the union of both trees
+void AVLTree::unionWith(AVLTree& other) {
+    adoptArenas(other);
+    root = unionHelper(root, other.root, forkDepth());
+    other.root = NULL;
+}
+
+// Replace this tree with the keys present in both trees
+void AVLTree::intersectWith(AVLTree& other) {
+    adoptArenas(other);
+    root = intersectHelper(root, other.root, forkDepth());
+    other.root = NULL;
+}
+
+// Remove every key of other from this tree
+void AVLTree::differenceWith(AVLTree& other) {
+    adoptArenas(other);
+    root = differenceHelper(root, other.root, forkDepth());
+    other.root = NULL;
+}
+
+// Apply ops[0, n) to t: split t at the middle key of the batch, apply both
+// halves of the batch to both halves of the tree in parallel, then join the
+// results back together around the middle key. O(m log(n/m + 1)) work for a
+// batch of m updates, like the set operations above.
+Node* AVLTree::applyBatchHelper(Node *t, const BatchOp *ops, size_t n, int depth) {
+    if (n==0)
+        return t;
+    size_t mid = n/2;
+    Node *l, *m, *r;
+    split(t, ops[mid].key, l, m, r);
+    forkJoin(n>BATCH_GRAIN ? depth : 0,
+        [&]() { l = applyBatchHelper(l, ops, mid, depth-1); },
+        [&]() { r = applyBatchHelper(r, ops+mid+1, n-mid-1, depth-1); });
+    if (ops[mid].insert)
+        return join(l, m!=NULL ? m : new Node(ops[mid].key), r);
+    if (m!=NULL)
+        freeNode(m);
+    return join2(l, r);
+}
+
+// Inserting a present key or deleting an absent one is a no-op, as with
+// insert and deleteNode. Returns false without modifying the tree if the
+// keys are not strictly increasing.
+bool AVLTree::applyBatch(const std::vector<BatchOp>& ops, unsigned int numThreads) {
+    for (size_t i = 1; i<ops.size(); i++)
+        if (ops[i-1].key>=ops[i].key)
+            return false;
+    int depth = numThreads==0 ? forkDepth() : forkDepth(numThreads);
+    root = applyBatchHelper(root, ops.data(), ops.size(), depth);
+    return true;
+}
+
 // // Driver Code
 // int main() {
 //     AVLTree* avl_tree = new AVLTree(); // Create an instance of AVLTree
@@ -1,36 +1,100 @@
+#pragma once
 #include <bits/stdc++.h>
+#include "relayout.h"
+#include "hugepage.h"
 using namespace std;
 
 // An AVL tree node
-class Node {
+class Node : public HugePageNode {
 public:
     int key;
     Node *left;
     Node *right;
     int height;
+    // Number of nodes in the subtree rooted here
+    int size;
 
     Node* newNode(int key);
     Node(int key);
 };
 
+// One update of a batch: insert key if insert is set, delete it otherwise
+struct BatchOp {
+    int key;
+    bool insert;
+};
+
 class AVLTree{
 public:
-    Node* root;
+    Node* root = NULL;
+    AVLTree() = default;
+    ~AVLTree();
+    // The destructor frees the nodes and arenas, so a copy would free them twice
+    AVLTree(const AVLTree&) = delete;
+    AVLTree& operator=(const AVLTree&) = delete;
     void insert(int key);
     void deleteNode(int key);
     bool search(int key);
+    void searchBatch(const int* keys, size_t n, bool* out);
+    size_t multiGet(const int* keys, size_t n, bool* out);
     void preOrder(Node* root);
 
+    // Order statistics from the subtree sizes, O(log n) each: the number of
+    // keys below key, the i-th smallest key (from 0; false if there are at
+    // most i keys) and the number of keys in [lo, hi]
+    size_t rank(int key);
+    bool select(size_t i, int& key);
+    size_t countRange(int lo, int hi);
+    bool bulkLoad(const int* sorted, size_t n);
+    // Relayout of every node into one arena in vEB order, see relayout.h
+    void compact();
+
+    // Join-based set operations; the argument tree is consumed and left empty,
+    // and this tree takes over its arenas
+    void unionWith(AVLTree& other);
+    void intersectWith(AVLTree& other);
+    void differenceWith(AVLTree& other);
+
+    // Apply a batch of updates with strictly increasing keys using up to
+    // numThreads threads (0 = one per hardware thread)
+    bool applyBatch(const std::vector<BatchOp>& ops, unsigned int numThreads = 0);
+
+    // Join-based building blocks over raw subtrees
+    Node* join(Node* l, Node* k, Node* r);
+    Node* join2(Node* l, Node* r);
+    void split(Node* t, int key, Node*& l, Node*& m, Node*& r);
+
 private:
+    // Arenas holding this tree's nodes: the last compact()'s, plus those
+    // taken over from trees consumed by the set operations. Nodes must not
+    // move to another tree except through those.
+    vector<NodeArena<Node>> arenas;
+
     Node* insertHelper(Node *node, int key);
     Node *deleteNodeHelper(Node *root, int key);
     bool searchHelper(Node* node, int key);
+    size_t multiGetHelper(Node* node, const pair<int, size_t>* batch, size_t n, bool* out);
 
     int height(Node* N);
+    int size(Node* N);
+    size_t countBelow(Node* node, int key, bool inclusive);
     Node* newNode(int key);
     Node* rightRotate(Node* y);
     Node* leftRotate(Node* x);
     int getBalance(Node *N);
     Node* minValueNode(Node *node);
+    Node* buildHelper(const int* sorted, size_t lo, size_t hi, int depth);
+
+    Node* makeNode(Node* l, Node* k, Node* r);
+    Node* joinRight(Node* l, Node* k, Node* r);
+    Node* joinLeft(Node* l, Node* k, Node* r);
+    Node* splitLast(Node* t, Node*& last);
+    Node* unionHelper(Node* a, Node* b, int depth);
+    Node* intersectHelper(Node* a, Node* b, int depth);
+    Node* differenceHelper(Node* a, Node* b, int depth);
+    Node* applyBatchHelper(Node* t, const BatchOp* ops, size_t n, int depth);
+    void freeTree(Node* node);
+    void freeNode(Node* node);
+    void adoptArenas(AVLTree& other);
 };
 
@@ -0,0 +1,117 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <climits>
+#include <cstddef>
+#include <utility>
+
+/*
+ * Boundaries cutting the int key space into numShards ranges: the
+ * numShards-quantiles of sample, which should be drawn from the expected key
+ * distribution, or equal slices of the int range for an empty sample.
+ * Duplicate quantiles are merged, so a narrow sample can yield fewer ranges
+ * than asked for. Range i holds the keys in [bounds[i-1], bounds[i]).
+ */
+inline std::vector<int> shardBounds(int numShards, std::vector<int> sample) {
+    std::vector<int> bounds;
+    if (numShards < 1)
+        numShards = 1;
+    if (sample.empty()) {
+        long long width = ((long long)INT_MAX - INT_MIN + 1) / numShards;
+        for (int i = 1; i < numShards; i++)
+            bounds.push_back((int)(INT_MIN + i * width));
+        return bounds;
+    }
+    std::sort(sample.begin(), sample.end());
+    for (int i = 1; i < numShards; i++)
+        bounds.push_back(sample[sample.size() * i / numShards]);
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+    // A bound at the smallest sampled key would leave range 0 empty
+    if (!bounds.empty() && bounds[0] == sample[0])
+        bounds.erase(bounds.begin());
+    return bounds;
+}
+
+/*
+ * Range-partitioned front end over numShards independent trees of type
+ * Impl. Shard i holds the keys in [bounds[i-1], bounds[i]), so operations
+ * on different shards never meet at a common root, and visiting the shards
+ * in order yields the keys in order. Impl needs insert, deleteNode, search
+ * and bulkLoad; rangeQuery is only required when it is used.
+ */
+template <typename Impl>
+class ShardedTree {
+public:
+    // Shard boundaries come from shardBounds(numShards, sample)
+    ShardedTree(int numShards, std::vector<int> sample);
+    ~ShardedTree();
+
+    bool insert(int key) { return shards[shardIndex(key)]->insert(key); }
+    bool deleteNode(int key) { return shards[shardIndex(key)]->deleteNode(key); }
+    bool search(int key) { return shards[shardIndex(key)]->search(key); }
+    void rangeQuery(int lo, int hi, std::vector<int>& out);
+    bool bulkLoad(const int* sorted, size_t n);
+
+    int numShards() const { return shards.size(); }
+    Impl* shard(int i) { return shards[i]; }
+
+private:
+    std::vector<int> bounds;
+    std::vector<Impl*> shards;
+
+    size_t shardIndex(int key) const {
+        return std::upper_bound(bounds.begin(), bounds.end(), key) - bounds.begin();
+    }
+};
+
+template <typename Impl>
+ShardedTree<Impl>::ShardedTree(int numShards, std::vector<int> sample)
+    : bounds(shardBounds(numShards, std::move(sample))) {
+    for (size_t i = 0; i <= bounds.size(); i++)
+        shards.push_back(new Impl());
+}
+
+template <typename Impl>
+ShardedTree<Impl>::~ShardedTree() {
+    for (Impl* t : shards)
+        delete t;
+}
+
+// Shards are visited in key order, so concatenating their answers keeps
+// out sorted. Each shard is read on its own, so the result is not one
+// snapshot of the whole tree when updates run concurrently.
+template <typename Impl>
+void ShardedTree<Impl>::rangeQuery(int lo, int hi, std::vector<int>& out) {
+    out.clear();
+    if (lo > hi)
+        return;
+    std::vector<int> part;
+    for (size_t i = shardIndex(lo), last = shardIndex(hi); i <= last; i++) {
+        shards[i]->rangeQuery(lo, hi, part);
+        out.insert(out.end(), part.begin(), part.end());
+    }
+}
+
+// Cut the sorted keys at the shard boundaries and bulk load every shard
+// with its slice. Fails without loading anything on unsorted input or if any
+// shard holds keys: loading no keys succeeds exactly on an empty tree, so
+// every shard is probed that way first. Updates racing with the load can
+// still make a later shard refuse its slice.
+template <typename Impl>
+bool ShardedTree<Impl>::bulkLoad(const int* sorted, size_t n) {
+    if (std::adjacent_find(sorted, sorted + n, std::greater_equal<int>()) != sorted + n)
+        return false;
+    for (Impl* t : shards) {
+        if (!t->bulkLoad(sorted, 0))
+            return false;
+    }
+    bool ok = true;
+    const int* begin = sorted;
+    for (size_t i = 0; i < shards.size(); i++) {
+        const int* end = i < bounds.size() ? std::lower_bound(begin, sorted + n, bounds[i]) : sorted + n;
+        ok &= shards[i]->bulkLoad(begin, end - begin);
+        begin = end;
+    }
+    return ok;
+}
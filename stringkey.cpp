@@ -0,0 +1,80 @@
+#include "stringkey.h"
+#include <cstring>
+#include <utility>
+
+StringKey::StringKey() : prefix{0, 0}, suffix(nullptr), length(0), owned(false) {}
+
+StringKey::StringKey(std::string_view s) : StringKey(s, true) {}
+
+StringKey StringKey::borrow(std::string_view s) {
+    return StringKey(s, false);
+}
+
+StringKey::StringKey(std::string_view s, bool copy) : suffix(nullptr), length((uint32_t)s.size()), owned(false) {
+    char bytes[STRING_KEY_PREFIX_BYTES] = {};
+    if (!s.empty())
+        memcpy(bytes, s.data(), s.size() < STRING_KEY_PREFIX_BYTES ? s.size() : STRING_KEY_PREFIX_BYTES);
+    for (int i = 0; i < 2; i++) {
+        uint64_t word;
+        memcpy(&word, bytes + 8 * i, 8);
+        prefix[i] = __builtin_bswap64(word);
+    }
+    if (s.size() > STRING_KEY_PREFIX_BYTES) {
+        size_t n = s.size() - STRING_KEY_PREFIX_BYTES;
+        if (copy) {
+            char* own = new char[n];
+            memcpy(own, s.data() + STRING_KEY_PREFIX_BYTES, n);
+            suffix = own;
+            owned = true;
+        }
+        else
+            suffix = s.data() + STRING_KEY_PREFIX_BYTES;
+    }
+}
+
+StringKey::StringKey(const StringKey& other) : prefix{other.prefix[0], other.prefix[1]}, suffix(nullptr), length(other.length), owned(false) {
+    if (other.suffix != nullptr) {
+        size_t n = length - STRING_KEY_PREFIX_BYTES;
+        char* own = new char[n];
+        memcpy(own, other.suffix, n);
+        suffix = own;
+        owned = true;
+    }
+}
+
+// The moved-from key is left empty, so it no longer claims a suffix
+StringKey::StringKey(StringKey&& other) noexcept : prefix{other.prefix[0], other.prefix[1]}, suffix(other.suffix), length(other.length), owned(other.owned) {
+    other.prefix[0] = other.prefix[1] = 0;
+    other.suffix = nullptr;
+    other.length = 0;
+    other.owned = false;
+}
+
+StringKey& StringKey::operator=(StringKey other) noexcept {
+    std::swap(prefix, other.prefix);
+    std::swap(suffix, other.suffix);
+    std::swap(length, other.length);
+    std::swap(owned, other.owned);
+    return *this;
+}
+
+StringKey::~StringKey() {
+    if (owned)
+        delete[] suffix;
+}
+
+size_t StringKey::size() const {
+    return length;
+}
+
+std::string StringKey::str() const {
+    char bytes[STRING_KEY_PREFIX_BYTES];
+    for (int i = 0; i < 2; i++) {
+        uint64_t word = __builtin_bswap64(prefix[i]);
+        memcpy(bytes + 8 * i, &word, 8);
+    }
+    std::string s(bytes, length < STRING_KEY_PREFIX_BYTES ? length : STRING_KEY_PREFIX_BYTES);
+    if (suffix != nullptr)
+        s.append(suffix, length - STRING_KEY_PREFIX_BYTES);
+    return s;
+}
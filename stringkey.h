@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+// Leading bytes of a key kept inside the key itself, as two 64-bit words
+#define STRING_KEY_PREFIX_BYTES 16
+
+/*
+ * String key for AVLMapCG and BronsonTree that keeps its first 16 bytes
+ * inline, so an ordered lookup over keys held through a std::string does
+ * not miss cache on the heap buffer at every level. Each prefix word is stored
+ * byte-swapped, which makes comparing two words as unsigned integers the
+ * same as comparing their bytes with memcmp: ordering is two integer
+ * comparisons, and the out-of-line bytes are only read when the prefixes
+ * tie. Shorter strings are zero-padded; the length breaks such ties, so the
+ * order is exactly std::string's.
+ *
+ * Keys own a copy of the bytes past the prefix. borrow() makes a key that
+ * points into the caller's string instead, for lookups that should not
+ * allocate; the string must outlive it, and copies of it own their bytes.
+ */
+class StringKey {
+public:
+    StringKey();
+    explicit StringKey(std::string_view s);
+    static StringKey borrow(std::string_view s);
+
+    StringKey(const StringKey& other);
+    StringKey(StringKey&& other) noexcept;
+    StringKey& operator=(StringKey other) noexcept;
+    ~StringKey();
+
+    size_t size() const;
+    std::string str() const;
+
+    friend bool operator<(const StringKey& a, const StringKey& b);
+    friend bool operator==(const StringKey& a, const StringKey& b);
+
+private:
+    uint64_t prefix[2];
+    // The bytes past the prefix, nullptr for short keys
+    const char* suffix;
+    uint32_t length;
+    bool owned;
+
+    StringKey(std::string_view s, bool copy);
+};
+
+inline bool operator<(const StringKey& a, const StringKey& b) {
+    if (a.prefix[0] != b.prefix[0])
+        return a.prefix[0] < b.prefix[0];
+    if (a.prefix[1] != b.prefix[1])
+        return a.prefix[1] < b.prefix[1];
+    if (a.length > STRING_KEY_PREFIX_BYTES && b.length > STRING_KEY_PREFIX_BYTES) {
+        size_t n = (a.length < b.length ? a.length : b.length) - STRING_KEY_PREFIX_BYTES;
+        int c = memcmp(a.suffix, b.suffix, n);
+        if (c != 0)
+            return c < 0;
+    }
+    return a.length < b.length;
+}
+
+inline bool operator==(const StringKey& a, const StringKey& b) {
+    return !(a < b) && !(b < a);
+}
+
+// Prints the whole string, for debugging output such as preOrder()
+inline std::ostream& operator<<(std::ostream& os, const StringKey& key) {
+    return os << key.str();
+}
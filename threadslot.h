@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+
+/*
+ * Small per-thread indices below MaxThreads, for structures that keep one
+ * slot per thread in a flat array. A thread claims the lowest free index on
+ * its first call to id() and releases it when it exits, so indices stay
+ * dense. limit() is one past the highest index ever claimed and bounds scans
+ * over the slots. Every MaxThreads value is a separate registry.
+ */
+template <int MaxThreads>
+class ThreadSlots {
+public:
+    static int id() {
+        static thread_local Holder holder;
+        return holder.id;
+    }
+
+    static int limit() {
+        return slotLimit.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Holder {
+        int id;
+
+        Holder() : id(-1) {
+            for (int i = 0; i < MaxThreads; i++) {
+                bool expected = false;
+                if (taken[i].compare_exchange_strong(expected, true)) {
+                    id = i;
+                    break;
+                }
+            }
+            if (id == -1)
+                throw "Too many threads for per-thread slots \n";
+            int current = slotLimit.load();
+            while (current < id + 1 && !slotLimit.compare_exchange_weak(current, id + 1)) {}
+        }
+
+        ~Holder() {
+            taken[id] = false;
+        }
+    };
+
+    static std::atomic<bool> taken[MaxThreads];
+    static std::atomic<int> slotLimit;
+};
+
+template <int MaxThreads>
+std::atomic<bool> ThreadSlots<MaxThreads>::taken[MaxThreads];
+
+template <int MaxThreads>
+std::atomic<int> ThreadSlots<MaxThreads>::slotLimit(0);
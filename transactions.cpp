@@ -0,0 +1,169 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <stdexcept>
+
+// The KCAS tree's AVLTree and Node clash with sequential.h, so its
+// transactions are measured here rather than in batchops.cpp
+#include "lockfree2.h"
+
+#define KEY_SPACE 100000000  // Keys are drawn from (0, KEY_SPACE), inside the sentinels
+
+/* Return n distinct keys drawn uniformly from the key space, in random order */
+std::vector<int> getKeys(int n, std::mt19937& eng) {
+    std::uniform_int_distribution<> distr(1, KEY_SPACE - 1);
+    std::vector<int> v(n);
+    for (int i = 0; i < n; i++)
+        v[i] = distr(eng);
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+    std::shuffle(v.begin(), v.end(), eng);
+    return v;
+}
+
+double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count() * 1000;
+}
+
+/* Run numThreads threads, each calling work(i) for the items of its slice of
+   [0, count), and return the elapsed time */
+template <typename Work>
+double runConcurrently(size_t count, int numThreads, Work work) {
+    std::vector<std::thread> threads;
+    size_t slice = (count + numThreads - 1) / numThreads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            size_t end = std::min(count, (t + 1) * slice);
+            for (size_t i = t * slice; i < end; i++)
+                work(i);
+        }));
+    }
+    for (auto& t : threads)
+        t.join();
+    return elapsed(start);
+}
+
+AVLTree* loadTree(std::vector<int> keys) {
+    std::sort(keys.begin(), keys.end());
+    AVLTree* tree = new AVLTree();
+    tree->bulkLoad(keys.data(), keys.size());
+    return tree;
+}
+
+/* Insert m fresh keys into a tree of n keys, batchSize keys per insertAll
+   transaction, against inserting the same keys one at a time */
+void testInsertAll(int n, int m, int batchSize, int numThreads, std::mt19937& eng, std::ofstream& outFile) {
+    std::vector<int> keys = getKeys(n + m, eng);
+    std::vector<int> loaded(keys.begin(), keys.begin() + n);
+    std::vector<int> fresh(keys.begin() + n, keys.end());
+    size_t batches = (fresh.size() + batchSize - 1) / batchSize;
+
+    AVLTree* batched = loadTree(loaded);
+    double batchTime = runConcurrently(batches, numThreads, [&](size_t b) {
+        size_t lo = b * batchSize;
+        size_t len = std::min((size_t)batchSize, fresh.size() - lo);
+        if (!batched->insertAll(fresh.data() + lo, len))
+            throw std::runtime_error("insertAll of fresh keys failed");
+    });
+    AVLTree* single = loadTree(loaded);
+    double singleTime = runConcurrently(fresh.size(), numThreads, [&](size_t i) {
+        single->insert(fresh[i]);
+    });
+    for (int k : fresh) {
+        if (!batched->search(k) || !single->search(k))
+            throw std::runtime_error("Inserted key is missing");
+    }
+    outFile << "Insert " << fresh.size() << " keys into " << n << " keys with " << numThreads << " threads, " << batchSize << " per transaction: insertAll " << batchTime << " milliseconds, one at a time " << singleTime << " milliseconds\n";
+    delete batched;
+    delete single;
+}
+
+/* Rename m of n keys: one move transaction per key against a deleteNode
+   followed by an insert, which exposes a moment where neither key is present */
+void testMoves(int n, int m, int numThreads, std::mt19937& eng, std::ofstream& outFile) {
+    std::vector<int> keys = getKeys(n + m, eng);
+    std::vector<int> loaded(keys.begin(), keys.begin() + n);
+    std::vector<int> targets(keys.begin() + n, keys.end());
+
+    AVLTree* moved = loadTree(loaded);
+    double moveTime = runConcurrently(targets.size(), numThreads, [&](size_t i) {
+        if (!moved->move(loaded[i], targets[i]))
+            throw std::runtime_error("move failed");
+    });
+    AVLTree* split = loadTree(loaded);
+    double splitTime = runConcurrently(targets.size(), numThreads, [&](size_t i) {
+        split->deleteNode(loaded[i]);
+        split->insert(targets[i]);
+    });
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (moved->search(loaded[i]) || !moved->search(targets[i]))
+            throw std::runtime_error("move left the wrong keys");
+    }
+    outFile << "Move " << targets.size() << " of " << n << " keys with " << numThreads << " threads: move " << moveTime << " milliseconds, delete then insert " << splitTime << " milliseconds\n";
+    delete moved;
+    delete split;
+}
+
+/* Exchange the values of m disjoint pairs of keys: one swap transaction per
+   pair against reading both values and replacing each in turn */
+void testSwaps(int n, int m, int numThreads, std::mt19937& eng, std::ofstream& outFile) {
+    std::vector<int> keys = getKeys(n, eng);
+    m = std::min(m, (int)keys.size() / 2);
+
+    AVLTree* swapped = loadTree(keys);
+    AVLTree* replaced = loadTree(keys);
+    for (size_t i = 0; i < keys.size(); i++) {
+        swapped->replace(keys[i], 0, (int)i);
+        replaced->replace(keys[i], 0, (int)i);
+    }
+    double swapTime = runConcurrently(m, numThreads, [&](size_t i) {
+        if (!swapped->swap(keys[2 * i], keys[2 * i + 1]))
+            throw std::runtime_error("swap failed");
+    });
+    double replaceTime = runConcurrently(m, numThreads, [&](size_t i) {
+        int a = keys[2 * i], b = keys[2 * i + 1];
+        int va = *replaced->get(a), vb = *replaced->get(b);
+        replaced->replace(a, va, vb);
+        replaced->replace(b, vb, va);
+    });
+    for (int i = 0; i < m; i++) {
+        if (*swapped->get(keys[2 * i]) != 2 * i + 1 || *swapped->get(keys[2 * i + 1]) != 2 * i)
+            throw std::runtime_error("swap left the wrong values");
+    }
+    outFile << "Swap " << m << " pairs of values among " << keys.size() << " keys with " << numThreads << " threads: swap " << swapTime << " milliseconds, get and replace " << replaceTime << " milliseconds\n";
+    delete swapped;
+    delete replaced;
+}
+
+int main() {
+    // Constructing the file path
+    std::string filePath = "./result/transactions_results.txt";
+
+    // Opening the file
+    std::ofstream outputFile(filePath);
+    if (!outputFile.is_open()) {
+        std::cerr << "Error: Could not open the file." << std::endl;
+        return 1;
+    }
+
+    std::random_device rd;
+    std::mt19937 eng(rd());
+    std::vector<int> threadCounts = {1, 2, 4, 8, 16, 32, 64, 128};
+    for (int batchSize : {1, 4, 16, 64, 256}) {
+        for (int numThreads : threadCounts)
+            testInsertAll(1000000, 100000, batchSize, numThreads, eng, outputFile);
+    }
+    for (int numThreads : threadCounts)
+        testMoves(1000000, 100000, numThreads, eng, outputFile);
+    for (int numThreads : threadCounts)
+        testSwaps(1000000, 100000, numThreads, eng, outputFile);
+    std::cout << "Transaction results written to '" << filePath << "'\n";
+
+    outputFile.close();
+    return 0;
+}